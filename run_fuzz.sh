@@ -4,7 +4,7 @@ export AFL_SKIP_CPUFREQ=1
 
 # taken from https://stackoverflow.com/questions/3685970/check-if-a-bash-array-contains-a-value
 IFS="|"
-targets=("lexer")
+targets=("lexer" "parser")
 
 if (($# != 1))
 then
@@ -17,7 +17,13 @@ if [[ ! "${IFS}${targets[*]}${IFS}" =~ "${IFS}$1${IFS}" ]]; then
   exit 1
 fi
 
-afl-fuzz -i fuzzer_corpus -c build/${1}_harness_cmplog -o afl-out -- build/${1}_harness
+# the parser gets further with inputs that keep looking like funlang
+if [[ "$1" == "parser" ]]
+then
+  export AFL_CUSTOM_MUTATOR_LIBRARY=build/funlang_mutator.so
+fi
+
+afl-fuzz -i fuzzer_corpus -x funlang.dict -c build/${1}_harness_cmplog -o afl-out -- build/${1}_harness
 
 unset IFS
 unset ALF_SKIP_CPUFREQ
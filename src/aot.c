@@ -0,0 +1,295 @@
+/*
+ * Ahead of time compilation into ELF relocatable objects.
+ *
+ *  the code is the same the JIT produces. since functions don't reference
+ *  anything, the object needs no relocations: just the text, a symbol per
+ *  function and the string tables. the whole object is built in memory and
+ *  written at once.
+ */
+
+#include "aot.h"
+#include "hashtable.h"
+#include "x64.h"
+#include <elf.h>
+
+enum
+{
+  SEC_NULL,
+  SEC_TEXT,
+  SEC_SYMTAB,
+  SEC_STRTAB,
+  SEC_SHSTRTAB,
+  SEC_NOTE_STACK, // marks the stack as non executable
+  SEC_COUNT,
+};
+
+static const char shstrtab[] =
+    "\0.text\0.symtab\0.strtab\0.shstrtab\0.note.GNU-stack";
+
+// offsets of the names in shstrtab
+static const uint32_t sec_names[SEC_COUNT] = {0, 1, 7, 15, 23, 33};
+
+// `name[u32,s8]` becomes `name__u32_s8`, which C can call
+static void c_name(DynamicArray *restrict out, StrView name)
+{
+  for (const char *s = name.txt; s < name.txt + name.len; ++s)
+  {
+    switch (*s)
+    {
+    case '[': co_append(out, "__", 2); break;
+    case ',': co_append(out, "_", 1); break;
+    case ']':
+    case ' ': break;
+    default:  co_append(out, s, 1); break;
+    }
+  }
+}
+
+// the lowercase keywords of C and the types of <stdint.h> the header uses,
+// the only C names a function name can run into
+static const char *const c_reserved[] = {
+    "alignas", "alignof", "auto", "bool", "break", "case", "char", "const",
+    "constexpr", "continue", "default", "do", "double", "else", "enum",
+    "extern", "false", "float", "for", "goto", "if", "inline", "int", "long",
+    "nullptr", "register", "restrict", "return", "short", "signed", "sizeof",
+    "static", "static_assert", "struct", "switch", "thread_local", "true",
+    "typedef", "typeof", "typeof_unqual", "union", "unsigned", "void",
+    "volatile", "while", "int8_t", "int16_t", "int32_t", "int64_t", "uint8_t",
+    "uint16_t", "uint32_t", "uint64_t",
+};
+
+#define NRESERVED (sizeof(c_reserved) / sizeof(c_reserved[0]))
+
+uint32_t c_name_clashes(const IR *ir, FILE *diag)
+{
+  const IRFunc *funcs = ir->funcs.buffer;
+  DynamicArray name = {}, other = {}; // char
+  HSet seen = {};
+
+  // the set puts a length prefix before every name
+  size_t bytes = 0;
+  for (uint32_t r = 0; r < NRESERVED; ++r)
+    bytes += strlen(c_reserved[r]) + sizeof(uint32_t);
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+    bytes += funcs[fn].name.len + 1 + sizeof(uint32_t);
+  hset_reserve(&seen, bytes);
+
+  for (uint32_t r = 0; r < NRESERVED; ++r)
+  {
+    const char *kw = c_reserved[r];
+    (void)insert(&seen, (char *)kw, (uint32_t)strlen(kw));
+  }
+  uint32_t reserved_end = seen.intrn.len;
+
+  uint32_t nclashes = 0;
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+  {
+    StrView f = funcs[fn].name;
+    if (funcs[fn].nparams > X64_MAX_PARAMS) continue; // never defined
+
+    name.len = 0;
+    c_name(&name, f);
+
+    uint32_t before = seen.inuse;
+    StrView c       = insert(&seen, name.buffer, name.len);
+    if (seen.inuse != before) continue;
+
+    nclashes++;
+    if (interned_off(&seen, c) < reserved_end)
+    {
+      fprintf(diag, "%.*s can't be called %.*s in C, which reserves it\n",
+              (int)f.len, f.txt, (int)c.len, c.txt);
+      continue;
+    }
+
+    // the function that took the name first, only looked for on errors
+    for (uint32_t prev = 0; prev < fn; ++prev)
+    {
+      other.len = 0;
+      c_name(&other, funcs[prev].name);
+      if (other.len != c.len || memcmp(other.buffer, c.txt, c.len)) continue;
+
+      fprintf(diag, "%.*s and %.*s are both called %.*s in C\n",
+              (int)funcs[prev].name.len, funcs[prev].name.txt, (int)f.len,
+              f.txt, (int)c.len, c.txt);
+      break;
+    }
+  }
+
+  free(name.buffer);
+  free(other.buffer);
+  free_hset(seen);
+
+  return nclashes;
+}
+
+static void align(DynamicArray *restrict buf, uint32_t to)
+{
+  while (buf->len & (to - 1))
+  {
+    uint8_t zero = 0;
+    co_push(buf, zero);
+  }
+}
+
+uint32_t write_elf(FILE *out, const IR *ir)
+{
+  DynamicArray obj  = {}; // uint8_t, the whole file
+  DynamicArray syms = {}; // Elf64_Sym
+  DynamicArray strs = {}; // char
+
+  uint8_t nul = 0;
+  co_push(&strs, nul);
+
+  Elf64_Sym sym = {};
+  co_push(&syms, sym);
+  sym.st_info  = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+  sym.st_shndx = SEC_TEXT;
+  co_push(&syms, sym);
+
+  Elf64_Ehdr eh = {};
+  co_append(&obj, (uint8_t *)&eh, sizeof(eh));
+  align(&obj, 16);
+
+  uint32_t skipped    = 0;
+  uint32_t text       = obj.len;
+  const IRFunc *funcs = ir->funcs.buffer;
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+  {
+    align(&obj, 16);
+
+    uint32_t off = obj.len;
+    if (!emit_x64(&obj, ir, funcs + fn))
+    {
+      skipped++;
+      continue;
+    }
+
+    sym = (Elf64_Sym){
+        .st_name  = strs.len,
+        .st_info  = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC),
+        .st_shndx = SEC_TEXT,
+        .st_value = off - text,
+        .st_size  = obj.len - off,
+    };
+    co_push(&syms, sym);
+
+    c_name(&strs, funcs[fn].name);
+    co_push(&strs, nul);
+  }
+
+  Elf64_Shdr sh[SEC_COUNT] = {};
+  for (uint32_t s = 0; s < SEC_COUNT; ++s)
+    sh[s].sh_name = sec_names[s];
+
+  sh[SEC_TEXT] = (Elf64_Shdr){
+      .sh_name      = sec_names[SEC_TEXT],
+      .sh_type      = SHT_PROGBITS,
+      .sh_flags     = SHF_ALLOC | SHF_EXECINSTR,
+      .sh_offset    = text,
+      .sh_size      = obj.len - text,
+      .sh_addralign = 16,
+  };
+
+  align(&obj, 8);
+  sh[SEC_SYMTAB] = (Elf64_Shdr){
+      .sh_name      = sec_names[SEC_SYMTAB],
+      .sh_type      = SHT_SYMTAB,
+      .sh_offset    = obj.len,
+      .sh_size      = syms.len * sizeof(Elf64_Sym),
+      .sh_link      = SEC_STRTAB,
+      .sh_info      = 2, // index of the first global
+      .sh_addralign = 8,
+      .sh_entsize   = sizeof(Elf64_Sym),
+  };
+  co_append(&obj, (uint8_t *)syms.buffer, syms.len * sizeof(Elf64_Sym));
+
+  sh[SEC_STRTAB] = (Elf64_Shdr){
+      .sh_name      = sec_names[SEC_STRTAB],
+      .sh_type      = SHT_STRTAB,
+      .sh_offset    = obj.len,
+      .sh_size      = strs.len,
+      .sh_addralign = 1,
+  };
+  co_append(&obj, (uint8_t *)strs.buffer, strs.len);
+
+  sh[SEC_SHSTRTAB] = (Elf64_Shdr){
+      .sh_name      = sec_names[SEC_SHSTRTAB],
+      .sh_type      = SHT_STRTAB,
+      .sh_offset    = obj.len,
+      .sh_size      = sizeof(shstrtab),
+      .sh_addralign = 1,
+  };
+  co_append(&obj, (const uint8_t *)shstrtab, sizeof(shstrtab));
+
+  sh[SEC_NOTE_STACK].sh_type      = SHT_PROGBITS;
+  sh[SEC_NOTE_STACK].sh_offset    = obj.len;
+  sh[SEC_NOTE_STACK].sh_addralign = 1;
+
+  align(&obj, 8);
+  uint32_t shoff = obj.len;
+  co_append(&obj, (uint8_t *)sh, sizeof(sh));
+
+  eh = (Elf64_Ehdr){
+      .e_ident     = {ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64,
+                      ELFDATA2LSB, EV_CURRENT, ELFOSABI_SYSV},
+      .e_type      = ET_REL,
+      .e_machine   = EM_X86_64,
+      .e_version   = EV_CURRENT,
+      .e_shoff     = shoff,
+      .e_ehsize    = sizeof(Elf64_Ehdr),
+      .e_shentsize = sizeof(Elf64_Shdr),
+      .e_shnum     = SEC_COUNT,
+      .e_shstrndx  = SEC_SHSTRTAB,
+  };
+  memcpy(obj.buffer, &eh, sizeof(eh));
+
+  (void)fwrite(obj.buffer, 1, obj.len, out);
+
+  free(obj.buffer);
+  free(syms.buffer);
+  free(strs.buffer);
+
+  return skipped;
+}
+
+static const char *c_type(TypeId ty)
+{
+  switch (ty)
+  {
+  case U8:  return "uint8_t";
+  case U16: return "uint16_t";
+  case U32: return "uint32_t";
+  case U64: return "uint64_t";
+  case S8:  return "int8_t";
+  case S16: return "int16_t";
+  case S32: return "int32_t";
+  default:  return "int64_t";
+  }
+}
+
+void write_c_header(FILE *out, const IR *ir)
+{
+  DynamicArray name = {};
+  const IRFunc *funcs = ir->funcs.buffer;
+
+  fprintf(out, "#pragma once\n\n#include <stdint.h>\n\n");
+
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+  {
+    const IRFunc *f = funcs + fn;
+    if (f->nparams > X64_MAX_PARAMS) continue;
+
+    name.len = 0;
+    c_name(&name, f->name);
+
+    uint32_t base = ((const IRBlock *)ir->blocks.buffer)[f->blk_beg].beg;
+    fprintf(out, "%s %.*s(", c_type(f->ret), (int)name.len,
+            (char *)name.buffer);
+    for (uint32_t p = 0; p < f->nparams; ++p)
+      fprintf(out, "%s%s", p ? ", " : "", c_type(ir->ty[base + p]));
+    fprintf(out, "%s);\n", f->nparams ? "" : "void");
+  }
+
+  free(name.buffer);
+}
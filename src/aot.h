@@ -0,0 +1,20 @@
+#ifndef _AOT_H
+#define _AOT_H
+
+#include "ir.h"
+
+// writes an x86-64 ELF relocatable object defining a global function symbol
+// for every IR function the backend can compile. instances are named like
+// `name__u32_s8` to be callable from C. returns the number of functions that
+// had to be left out
+[[nodiscard]] uint32_t write_elf(FILE *out, const IR *ir);
+
+// reports every function that would be defined under the same C name as an
+// earlier one, like `id[u8]` and `id__u8`, or under a C keyword, and returns
+// how many there are. the object and header of an IR with any are broken
+[[nodiscard]] uint32_t c_name_clashes(const IR *ir, FILE *diag);
+
+// writes C prototypes for the functions `write_elf` defines
+void write_c_header(FILE *out, const IR *ir);
+
+#endif // _AOT_H
@@ -0,0 +1,201 @@
+/*
+ * On disk cache of parse results, keyed by a hash of the source.
+ *
+ *  an entry is an image of the columns of the tree, its literals and the
+ *  interned names, where every StrView points at an offset into the names
+ *  instead of an address:
+ *
+ *    CacheHeader | data[nnodes] | pos[nnodes] | uint64_t[nlits]
+ *                | SetEntry[encap] | kind[nnodes] | char[nintern]
+ *
+ *  loading maps the file, copies the parts into memory owned like the
+ *  result of `parse` and adds the address of the names back into the hash
+ *  table. symbols are offsets already, so the tree is copied as is, and the
+ *  hash table is stored as is, so nothing has to be rehashed.
+ */
+
+#include "cache.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC 0x4350464c /* "LFPC" */
+#define CACHE_VERSION 7        /* bump whenever PTree or the layout changes */
+
+typedef struct
+{
+  uint32_t magic, version;
+  uint64_t hash, src_len;
+  uint32_t nnodes, nlits, encap, inuse, nintern;
+} CacheHeader;
+
+// the bytes go last, so that every other column stays aligned
+static size_t image_size(const CacheHeader *h)
+{
+  return sizeof(*h) + h->nnodes * (2 * sizeof(uint32_t) + 1) +
+         h->nlits * sizeof(uint64_t) + h->encap * sizeof(SetEntry) +
+         h->nintern;
+}
+
+// an empty slot is 0, so offsets are stored plus one
+static const char *to_offset(const char *txt, const char *base)
+{
+  return (const char *)(txt ? (uintptr_t)(txt - base) + 1 : 0);
+}
+
+static const char *from_offset(const char *off, const char *base)
+{
+  return off ? base + ((uintptr_t)off - 1) : NULL;
+}
+
+void cache_path(char *buf, size_t size, const char *dir, uint64_t key,
+                const char *ext)
+{
+  (void)snprintf(buf, size, "%s/%016lx.%s", dir, key, ext);
+}
+
+const void *cache_map(const char *path, size_t *size)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) || !st.st_size)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  *size     = (size_t)st.st_size;
+  void *img = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  return img == MAP_FAILED ? NULL : img;
+}
+
+void cache_unmap(const void *img, size_t size) { munmap((void *)img, size); }
+
+void cache_put(const char *dir, const char *path, const void *img, size_t size)
+{
+  (void)mkdir(dir, 0755);
+
+  // written under a private name first, so readers never see half an entry
+  char tmp[4096 + 8];
+  (void)snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+  int fd = mkstemp(tmp);
+  if (fd < 0) return;
+
+  bool ok = write(fd, img, size) == (ssize_t)size;
+  ok &= !close(fd);
+  if (!ok || rename(tmp, path)) (void)unlink(tmp);
+}
+
+bool cache_load(const char *dir, const char *src, size_t len, ParseRes *pr)
+{
+  uint64_t hash = fnv_64_buf(src, len);
+
+  char path[4096];
+  cache_path(path, sizeof(path), dir, hash, "fpc");
+
+  size_t size;
+  const char *img = cache_map(path, &size);
+  if (!img) return false;
+
+  CacheHeader h = {};
+  memcpy(&h, img, MIN(size, sizeof(h)));
+
+  bool hit = size >= sizeof(h) && h.magic == CACHE_MAGIC &&
+             h.version == CACHE_VERSION && h.hash == hash && h.src_len == len &&
+             image_size(&h) == size;
+  if (!hit) goto out;
+
+  // the image is only read from, the casts just make a tree to copy from
+  const uint32_t *data  = (const uint32_t *)(img + sizeof(h));
+  const uint32_t *pos   = data + h.nnodes;
+  const uint64_t *lits  = (const uint64_t *)(pos + h.nnodes);
+  const SetEntry *entrs = (const SetEntry *)(lits + h.nlits);
+  const uint8_t *kind   = (const uint8_t *)(entrs + h.encap);
+  const char *intern    = (const char *)(kind + h.nnodes);
+  PTree nodes           = {.kind = (uint8_t *)kind,
+                           .data = (uint32_t *)data,
+                           .pos  = (uint32_t *)pos};
+
+  pr->size  = h.nnodes;
+  pr->err   = (ParseErr){};
+  pr->names = hset_from_bytes(intern, h.nintern,
+                              h.nintern + PARSE_NAMES_SLACK, h.encap);
+  pr->lits  = (DynamicArray){.mem = MEM_TREE};
+  pr->tree  = (PTree){};
+  co_append(&pr->lits, lits, h.nlits);
+  append_nodes(&pr->tree, &nodes, 0, h.nnodes);
+
+  const char *base = pr->names.intrn.buffer;
+  pr->tree.lits    = pr->lits.buffer;
+  pr->tree.names   = base;
+
+  pr->names.inuse = h.inuse;
+  for (uint32_t i = 0; i < h.encap; ++i)
+  {
+    pr->names.entrs[i]          = entrs[i];
+    pr->names.entrs[i].skey.txt = from_offset(entrs[i].skey.txt, base);
+  }
+
+out:
+  cache_unmap(img, size);
+  return hit;
+}
+
+void cache_store(const char *dir, const char *src, size_t len,
+                 const ParseRes *pr)
+{
+  if (pr->err.msg) return; // the error would have to be kept too
+
+  CacheHeader h = {
+      .magic   = CACHE_MAGIC,
+      .version = CACHE_VERSION,
+      .hash    = fnv_64_buf(src, len),
+      .src_len = len,
+      .nnodes  = (uint32_t)pr->size,
+      .nlits   = pr->lits.len,
+      .encap   = pr->names.encap,
+      .inuse   = pr->names.inuse,
+      .nintern = pr->names.intrn.len,
+  };
+
+  size_t data = sizeof(h), pos = data + h.nnodes * sizeof(uint32_t);
+  size_t lits = pos + h.nnodes * sizeof(uint32_t);
+  size_t entrs = lits + h.nlits * sizeof(uint64_t);
+  size_t kind  = entrs + h.encap * sizeof(SetEntry), intern = kind + h.nnodes;
+  size_t size  = image_size(&h);
+
+  char *img = malloc(size);
+  assert(img && "failed to allocate cache image");
+
+  const char *base = pr->names.intrn.buffer;
+  memcpy(img, &h, sizeof(h));
+
+  if (h.nnodes)
+  {
+    memcpy(img + data, pr->tree.data, h.nnodes * sizeof(uint32_t));
+    memcpy(img + pos, pr->tree.pos, h.nnodes * sizeof(uint32_t));
+    memcpy(img + kind, pr->tree.kind, h.nnodes);
+  }
+  if (h.nlits) memcpy(img + lits, pr->lits.buffer, h.nlits * sizeof(uint64_t));
+
+  SetEntry *e = (SetEntry *)(img + entrs);
+  for (uint32_t i = 0; i < h.encap; ++i)
+  {
+    e[i]          = pr->names.entrs[i];
+    e[i].skey.txt = to_offset(e[i].skey.txt, base);
+  }
+
+  if (h.nintern) memcpy(img + intern, base, h.nintern);
+
+  char path[4096];
+  cache_path(path, sizeof(path), dir, h.hash, "fpc");
+  cache_put(dir, path, img, size);
+
+  free(img);
+}
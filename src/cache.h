@@ -0,0 +1,27 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include "parser.h"
+
+// looks for the parse of `src` in the cache directory `dir`. on a hit `pr`
+// is filled in, owning its memory just like the result of `parse`
+[[nodiscard]] bool cache_load(const char *dir, const char *src, size_t len,
+                              ParseRes *pr);
+
+// stores the parse of `src` in `dir`, creating it if needed, unless it has an
+// error. failing to do so is not an error, the next run just misses
+void cache_store(const char *dir, const char *src, size_t len,
+                 const ParseRes *pr);
+
+// the path of the entry for `key` in `dir`
+void cache_path(char *buf, size_t size, const char *dir, uint64_t key,
+                const char *ext);
+
+// maps a whole entry read only, NULL if there is none
+[[nodiscard]] const void *cache_map(const char *path, size_t *size);
+void cache_unmap(const void *img, size_t size);
+
+// replaces the entry at `path` in `dir` atomically, creating `dir` if needed
+void cache_put(const char *dir, const char *path, const void *img, size_t size);
+
+#endif // _CACHE_H
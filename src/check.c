@@ -0,0 +1,223 @@
+/*
+ * Type checking.
+ *
+ *  the postorder tree is checked in one forward pass, every operand is typed
+ *  before its user. integer literals start out untyped and are settled once
+ *  they meet a typed operand, an annotation or a return type. since an
+ *  untyped subtree consists only of untyped nodes, every node gets settled
+ *  at most once.
+ *
+ *  functions with implicit arguments are skipped, only their instances are
+ *  checked.
+ */
+
+#include "check.h"
+#include "perf.h"
+
+typedef struct
+{
+  const PTree *tree;
+  const Resolution *res;
+  uint32_t size;
+  TypeId *types;
+  DynamicArray errs;
+} Checker;
+
+static void error(Checker *restrict c, uint32_t node, const char *msg)
+{
+  CheckErr e = {.node = node, .msg = msg};
+  co_push(&c->errs, e);
+}
+
+static bool lit_fits(uint64_t val, TypeId ty)
+{
+  switch (ty)
+  {
+  case U8:  return val <= UINT8_MAX;
+  case U16: return val <= UINT16_MAX;
+  case U32: return val <= UINT32_MAX;
+  case U64: return true;
+  case S8:  return val <= INT8_MAX;
+  case S16: return val <= INT16_MAX;
+  case S32: return val <= INT32_MAX;
+  case S64: return val <= INT64_MAX;
+  default:  return false;
+  }
+}
+
+static void settle(Checker *restrict c, uint32_t root, TypeId ty)
+{
+  for (uint32_t i = root - subtree_size(c->tree, root); i <= root; ++i)
+  {
+    if (c->types[i] != TY_UNTYPED) continue;
+
+    c->types[i] = ty;
+    if (c->tree->kind[i] == LITERAL_INT && !lit_fits(lit_val(c->tree, i), ty))
+      error(c, i, "literal out of range for its type");
+  }
+}
+
+static TypeId unify(Checker *restrict c, uint32_t node, uint32_t l,
+                    uint32_t r)
+{
+  TypeId tl = c->types[l], tr = c->types[r];
+
+  if (tl == TY_NONE || tr == TY_NONE) return TY_NONE; // already reported
+  if (tl == tr) return tl;
+
+  if (tl == TY_UNTYPED) settle(c, l, tr);
+  else if (tr == TY_UNTYPED) settle(c, r, tl);
+  else
+  {
+    error(c, node, "mismatched operand types");
+    return TY_NONE;
+  }
+
+  return tl == TY_UNTYPED ? tr : tl;
+}
+
+static void expect(Checker *restrict c, uint32_t node, uint32_t root,
+                   TypeId ty)
+{
+  TypeId got = c->types[root];
+
+  if (ty == TY_NONE || got == TY_NONE) return;
+
+  if (got == TY_UNTYPED) settle(c, root, ty);
+  else if (got != ty) error(c, node, "mismatched types");
+}
+
+static void check_stmt(Checker *restrict c, uint32_t semi, TypeId ret)
+{
+  uint32_t first = semi - c->tree->data[semi];
+  uint32_t expr  = semi - 1;
+
+  if (c->tree->kind[first] == STMT_RETURN)
+  {
+    expect(c, semi, expr, ret);
+    return;
+  }
+
+  if (c->tree->kind[first] == STMT_ASSERT ||
+      c->tree->kind[first] == STMT_ASSUME)
+  { // both sides of the comparison have the same type
+    uint32_t cmp = expr - subtree_size(c->tree, expr) - 1;
+    if (unify(c, cmp, cmp - 1, expr) == TY_UNTYPED)
+    {
+      settle(c, cmp - 1, S64);
+      settle(c, expr, S64);
+    }
+    return;
+  }
+
+  // let
+  uint32_t name = first + 1;
+  if (c->types[name] != TY_NONE) // annotated
+  {
+    expect(c, semi, expr, c->types[name]);
+    return;
+  }
+
+  if (c->types[expr] == TY_UNTYPED) settle(c, expr, S64);
+  c->types[name] = c->types[expr];
+}
+
+static uint32_t check_fn(Checker *restrict c, uint32_t start)
+{
+  const PTree *tree = c->tree;
+  uint32_t errs     = c->errs.len;
+  TypeId ret        = TY_NONE;
+  bool has_ret      = false, returns = false;
+
+  uint32_t i = start;
+  for (; i < c->size && tree->kind[i] != FUN_END; ++i)
+  {
+    switch (tree->kind[i])
+    {
+    case BUILTIN_TY: c->types[i] = (TypeId)tree->data[i]; break;
+    case BIND_TY_USE:
+      error(c, i, c->res->binding[i] == RES_UNBOUND ? "unknown type"
+                                                    : "not a type");
+      break;
+    case BIND_TY_JUDGE:
+      c->types[i - tree->data[i]] = c->types[i - 1];
+      break;
+    case FUN_ARROW:
+      ret     = c->types[i - 1];
+      has_ret = true;
+      break;
+    case LITERAL_INT: c->types[i] = TY_UNTYPED; break;
+    case BIND_USE:
+    {
+      uint32_t b = c->res->binding[i];
+
+      if (b == RES_UNBOUND) error(c, i, "unknown name");
+      else if (tree->kind[b - 1] == FUN_INT)
+        error(c, i, "functions are not values");
+      else c->types[i] = c->types[b];
+      break;
+    }
+    case PREFIX_MINUS: c->types[i] = c->types[i - 1]; break;
+    case INFIX_PLUS:
+    {
+      uint32_t r = i - 1;
+      uint32_t l = r - subtree_size(tree, r) - 1;
+
+      c->types[i] = unify(c, i, l, r);
+      break;
+    }
+    case STMT_SEMI:
+      returns |= tree->kind[i - tree->data[i]] == STMT_RETURN;
+      check_stmt(c, i, ret);
+      break;
+    default: break;
+    }
+  }
+
+  if (i == c->size) return i; // unterminated, reported by the parser
+
+  if (!has_ret) error(c, i, "function needs a return type");
+  else if (!returns) error(c, i, "function never returns");
+
+  c->types[i] = c->errs.len == errs ? ret : TY_NONE;
+
+  return i;
+}
+
+Typing check(const PTree *tree, uint32_t size, const Resolution *res)
+{
+  PERF_BEGIN(perf);
+
+  Checker c = {
+      .tree = tree, .res = res, .size = size, .types = calloc(size, 1)};
+  assert((c.types || !size) && "failed to allocate type array");
+
+  for (uint32_t i = 0; i < size; ++i)
+  {
+    if (tree->kind[i] != FUN_INT) continue;
+
+    if (i + 2 < size && tree->kind[i + 2] == IMP_ARGLIST_BEG)
+    { // generic, only its instances are checked
+      i += 2;
+      while (i < size && tree->kind[i] != FUN_END)
+        i++;
+      continue;
+    }
+
+    uint32_t start = i;
+
+    PERF_BEGIN_FN(perf_fn);
+    i = check_fn(&c, start);
+    PERF_END_FN(PERF_CHECK, perf_fn, sym_str(tree, start + 1));
+  }
+
+  PERF_END(PERF_CHECK, perf);
+
+  return (Typing){.types = c.types, .errs = c.errs};
+}
+
+void free_typing(Typing t)
+{
+  free(t.types);
+  free(t.errs.buffer);
+}
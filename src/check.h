@@ -0,0 +1,27 @@
+#ifndef _CHECK_H
+#define _CHECK_H
+
+#include "parser.h"
+#include "resolve.h"
+#include "types.h"
+
+typedef struct
+{
+  uint32_t node;
+  const char *msg;
+} CheckErr;
+
+typedef struct
+{
+  // the type of every node, TY_NONE for nodes that aren't values.
+  // a FUN_END holds the return type of its function if the function
+  // checked without errors, and TY_NONE otherwise (or if it's generic)
+  TypeId *types;
+  DynamicArray errs; // CheckErr
+} Typing;
+
+[[nodiscard]] Typing check(const PTree *tree, uint32_t size,
+                           const Resolution *res);
+void free_typing(Typing t);
+
+#endif // _CHECK_H
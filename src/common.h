@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "mem.h"
+
 #define PHI 1.618033988749894848204586834365638118f
 #define MIN(a, b) ((a < b) ? a : b)
 #define MAX(a, b) ((a > b) ? a : b)
@@ -22,6 +24,7 @@ typedef struct
 {
   void *buffer;
   uint32_t len, cap;
+  uint8_t mem; // MemSys the buffer is charged to
 } DynamicArray;
 
 void grow_array(DynamicArray *restrict array, size_t elem_bytes);
@@ -58,11 +61,18 @@ void grow_array(DynamicArray *restrict array, size_t elem_bytes)
 {
   uint32_t new_cap = next_pow2(array->len + 1);
 
+  uintptr_t old_buf = (uintptr_t)array->buffer;
+  size_t old_size   = array->mem ? mem_size(array->buffer) : 0;
+
   void *new_buf = realloc(array->buffer, elem_bytes * new_cap);
 
   // TODO: actual error handling
   assert(new_buf && "failed to reallocate new_buf");
 
+  if (array->mem)
+    mem_grow(array->mem, old_size, mem_size(new_buf),
+             (uintptr_t)new_buf != old_buf ? old_size : 0);
+
   array->buffer = new_buf;
   array->cap    = new_cap;
 }
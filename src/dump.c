@@ -0,0 +1,378 @@
+/*
+ * Tree dumps, see dump.h.
+ *
+ *  a binary dump is
+ *
+ *    DumpHeader | uint64_t[nlits] | data[nnodes] | pos[nnodes]
+ *               | kind[nnodes] | char[nintern] | kind names
+ *
+ *  where the kind names are NUL terminated and in the order of the kinds
+ *  of the writer. the names are the intern region of the parse, which
+ *  symbols are offsets into, so they need no fixing up either way.
+ */
+
+#include "dump.h"
+#include "cache.h"
+#include "resolve.h"
+
+#define DUMP_MAGIC 0x4454464c /* "LFTD" */
+#define DUMP_VERSION 3
+
+typedef struct
+{
+  uint32_t magic, version;
+  uint32_t nnodes, nlits, nintern;
+  uint32_t nkinds, kind_bytes;
+  uint32_t pad; // keeps the literals after it aligned
+} DumpHeader;
+
+// the payload of a node, named after the formats of PNodeKindMacro
+typedef enum
+{
+  FIELD_NONE,
+  FIELD_subtree_sz,
+  FIELD_literal_int,
+  FIELD_inbuilt,
+  FIELD_str,
+} Field;
+
+typedef struct
+{
+  const char *head;
+  uint8_t head_len;
+  uint8_t field;
+} KindFmt;
+
+#define KIND_HEAD(H) .head = H, .head_len = sizeof(H) - 1
+
+#define DumpKindFmt1(V, ...) [V] = {KIND_HEAD("{ .kind = " #V)},
+#define DumpKindFmt2(V, _, S, F)                                               \
+  [V] = {KIND_HEAD("{ .kind = " #V ", ." #F " = "), .field = FIELD_##F},
+#define DumpKindFmt3(V, ...)                                                   \
+  [V] = {KIND_HEAD("{ .kind = " #V ", .str = "), .field = FIELD_str},
+
+static const KindFmt kind_fmts[] = {
+    PNodeKindMacro(DumpKindFmt1, DumpKindFmt2, DumpKindFmt3)};
+
+#define DumpKindName(V, ...) [V] = #V,
+
+static const char *const kind_names[] = {
+    PNodeKindMacro(DumpKindName, DumpKindName, DumpKindName)};
+
+#define NKINDS (sizeof(kind_names) / sizeof(*kind_names))
+
+const char *pnode_kind_name(uint8_t kind)
+{
+  return kind < NKINDS ? kind_names[kind] : "?";
+}
+
+static const char digit_pairs[] =
+    "000102030405060708091011121314151617181920212223242526272829"
+    "303132333435363738394041424344454647484950515253545556575859"
+    "606162636465666768697071727374757677787980818283848586878889"
+    "90919293949596979899";
+
+DumpBuf *dump_open(FILE *out)
+{
+  DumpBuf *b = malloc(sizeof(*b));
+  assert(b && "failed to allocate dump buffer");
+  b->out = out;
+  b->len = 0;
+  return b;
+}
+
+void dump_flush(DumpBuf *restrict b)
+{
+  if (b->len) (void)fwrite(b->buf, 1, b->len, b->out);
+  b->len = 0;
+}
+
+void dump_close(DumpBuf *b)
+{
+  dump_flush(b);
+  free(b);
+}
+
+// room for `n` more bytes, which must be at most DUMP_BUF
+static char *room(DumpBuf *restrict b, uint32_t n)
+{
+  if (b->len + n > DUMP_BUF) dump_flush(b);
+  return b->buf + b->len;
+}
+
+void dump_str(DumpBuf *restrict b, const char *s, uint32_t len)
+{
+  if (len > DUMP_BUF / 2)
+  {
+    dump_flush(b);
+    (void)fwrite(s, 1, len, b->out);
+    return;
+  }
+
+  memcpy(room(b, len), s, len);
+  b->len += len;
+}
+
+void dump_u64(DumpBuf *restrict b, uint64_t n)
+{
+  // written backwards two digits at a time
+  char tmp[20], *p = tmp + sizeof(tmp);
+  for (; n >= 100; n /= 100)
+    memcpy(p -= 2, digit_pairs + n % 100 * 2, 2);
+  if (n >= 10) memcpy(p -= 2, digit_pairs + n * 2, 2);
+  else *--p = (char)('0' + n);
+
+  dump_str(b, p, (uint32_t)(tmp + sizeof(tmp) - p));
+}
+
+void dump_hex(DumpBuf *restrict b, uint64_t n)
+{
+  char tmp[18], *p = tmp + sizeof(tmp);
+  do
+  {
+    *--p = "0123456789abcdef"[n & 0xf];
+    n >>= 4;
+  } while (n);
+  *--p = 'x';
+  *--p = '0';
+
+  dump_str(b, p, (uint32_t)(tmp + sizeof(tmp) - p));
+}
+
+void dump_tokens(DumpBuf *restrict b, const Token *toks, uint32_t n)
+{
+  for (uint32_t i = 0; i < n; ++i)
+  {
+    dump_hex(b, toks[i].tag & 0xff);
+    dump_str(b, " ", 1);
+  }
+}
+
+void dump_pnode(DumpBuf *restrict b, const PTree *t, uint32_t i)
+{
+  uint8_t kind = t->kind[i];
+  if (kind >= NKINDS) kind = INVALID;
+
+  const KindFmt *f = kind_fmts + kind;
+  dump_str(b, f->head, f->head_len);
+
+  switch ((Field)f->field)
+  {
+  case FIELD_NONE: break;
+  case FIELD_subtree_sz: dump_u64(b, t->data[i]); break;
+  case FIELD_literal_int: dump_u64(b, lit_val(t, i)); break;
+  case FIELD_inbuilt: dump_hex(b, t->data[i]); break;
+  case FIELD_str:
+  {
+    StrView str = sym_str(t, i);
+    dump_str(b, str.txt, str.len);
+    break;
+  }
+  }
+
+  dump_str(b, " }", 2);
+}
+
+void dump_tree(DumpBuf *restrict b, const PTree *t, uint32_t size,
+               const uint32_t *binding)
+{
+  for (uint32_t i = 0; i < size; ++i)
+  {
+    dump_pnode(b, t, i);
+    if (binding && binding[i] != RES_UNBOUND)
+    {
+      dump_str(b, " -> ", 4);
+      dump_u64(b, binding[i]);
+    }
+    dump_str(b, "\n", 1);
+  }
+}
+
+bool dump_bin(const char *path, const ParseRes *pr)
+{
+  DumpHeader h = {
+      .magic   = DUMP_MAGIC,
+      .version = DUMP_VERSION,
+      .nnodes  = (uint32_t)pr->size,
+      .nlits   = pr->lits.len,
+      .nintern = pr->names.intrn.len,
+      .nkinds  = NKINDS,
+  };
+  for (uint32_t k = 0; k < NKINDS; ++k)
+    h.kind_bytes += (uint32_t)strlen(kind_names[k]) + 1;
+
+  size_t lits = sizeof(h), data = lits + h.nlits * sizeof(uint64_t);
+  size_t pos = data + h.nnodes * sizeof(uint32_t);
+  size_t kind = pos + h.nnodes * sizeof(uint32_t), names = kind + h.nnodes;
+  size_t kinds = names + h.nintern, size = kinds + h.kind_bytes;
+
+  char *img = malloc(size);
+  assert(img && "failed to allocate dump image");
+
+  memcpy(img, &h, sizeof(h));
+  if (h.nlits) memcpy(img + lits, pr->lits.buffer, h.nlits * sizeof(uint64_t));
+  if (h.nnodes)
+  {
+    memcpy(img + data, pr->tree.data, h.nnodes * sizeof(uint32_t));
+    memcpy(img + pos, pr->tree.pos, h.nnodes * sizeof(uint32_t));
+    memcpy(img + kind, pr->tree.kind, h.nnodes);
+  }
+  if (h.nintern) memcpy(img + names, pr->names.intrn.buffer, h.nintern);
+
+  char *at = img + kinds;
+  for (uint32_t k = 0; k < NKINDS; ++k)
+  {
+    size_t len = strlen(kind_names[k]) + 1;
+    memcpy(at, kind_names[k], len);
+    at += len;
+  }
+
+  FILE *f = fopen(path, "wb");
+  bool ok = f && fwrite(img, 1, size, f) == size;
+  ok &= f && !fclose(f);
+
+  free(img);
+  return ok;
+}
+
+bool is_dump(const char *path)
+{
+  FILE *f        = fopen(path, "rb");
+  uint32_t magic = 0;
+  if (!f) return false;
+
+  bool ok = fread(&magic, sizeof(magic), 1, f) == 1 && magic == DUMP_MAGIC;
+  (void)fclose(f);
+  return ok;
+}
+
+// do the payloads of the nodes of `t` stay within the dump. a dump may come
+// from anywhere, and everything that reads a tree trusts them
+static bool payloads_valid(const PTree *t, uint32_t nlits, uint32_t nintern)
+{
+  for (uint32_t i = 0; i < t->len; ++i)
+  {
+    uint32_t d = t->data[i];
+
+    if (has_sym(t->kind[i]))
+    {
+      uint32_t len;
+      if (d < sizeof(len) || d > nintern) return false;
+
+      memcpy(&len, t->names + d - sizeof(len), sizeof(len));
+      if (len > nintern - d) return false;
+    }
+    else if (t->kind[i] == LITERAL_INT && !(d & LIT_INLINE) &&
+             d >> 1 >= nlits)
+      return false;
+    else if (subtree_size(t, i) > i) return false;
+  }
+  return true;
+}
+
+bool read_dump(const char *path, TreeDump *d)
+{
+  size_t size;
+  const char *img = cache_map(path, &size);
+  if (!img) return false;
+
+  DumpHeader h = {};
+  memcpy(&h, img, MIN(size, sizeof(h)));
+
+  size_t lits = sizeof(h), data = lits + (size_t)h.nlits * sizeof(uint64_t);
+  size_t pos  = data + (size_t)h.nnodes * sizeof(uint32_t);
+  size_t kind = pos + (size_t)h.nnodes * sizeof(uint32_t);
+  size_t names = kind + h.nnodes, kinds = names + h.nintern;
+
+  if (size < sizeof(h) || h.magic != DUMP_MAGIC ||
+      h.version != DUMP_VERSION || h.nkinds > 256 ||
+      kinds + h.kind_bytes != size || (h.kind_bytes && img[size - 1]))
+  {
+    cache_unmap(img, size);
+    return false;
+  }
+
+  // the kinds of the writer to ours, by name
+  uint8_t map[256] = {};
+  const char *name = img + kinds;
+  for (uint32_t k = 0; k < h.nkinds && name < img + size; ++k)
+  {
+    for (uint32_t our = 0; our < NKINDS; ++our)
+      if (!strcmp(name, kind_names[our])) map[k] = (uint8_t)our;
+    name += strlen(name) + 1;
+  }
+
+  uint8_t *our_kinds = malloc(h.nnodes + 1);
+  assert(our_kinds && "failed to allocate dump kinds");
+
+  *d = (TreeDump){.size = h.nnodes, .img = img, .img_size = size};
+  for (uint32_t i = 0; i < h.nnodes; ++i)
+  {
+    uint8_t k    = (uint8_t)img[kind + i];
+    our_kinds[i] = k < h.nkinds ? map[k] : INVALID;
+    d->unknown += our_kinds[i] == INVALID && k != INVALID;
+  }
+
+  // the image is only read from, the casts just make a tree of it
+  d->tree = (PTree){.kind  = our_kinds,
+                    .data  = (uint32_t *)(img + data),
+                    .pos   = (uint32_t *)(img + pos),
+                    .len   = h.nnodes,
+                    .cap   = h.nnodes,
+                    .lits  = (const uint64_t *)(img + lits),
+                    .names = img + names};
+
+  if (!payloads_valid(&d->tree, h.nlits, h.nintern))
+  {
+    free_dump(*d);
+    return false;
+  }
+  return true;
+}
+
+void free_dump(TreeDump d)
+{
+  free(d.tree.kind);
+  cache_unmap(d.img, d.img_size);
+}
+
+// do the payloads of `a` and `b`, of the same kind, mean the same
+static bool same_payload(const PTree *a, uint32_t i, const PTree *b,
+                         uint32_t j)
+{
+  if (has_sym(a->kind[i]))
+  {
+    StrView x = sym_str(a, i), y = sym_str(b, j);
+    return x.len == y.len && !memcmp(x.txt, y.txt, x.len);
+  }
+  if (a->kind[i] == LITERAL_INT) return lit_val(a, i) == lit_val(b, j);
+  return a->data[i] == b->data[j];
+}
+
+static void diff_line(DumpBuf *restrict out, char side, const PTree *t,
+                      uint32_t i)
+{
+  dump_str(out, &side, 1);
+  dump_str(out, " ", 1);
+  dump_u64(out, i);
+  dump_str(out, ": ", 2);
+  dump_pnode(out, t, i);
+  dump_str(out, "\n", 1);
+}
+
+uint32_t dump_diff(DumpBuf *restrict out, const PTree *a, uint32_t na,
+                   const PTree *b, uint32_t nb, uint32_t max)
+{
+  uint32_t diffs = 0;
+  for (uint32_t i = 0; i < MAX(na, nb); ++i)
+  {
+    if (i < na && i < nb && a->kind[i] == b->kind[i] &&
+        same_payload(a, i, b, i))
+      continue;
+
+    if (diffs++ >= max) continue;
+    if (i < na) diff_line(out, '<', a, i);
+    if (i < nb) diff_line(out, '>', b, i);
+  }
+  return diffs;
+}
@@ -0,0 +1,82 @@
+#ifndef _DUMP_H
+#define _DUMP_H
+
+#include "parser.h"
+#include <stdio.h>
+
+/*
+ * Dumps of parse trees, as text and as a binary image.
+ *
+ *  the text of a node is what print_pnode used to print, built from tables
+ *  made out of PNodeKindMacro and integers formatted by hand into a buffer
+ *  that goes out in big writes.
+ *
+ *  the binary dump is the columns of the tree with its literals and names,
+ *  and the names of the kinds, so a dump made by another version of the
+ *  compiler still reads back with the kinds it knew. two dumps, or a dump
+ *  and a fresh parse, can be compared node by node.
+ */
+
+#define DUMP_BUF (1u << 16)
+
+typedef struct
+{
+  FILE *out;
+  uint32_t len;
+  char buf[DUMP_BUF];
+} DumpBuf;
+
+[[nodiscard]] DumpBuf *dump_open(FILE *out);
+
+// writes out what is buffered
+void dump_flush(DumpBuf *restrict b);
+
+// flushes and frees `b`
+void dump_close(DumpBuf *b);
+
+void dump_str(DumpBuf *restrict b, const char *s, uint32_t len);
+void dump_u64(DumpBuf *restrict b, uint64_t n);
+void dump_hex(DumpBuf *restrict b, uint64_t n);
+
+// the tags of the tokens, in hex separated by spaces
+void dump_tokens(DumpBuf *restrict b, const Token *toks, uint32_t n);
+
+// node `i` of `t`, like `{ .kind = FUN_END, .subtree_sz = 12 }`
+void dump_pnode(DumpBuf *restrict b, const PTree *t, uint32_t i);
+
+// every node on a line of its own, followed by ` -> ` and the node it binds
+// to if `binding` (from a Resolution) is given
+void dump_tree(DumpBuf *restrict b, const PTree *t, uint32_t size,
+               const uint32_t *binding);
+
+// the name of a kind, "?" past the last
+[[nodiscard]] const char *pnode_kind_name(uint8_t kind);
+
+// writes the binary dump of `pr` to `path`, false if that failed
+[[nodiscard]] bool dump_bin(const char *path, const ParseRes *pr);
+
+typedef struct
+{
+  PTree tree; // the kinds are our own, mapped by name
+  uint32_t size;
+  uint32_t unknown; // nodes of kinds we don't know, read as INVALID
+
+  const void *img;
+  size_t img_size;
+} TreeDump;
+
+// maps the binary dump at `path`, false if it isn't one or if any of its
+// nodes has a name, literal or subtree outside of it
+[[nodiscard]] bool read_dump(const char *path, TreeDump *d);
+void free_dump(TreeDump d);
+
+// is the file at `path` a binary dump
+[[nodiscard]] bool is_dump(const char *path);
+
+// writes the nodes that differ between `a` and `b` to `out`, at most
+// `max`, comparing names and literals by value and not positions. returns
+// the number of differing nodes
+uint32_t dump_diff(DumpBuf *restrict out, const PTree *a, uint32_t na,
+                   const PTree *b, uint32_t nb, uint32_t max);
+
+#endif // _DUMP_H
@@ -0,0 +1,346 @@
+/*
+ * Canonical formatter, see fmt.h.
+ *
+ *  the bytes between two tokens are whitespace and comments, and whatever
+ *  the lexer couldn't make a token of. comments and such junk are kept,
+ *  the whitespace is replaced by the separator the two tokens call for.
+ *  separators are only decided when the next thing is about to be written,
+ *  so a comment can sit between a token and its newline.
+ */
+
+#include "fmt.h"
+#include "perf.h"
+#include <ctype.h>
+
+// indentation deeper than this is cut off, only broken sources get there
+#define MAX_INDENT 16
+
+// tokens this short are copied with one fixed size move
+#define SHORT_TOK 16
+
+// what goes before the next token, stronger ones win
+typedef enum
+{
+  SEP_NONE,
+  SEP_SPACE,
+  SEP_LINE,
+  SEP_BLANK, // a line with nothing on it in between
+} Sep;
+
+typedef struct
+{
+  const char *src;
+  char *beg; // where the formatted region starts in the output
+  char *at;
+  uint32_t depth;
+  Sep need;
+} Fmt;
+
+size_t fmt_bound(uint32_t len, uint32_t ntoks)
+{
+  // every token and every comment or piece of junk, of which there are
+  // less than bytes, gets at most a separator of two newlines and indent.
+  // fixed size moves write up to a token or indent past the end
+  return (size_t)len + ((size_t)ntoks + len + 1) * (MAX_INDENT + 3) +
+         SHORT_TOK + MAX_INDENT + 2;
+}
+
+static TokTag tag_of(const Token *t) { return (TokTag)(t->tag & 0xff); }
+
+static bool is_word(char c)
+{
+  return (uint8_t)((c | 0x20) - 'a') < 26 || (uint8_t)(c - '0') < 10 ||
+         c == '_';
+}
+
+// isspace of the C locale, without the lookup through the locale
+static bool is_ws(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+// where the text of `t` starts, a string token points past its quote
+static uint32_t tok_beg(const Token *t)
+{
+  return tag_of(t) == TOK_LIT_STR ? t->pos - 1 : t->pos;
+}
+
+// keywords are grouped by their length, `->` and `<:` with `fn`
+static const uint8_t kw_len[4] = {2, 3, 4, 6};
+
+// past the text of `t`, scanned like the lexer did
+static uint32_t tok_end(const char *src, uint32_t len, const Token *t)
+{
+  uint32_t p = t->pos;
+  switch (tag_of(t))
+  {
+  case TOK_LIT_STR:
+    // no escape keeps the lexer from ending at a quote
+    while (p < len && src[p] != '"')
+      p++;
+    return MIN(p + 1, len);
+  case TOK_LIT_INT:
+    // the prefixes strtoll takes with a base of 0
+    if (src[p] == '0' && (src[p + 1] | 0x20) == 'x' && isxdigit((uint8_t)src[p + 2]))
+      for (p += 2; p < len && isxdigit((uint8_t)src[p]);)
+        p++;
+    else if (src[p] == '0')
+      for (p++; p < len && src[p] >= '0' && src[p] <= '7';)
+        p++;
+    else
+      while (p < len && isdigit((uint8_t)src[p]))
+        p++;
+    return p;
+  case TOK_VAL_ID:
+  case TOK_TYPE_ID:
+    // the intern keeps the low byte of the length, a longer name goes on
+    p += (uint32_t)t->as_intern.len >> 8;
+    break;
+  default:
+    if (tag_of(t) & TOK_KEYOWRD_) return p + kw_len[tag_of(t) >> 4 & 3];
+    if (!is_word(src[p])) return p + 1;
+    break;
+  }
+
+  while (p < len && is_word(src[p]))
+    p++;
+  return p;
+}
+
+// what spacing needs to know of a kind of token
+enum
+{
+  TK_OPERAND = 1 << 0, // ends an operand, so a `-` after it subtracts
+  TK_HUG_L   = 1 << 1, // no space before it
+  TK_HUG_R   = 1 << 2, // no space after it
+  TK_CALL    = 1 << 3, // no space before it after a callee
+  TK_CALLEE  = 1 << 4, // calls and type arguments hug it
+};
+
+static const uint8_t tok_kinds[256] = {
+    [TOK_INVALID] = TK_HUG_R, // the start
+    [TOK_LIT_INT] = TK_OPERAND,
+    [TOK_LIT_STR] = TK_OPERAND,
+    [TOK_VAL_ID]  = TK_OPERAND | TK_CALLEE,
+    [TOK_TYPE_ID] = TK_OPERAND,
+    [TOK_PAREN_O] = TK_HUG_R | TK_CALL,
+    [TOK_PAREN_C] = TK_OPERAND | TK_HUG_L,
+    [TOK_BRACK_O] = TK_HUG_R | TK_CALL,
+    [TOK_BRACK_C] = TK_OPERAND | TK_HUG_L | TK_CALLEE,
+    [TOK_COLON]   = TK_HUG_L,
+    [TOK_SEMI]    = TK_HUG_L,
+    [',']         = TK_HUG_L,
+    [TOK_KW_U8]   = TK_OPERAND,
+    [TOK_KW_S8]   = TK_OPERAND,
+    [TOK_KW_U16]  = TK_OPERAND,
+    [TOK_KW_U32]  = TK_OPERAND,
+    [TOK_KW_U64]  = TK_OPERAND,
+    [TOK_KW_S16]  = TK_OPERAND,
+    [TOK_KW_S32]  = TK_OPERAND,
+    [TOK_KW_S64]  = TK_OPERAND,
+    [TOK_KW_HOLE] = TK_OPERAND,
+};
+
+// the separator due after a token, before the next one is known
+static const Sep tok_need[256] = {
+    [TOK_BRACE_O] = SEP_LINE,
+    [TOK_SEMI]    = SEP_LINE,
+};
+
+// copies `n` bytes of `s`, which has at least `avail`, to `at`
+static char *put(char *at, const char *s, uint32_t n, uint32_t avail)
+{
+  if (n <= SHORT_TOK && avail >= SHORT_TOK) memcpy(at, s, SHORT_TOK);
+  else memcpy(at, s, n);
+  return at + n;
+}
+
+// writes the separator `sep` to `at`, a new line is indented `depth` deep
+static char *put_sep(char *at, Sep sep, uint32_t depth)
+{
+  static const char line[MAX_INDENT + 3] = "\n\n\t\t\t\t\t\t\t\t\t\t\t\t"
+                                           "\t\t\t\t\t";
+
+  // no space is a space the next write takes back
+  *at = ' ';
+  if (sep < SEP_LINE) return at + sep;
+
+  uint32_t skip = sep == SEP_LINE;
+  memcpy(at, line + skip, MAX_INDENT + 2);
+  return at + 2 - skip + MIN(depth, MAX_INDENT);
+}
+
+// the comments and junk in [p, end), after `nl` newlines. what's left of
+// the whitespace is the number of newlines after the last of them
+static uint32_t gap(Fmt *restrict f, uint32_t p, uint32_t end, uint32_t nl)
+{
+  const char *src = f->src;
+
+  while (p < end)
+  {
+    char c = src[p];
+    if (is_ws(c))
+    {
+      nl += c == '\n';
+      p++;
+      continue;
+    }
+
+    uint32_t q    = p + 1;
+    bool line_cmt = false;
+    if (c == '/' && q < end && src[q] == '/')
+    {
+      while (q < end && src[q] != '\n')
+        q++;
+      line_cmt = true;
+    }
+    else if (c == '/' && q < end && src[q] == '*')
+    {
+      for (q += 2; q + 1 < end && (src[q] != '*' || src[q + 1] != '/');)
+        q++;
+      q = MIN(q + 2, end);
+    }
+    else
+      while (q < end && !is_ws(src[q]) && src[q] != '/')
+        q++;
+
+    // on a line of its own, or trailing whatever came before
+    Sep own = nl > 1 ? SEP_BLANK : SEP_LINE;
+    Sep sep = nl ? MAX(f->need, own) : SEP_SPACE;
+    f->at   = put_sep(f->at, f->at == f->beg ? SEP_NONE : sep, f->depth);
+
+    // trailing whitespace of a line comment isn't part of it
+    uint32_t e = q;
+    while (line_cmt && is_ws(src[e - 1]))
+      e--;
+    f->at = put(f->at, src + p, e - p, 0);
+
+    // a comment on a line of its own took the separator that was due
+    if (nl) f->need = SEP_LINE;
+    else if (line_cmt) f->need = MAX(f->need, SEP_LINE);
+    else if (f->need == SEP_NONE) f->need = SEP_SPACE;
+    nl = 0;
+    p  = q;
+  }
+
+  return nl;
+}
+
+// formats the tokens [from, to), the gaps start after `prev_end`. returns
+// the end of the last token
+static uint32_t format(Fmt *restrict f, uint32_t len, const Token *toks,
+                       uint32_t from, uint32_t to, uint32_t prev_end)
+{
+  // the cursor and depth stay in registers, char stores could alias them
+  const char *src = f->src;
+  char *at        = f->at;
+  uint32_t depth  = f->depth;
+  Sep need        = f->need;
+  uint8_t prev    = tok_kinds[TOK_INVALID];
+
+  for (uint32_t i = from; i < to; ++i)
+  {
+    const Token *t = toks + i;
+    TokTag tag     = tag_of(t);
+    if (tag == TOK_INVALID) continue; // its text is left in the gap
+
+    uint32_t beg = tok_beg(t), end = tok_end(src, len, t);
+
+    // mostly the gap is a space or a newline and indent, no comments
+    uint32_t p = prev_end, nl = 0;
+    while (p < beg && is_ws(src[p]))
+      nl += src[p++] == '\n';
+    if (p < beg)
+    {
+      f->at = at, f->depth = depth, f->need = need;
+      nl    = gap(f, p, beg, nl);
+      at = f->at, need = f->need;
+    }
+
+    // the spacing is worked out with bit ops, branches on it mispredict
+    uint8_t kind = tok_kinds[tag];
+    uint8_t hug  = (prev & TK_HUG_R) | (kind & TK_HUG_L) |
+                  (kind & TK_CALL & (uint8_t)(prev >> 1));
+    Sep sep = hug ? SEP_NONE : SEP_SPACE;
+    if (tag == TOK_BRACE_C)
+    {
+      depth -= !!depth;
+      sep = SEP_LINE;
+    }
+    sep = MAX(sep, need);
+    if (sep == SEP_LINE && nl > 1) sep = SEP_BLANK;
+    if (at == f->beg) sep = SEP_NONE;
+
+    at = put_sep(at, sep, depth);
+    at = put(at, src + beg, end - beg, len - beg);
+
+    depth += tag == TOK_BRACE_O;
+    need = tok_need[tag];
+    if (tag == TOK_BRACE_C) need = depth ? SEP_LINE : SEP_BLANK;
+
+    // a `-` that doesn't follow an operand negates what comes after it
+    if (tag == TOK_HYPHON && !(prev & TK_OPERAND)) kind |= TK_HUG_R;
+    prev     = kind;
+    prev_end = end;
+  }
+
+  f->at = at, f->depth = depth, f->need = need;
+  return prev_end;
+}
+
+size_t fmt_source(const char *src, uint32_t len, LexRes lr, uint32_t beg,
+                  uint32_t end, char *out)
+{
+  const Token *toks = lr.tokens;
+  uint32_t ntoks    = (uint32_t)(lr.tkeptr - lr.tokens);
+  Fmt f             = {.src = src, .beg = out, .at = out};
+
+  // the whole file, with the comments before and after all the tokens
+  if (beg == 0 && end >= len)
+  {
+    PERF_BEGIN(perf);
+    uint32_t tail = format(&f, len, toks, 0, ntoks, 0);
+    (void)gap(&f, tail, len, 0);
+    if (f.at != f.beg && f.at[-1] != '\n') *f.at++ = '\n';
+    PERF_END(PERF_FMT, perf);
+    return (size_t)(f.at - out);
+  }
+
+  // the top level items overlapping the range, an item runs from a token
+  // at depth 0 to the brace that returns there, or to the end
+  uint32_t first = ntoks, last = ntoks, item = ntoks, depth = 0;
+  for (uint32_t i = 0; i < ntoks; ++i)
+  {
+    TokTag tag = tag_of(toks + i);
+    if (tag == TOK_INVALID) continue;
+    if (item == ntoks) item = i;
+
+    depth += tag == TOK_BRACE_O;
+    depth -= tag == TOK_BRACE_C && depth;
+    if (depth || tag != TOK_BRACE_C) continue;
+
+    if (tok_beg(toks + item) < end && tok_end(src, len, toks + i) > beg)
+    {
+      if (first == ntoks) first = item;
+      last = i + 1;
+    }
+    item = ntoks;
+  }
+  // an item left open runs to the end of the file
+  if (item != ntoks && tok_beg(toks + item) < end && len > beg)
+  {
+    if (first == ntoks) first = item;
+    last = ntoks;
+  }
+
+  if (first == ntoks)
+  {
+    memcpy(out, src, len);
+    return len;
+  }
+
+  // everything around the items is left as it is
+  uint32_t head = tok_beg(toks + first);
+  memcpy(out, src, head);
+  f.beg = f.at  = out + head;
+  uint32_t tail = format(&f, len, toks, first, last, head);
+  memcpy(f.at, src + tail, len - tail);
+  return (size_t)(f.at - out) + len - tail;
+}
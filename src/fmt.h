@@ -0,0 +1,30 @@
+#ifndef _FMT_H
+#define _FMT_H
+
+#include "common.h"
+#include "lexer.h"
+
+/*
+ * Canonical formatting of funlang sources.
+ *
+ *  the formatter walks the tokens and finds the comments in the gaps the
+ *  lexer left between them, copying the text of both from the source, so
+ *  literals keep their spelling. it never allocates, the output goes into a
+ *  buffer of the caller with room for the worst case.
+ *
+ *  functions are separated by a blank line, a statement takes a line of its
+ *  own indented by a tab per brace, binary operators are surrounded by
+ *  spaces. a single blank line between statements is kept, comments stay
+ *  where they were relative to the tokens.
+ */
+
+// the most bytes formatting `len` bytes with `ntoks` tokens may produce
+[[nodiscard]] size_t fmt_bound(uint32_t len, uint32_t ntoks);
+
+// formats `src` of `len` bytes, lexed into `lr`, into `out`, returning how
+// many bytes were written. only the top level items overlapping
+// [beg, end) are formatted, everything else is copied as it is
+[[nodiscard]] size_t fmt_source(const char *src, uint32_t len, LexRes lr,
+                                uint32_t beg, uint32_t end, char *out);
+
+#endif // _FMT_H
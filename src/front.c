@@ -0,0 +1,166 @@
+/*
+ * Pieces shared by the drivers, from a path to lowered IR.
+ */
+
+#include "front.h"
+
+char *read_file(const char *path, size_t *size)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f) return NULL;
+
+  (void)fseek(f, 0, SEEK_END);
+  *size = (size_t)ftell(f);
+  (void)fseek(f, 0, SEEK_SET);
+
+  char *string = malloc(*size + 1);
+  *size        = fread(string, 1, *size, f);
+  (void)fclose(f);
+
+  string[*size] = 0;
+  return string;
+}
+
+ParseRes parse_source(char *src, size_t len, const char *cache)
+{
+  ParseRes pr;
+  if (cache)
+  {
+    trace_begin("cache load", NULL);
+    bool hit = cache_load(cache, src, len, &pr);
+    trace_end();
+    if (hit) return pr;
+  }
+
+  trace_begin("lex", NULL);
+  Lexer l   = {.src = src, .cur = src, .end = src + len};
+  LexRes lr = lex(l);
+  trace_end();
+
+  // names are interned as they are parsed
+  trace_begin("parse", NULL);
+  pr = parse(lr);
+  trace_end();
+  destroy_lexres(lr);
+
+  if (cache)
+  {
+    trace_begin("cache store", NULL);
+    cache_store(cache, src, len, &pr);
+    trace_end();
+  }
+
+  return pr;
+}
+
+uint32_t find_fn(const PTree *tree, uint32_t size, StrView name)
+{
+  for (uint32_t i = 0; i < size; ++i)
+  {
+    if (tree->kind[i] != FUN_END) continue;
+
+    StrView fname = sym_str(tree, i - tree->data[i] + 1);
+    if (fname.len == name.len && !memcmp(fname.txt, name.txt, name.len))
+      return i;
+  }
+  return UINT32_MAX;
+}
+
+void report_node(FILE *diag, Lines *lines, const PTree *tree, uint32_t node,
+                 StrView msg)
+{
+  if (!lines)
+  {
+    fprintf(diag, "error at node %u: %.*s\n", node, (int)msg.len, msg.txt);
+    return;
+  }
+
+  print_pos(diag, lines, tree->pos[node]);
+  fprintf(diag, ": %.*s\n", (int)msg.len, msg.txt);
+}
+
+uint32_t lower_tree(IR *restrict ir, const PTree *tree, uint32_t size,
+                    FILE *diag, Lines *lines)
+{
+  trace_begin("resolve", NULL);
+  Resolution res = resolve(tree, size);
+  trace_end();
+
+  trace_begin("check", NULL);
+  Typing typing = check(tree, size, &res);
+  trace_end();
+
+  for (CheckErr *e = typing.errs.buffer;
+       e < (CheckErr *)typing.errs.buffer + typing.errs.len; ++e)
+    report_node(diag, lines, tree, e->node,
+                (StrView){.txt = e->msg, .len = (uint32_t)strlen(e->msg)});
+
+  trace_begin("lower", NULL);
+  lower(ir, tree, size, &res, &typing);
+  trace_end();
+
+  uint32_t nerrs = typing.errs.len;
+  free_typing(typing);
+  free_resolution(res);
+
+  return nerrs;
+}
+
+static bool parse_inbuilt(const char *s, size_t len, InbuiltType *ty)
+{
+  for (InbuiltType t = U8; t <= S64; ++t)
+  {
+    const char *name = inbuilt_name(t);
+    if (strlen(name) == len && !memcmp(name, s, len))
+    {
+      *ty = t;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool lower_instance(IR *restrict ir, Mono *restrict m, const ParseRes *pr,
+                    const char *spec, FILE *diag, StrView *name)
+{
+  const char *brak = strchr(spec, '[');
+  if (!brak) return false;
+
+  InbuiltType tys[MONO_MAX_ARGS];
+  uint32_t ntys = 0;
+
+  for (const char *s = brak + 1; *s && *s != ']' && ntys < MONO_MAX_ARGS;)
+  {
+    while (*s == ' ' || *s == ',')
+      s++;
+    size_t len = strcspn(s, " ,]");
+    if (!parse_inbuilt(s, len, tys + ntys++))
+    {
+      fprintf(diag, "unknown type %.*s\n", (int)len, s);
+      return false;
+    }
+    s += len;
+  }
+
+  StrView base = {.txt = spec, .len = (uint32_t)(brak - spec)};
+  uint32_t gen = find_fn(&pr->tree, (uint32_t)pr->size, base);
+  uint32_t ins =
+      gen == UINT32_MAX ? MONO_NONE : instantiate(m, gen, tys, ntys);
+  if (ins == MONO_NONE)
+  {
+    fprintf(diag, "can't instantiate %s\n", spec);
+    return false;
+  }
+
+  const PTree *out = &m->out;
+  uint32_t sz      = out->data[ins];
+  *name            = sym_str(out, ins - sz + 1);
+
+  // instances are cached, so their names are interned only once
+  const IRFunc *funcs = ir->funcs.buffer;
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+    if (funcs[fn].name.txt == name->txt) return true;
+
+  PTree inst = ptree_from(out, ins - sz);
+  return !lower_tree(ir, &inst, sz + 1, diag, NULL);
+}
@@ -0,0 +1,38 @@
+#ifndef _FRONT_H
+#define _FRONT_H
+
+#include "cache.h"
+#include "ir.h"
+#include "lines.h"
+#include "mono.h"
+#include "trace.h"
+
+// reads a whole file and NUL terminates it, NULL on failure
+[[nodiscard]] char *read_file(const char *path, size_t *size);
+
+// lexes and parses `src`, or loads its parse from the cache directory `cache`
+// (when not NULL), storing it there on a miss
+[[nodiscard]] ParseRes parse_source(char *src, size_t len, const char *cache);
+
+// the function ending at the returned node is called `name`, UINT32_MAX if
+// there is none
+[[nodiscard]] uint32_t find_fn(const PTree *tree, uint32_t size, StrView name);
+
+// reports `msg` about `node` to `diag`, at its line and column if `lines`
+// (of the file of the tree) is given
+void report_node(FILE *diag, Lines *lines, const PTree *tree, uint32_t node,
+                 StrView msg);
+
+// resolves, checks and lowers `tree` into `ir`, reporting errors to `diag`.
+// returns the number of errors
+uint32_t lower_tree(IR *restrict ir, const PTree *tree, uint32_t size,
+                    FILE *diag, Lines *lines);
+
+// instantiates `spec`, which looks like `name[u32, s8]`, and lowers the
+// instance into `ir`. `name` receives the name of the instance. returns
+// false, after reporting why to `diag`, if that isn't possible
+[[nodiscard]] bool lower_instance(IR *restrict ir, Mono *restrict m,
+                                  const ParseRes *pr, const char *spec,
+                                  FILE *diag, StrView *name);
+
+#endif // _FRONT_H
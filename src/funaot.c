@@ -0,0 +1,114 @@
+#include "aot.h"
+#include "front.h"
+#include "incr.h"
+#include "live.h"
+#include "opt.h"
+#include "range.h"
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-o out.o] [-H out.h] <file> [fn[Ty, ...]...]\n"
+          "  compiles every function of <file>, plus the listed instances of\n"
+          "  generic functions, into an x86-64 ELF object\n",
+          argv0);
+  fprintf(stderr, "set FUNLANG_CACHE to a directory to cache parses and\n"
+                  "checked functions in\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  const char *obj_path = "a.o", *hdr_path = NULL;
+  int argi             = 1;
+
+  for (; argi + 1 < argc && argv[argi][0] == '-'; argi += 2)
+  {
+    if (!strcmp(argv[argi], "-o")) obj_path = argv[argi + 1];
+    else if (!strcmp(argv[argi], "-H")) hdr_path = argv[argi + 1];
+    else usage(argv[0]);
+  }
+  if (argi >= argc) usage(argv[0]);
+
+  const char *path = argv[argi++];
+
+  size_t fsize;
+  char *src = read_file(path, &fsize);
+  if (!src)
+  {
+    perror(path);
+    return 1;
+  }
+
+  const char *cache = getenv("FUNLANG_CACHE");
+  ParseRes pr       = parse_source(src, fsize, cache);
+  Lines lines       = lines_of(path, src, (uint32_t)fsize);
+  if (pr.err.msg)
+  {
+    print_pos(stderr, &lines, pr.err.pos);
+    fprintf(stderr, ": %s\n", pr.err.msg);
+  }
+
+  IR ir          = {};
+  uint32_t size  = (uint32_t)pr.size;
+  uint32_t nerrs = cache ? lower_incremental(&ir, &pr.tree, size, stderr,
+                                             &lines, cache, path, NULL)
+                         : lower_tree(&ir, &pr.tree, size, stderr, &lines);
+  nerrs += !!pr.err.msg;
+
+  Mono m = init_mono(&pr);
+  for (; argi < argc; ++argi)
+  {
+    StrView name;
+    nerrs += !lower_instance(&ir, &m, &pr, argv[argi], stderr, &name);
+  }
+
+  nerrs += c_name_clashes(&ir, stderr);
+
+  int ret = 1;
+  if (nerrs) goto out;
+
+  fold_and_number(&ir);
+  relax_checks(&ir);
+  eliminate_dead(&ir);
+
+  FILE *obj = fopen(obj_path, "wb");
+  if (!obj)
+  {
+    perror(obj_path);
+    goto out;
+  }
+  uint32_t skipped = write_elf(obj, &ir);
+  if (fclose(obj))
+  {
+    perror(obj_path);
+    goto out;
+  }
+  if (skipped)
+    fprintf(stderr, "left out %u functions with too many parameters\n",
+            skipped);
+
+  if (hdr_path)
+  {
+    FILE *hdr = fopen(hdr_path, "w");
+    if (!hdr)
+    {
+      perror(hdr_path);
+      goto out;
+    }
+    write_c_header(hdr, &ir);
+    (void)fclose(hdr);
+  }
+  ret = 0;
+
+out:
+  free_ir(ir);
+  free_mono(m);
+  free_parseres(pr);
+  free_lines(lines);
+  free(src);
+
+  return ret;
+}
@@ -0,0 +1,224 @@
+/*
+ * Benchmarks lexing, parsing and interning on generated sources.
+ *
+ *  every phase is run over the same input many times and the fastest run
+ *  is reported, as one JSON object per line. allocations are counted by
+ *  linking with --wrap for the allocator (see the bench target), so only
+ *  the calls made by the compiler itself show up.
+ */
+
+#include "gen.h"
+#include "parser.h"
+#include <sys/mman.h>
+#include <time.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+typedef struct
+{
+  uint64_t calls, bytes;
+} Allocs;
+
+static Allocs allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void *__real_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off);
+
+void *__wrap_malloc(size_t size)
+{
+  allocs.calls++;
+  allocs.bytes += size;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+  allocs.calls++;
+  allocs.bytes += n * size;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+  allocs.calls++;
+  allocs.bytes += size;
+  return __real_realloc(p, size);
+}
+
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd,
+                  off_t off)
+{
+  allocs.calls++;
+  allocs.bytes += len;
+  return __real_mmap(addr, len, prot, flags, fd, off);
+}
+
+typedef enum
+{
+  PHASE_LEX,
+  PHASE_PARSE, // includes interning the names, like a real parse
+  PHASE_INTERN,
+  PHASES,
+} Phase;
+
+static const char *phase_names[PHASES] = {"lex", "parse", "intern"};
+
+typedef struct
+{
+  double best, total; // seconds
+  Allocs allocs;      // of one run
+} Timing;
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// interns every name the way the parser does, into a fresh set
+static void intern_all(LexRes lr)
+{
+  HSet names = {};
+  hset_reserve(&names, lr.nintern + (size_t)(lr.tkeptr - lr.tokens) *
+                                        sizeof(uint32_t));
+
+  for (Token *tok = lr.tokens; tok < lr.tkeptr; ++tok)
+  {
+    uint8_t tag = tok->tag & 0xff;
+    if (tag != TOK_VAL_ID && tag != TOK_TYPE_ID) continue;
+
+    (void)insert(&names, lr.intern + tok->as_intern.idx,
+                 tok->as_intern.len >> 8);
+  }
+
+  free_hset(names);
+}
+
+static void run(Phase phase, char *src, size_t len, LexRes lr,
+                Timing *restrict t)
+{
+  Lexer l = {.src = src, .cur = src, .end = src + len};
+
+  Allocs before = allocs;
+  double start  = now();
+
+  switch (phase)
+  {
+  case PHASE_LEX: destroy_lexres(lex(l)); break;
+  case PHASE_PARSE:
+  {
+    free_parseres(parse(lr));
+    break;
+  }
+  case PHASE_INTERN: intern_all(lr); break;
+  default:           break;
+  }
+
+  double secs = now() - start;
+
+  t->best = t->total ? MIN(t->best, secs) : secs;
+  t->total += secs;
+  t->allocs = (Allocs){.calls = allocs.calls - before.calls,
+                       .bytes = allocs.bytes - before.bytes};
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-i iterations] [-n bytes] [-s seed] [-g] [shape...]\n"
+          "  times each phase over a generated source of every given shape\n"
+          "  (all by default) and prints one JSON object per shape and "
+          "phase\n"
+          "  -g  print the generated source of the first shape instead\n"
+          "shapes:",
+          argv0);
+  for (GenShape s = 0; s < GEN_SHAPES; ++s)
+    fprintf(stderr, " %s", gen_shape_name(s));
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t iters = 20;
+  size_t bytes   = 4 << 20;
+  uint64_t seed  = 0x5eed;
+  bool dump      = false;
+  int argi       = 1;
+
+  for (; argi < argc && argv[argi][0] == '-'; ++argi)
+  {
+    if (!strcmp(argv[argi], "-g")) dump = true;
+    else if (argi + 1 >= argc) usage(argv[0]);
+    else if (!strcmp(argv[argi], "-i"))
+      iters = (uint32_t)strtoul(argv[++argi], NULL, 0);
+    else if (!strcmp(argv[argi], "-n"))
+      bytes = (size_t)strtoull(argv[++argi], NULL, 0);
+    else if (!strcmp(argv[argi], "-s")) seed = strtoull(argv[++argi], NULL, 0);
+    else usage(argv[0]);
+  }
+  if (!iters) usage(argv[0]);
+
+  bool shapes[GEN_SHAPES] = {};
+  bool any                = false;
+  for (; argi < argc; ++argi)
+  {
+    GenShape s = 0;
+    while (s < GEN_SHAPES && strcmp(argv[argi], gen_shape_name(s)))
+      s++;
+    if (s == GEN_SHAPES) usage(argv[0]);
+    shapes[s] = any = true;
+  }
+
+  for (GenShape s = 0; s < GEN_SHAPES; ++s)
+  {
+    if (any && !shapes[s]) continue;
+
+    DynamicArray src = {}; // char
+    gen_source(&src, s, seed, bytes);
+
+    if (dump)
+    {
+      (void)fwrite(src.buffer, 1, src.len, stdout);
+      free(src.buffer);
+      return 0;
+    }
+
+    // the later phases run on a lexed source that's kept around
+    Lexer l     = {.src = src.buffer, .cur = src.buffer,
+                   .end = (char *)src.buffer + src.len};
+    LexRes lr   = lex(l);
+    ParseRes pr = parse(lr);
+
+    uint64_t ntoks = (uint64_t)(lr.tkeptr - lr.tokens), nnodes = pr.size;
+    free_parseres(pr);
+
+    Timing t[PHASES] = {};
+    for (uint32_t i = 0; i < iters; ++i)
+      for (Phase p = 0; p < PHASES; ++p)
+        run(p, src.buffer, src.len, lr, t + p);
+
+    for (Phase p = 0; p < PHASES; ++p)
+    {
+      double best = t[p].best;
+      printf("{\"shape\": \"%s\", \"phase\": \"%s\", \"bytes\": %u, "
+             "\"tokens\": %lu, \"nodes\": %lu, \"iters\": %u, "
+             "\"best_s\": %.9f, \"mean_s\": %.9f, \"mb_per_s\": %.3f, "
+             "\"tokens_per_s\": %.0f, \"nodes_per_s\": %.0f, "
+             "\"allocs\": %lu, \"alloc_bytes\": %lu}\n",
+             gen_shape_name(s), phase_names[p], src.len, ntoks, nnodes, iters,
+             best, t[p].total / iters, (double)src.len / best / 1e6,
+             (double)ntoks / best, (double)nnodes / best, t[p].allocs.calls,
+             t[p].allocs.bytes);
+    }
+
+    destroy_lexres(lr);
+    free(src.buffer);
+  }
+
+  return 0;
+}
@@ -0,0 +1,370 @@
+/*
+ * Compiles many files at once.
+ *
+ *  every file becomes a parse job and a check job depending on it, and a
+ *  final link job depends on all check jobs. funlang has no imports yet, so
+ *  files don't depend on each other and the link job only looks for
+ *  functions defined more than once. files are admitted while the source
+ *  held by unfinished files stays within a budget, with the stages of
+ *  different files overlapping on the pool. the budget only counts source
+ *  bytes: the tree, IR and names of a file in flight come on top of its
+ *  source and take several times as much, and the diagnostics and function
+ *  names of every file are kept until the build is done.
+ */
+
+#include "front.h"
+#include "incr.h"
+#include "live.h"
+#include "opt.h"
+#include "range.h"
+#include "sched.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+#define EXT ".funlang"
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t freed;
+  size_t inflight, budget; // bytes of source of unfinished files
+
+  const char *cache;
+  DynamicArray units; // Unit
+} Build;
+
+typedef struct
+{
+  Build *b;
+  const char *path;
+  size_t charged; // against the budget, the size when the file was admitted
+
+  char *src;
+  size_t size;
+  ParseRes pr;
+  Lines lines; // only built if there's something to report
+
+  FILE *diag; // buffered so output doesn't interleave, closed by link_job
+  char *diag_buf;
+  size_t diag_len;
+  uint32_t nerrs;
+  IncrStats incr;
+
+  DynamicArray fns; // char, names of the defined functions, NUL terminated
+} Unit;
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-j threads] [-m MiB] [--trace out.json] "
+          "<file or directory>...\n"
+          "  checks and lowers every " EXT " file given or found below the\n"
+          "  given directories in parallel\n"
+          "  -j  number of worker threads, defaults to the number of cores\n"
+          "  -m  MiB of source of unfinished files at most, defaults to\n"
+          "      256, their trees, IR and names take several times that\n"
+          "  --trace  write a timeline of every thread as Chrome trace "
+          "events\n",
+          argv0);
+  fprintf(stderr, "set FUNLANG_CACHE to a directory to cache parses and\n"
+                  "checked functions in\n");
+  exit(1);
+}
+
+static void parse_job(void *arg)
+{
+  Unit *u = arg;
+
+  u->diag = open_memstream(&u->diag_buf, &u->diag_len);
+  assert(u->diag && "failed to open diagnostics stream");
+
+  trace_begin("parse file", u->path);
+  trace_begin("read", NULL);
+  u->src = read_file(u->path, &u->size);
+  trace_end();
+
+  if (!u->src)
+  {
+    fprintf(u->diag, "%s: can't read the file\n", u->path);
+    u->nerrs++;
+    trace_end();
+    return;
+  }
+
+  u->pr    = parse_source(u->src, u->size, u->b->cache);
+  u->lines = lines_of(u->path, u->src, (uint32_t)u->size);
+  if (u->pr.err.msg)
+  {
+    print_pos(u->diag, &u->lines, u->pr.err.pos);
+    fprintf(u->diag, ": %s\n", u->pr.err.msg);
+    u->nerrs++;
+  }
+  trace_end();
+}
+
+static void check_job(void *arg)
+{
+  Unit *u = arg;
+
+  if (u->src)
+  {
+    trace_begin("check file", u->path);
+
+    IR ir = {};
+    const PTree *tree = &u->pr.tree;
+    uint32_t size     = (uint32_t)u->pr.size;
+    const char *cache = u->b->cache;
+
+    u->nerrs += cache ? lower_incremental(&ir, tree, size, u->diag, &u->lines,
+                                          cache, u->path, &u->incr)
+                      : lower_tree(&ir, tree, size, u->diag, &u->lines);
+
+    trace_begin("fold", NULL);
+    fold_and_number(&ir);
+    trace_end();
+
+    trace_begin("range", NULL);
+    relax_checks(&ir);
+    trace_end();
+
+    trace_begin("dce", NULL);
+    eliminate_dead(&ir);
+    trace_end();
+
+    // the names outlive the tree for the link job
+    const IRFunc *funcs = ir.funcs.buffer;
+    for (uint32_t fn = 0; fn < ir.funcs.len; ++fn)
+    {
+      co_append(&u->fns, funcs[fn].name.txt, funcs[fn].name.len);
+      co_append(&u->fns, "", 1);
+    }
+
+    free_ir(ir);
+    free_parseres(u->pr);
+    free_lines(u->lines);
+    free(u->src);
+
+    trace_end();
+  }
+
+  Build *b = u->b;
+  pthread_mutex_lock(&b->lock);
+  b->inflight -= u->charged;
+  pthread_cond_signal(&b->freed);
+  pthread_mutex_unlock(&b->lock);
+}
+
+static void link_job(void *arg)
+{
+  Build *b    = arg;
+  HSet seen   = {};
+  Unit *units = b->units.buffer;
+
+  trace_begin("link", NULL);
+
+  // names are NUL terminated, where the set puts a length prefix
+  size_t bytes = 0;
+  for (Unit *u = units; u < units + b->units.len; ++u)
+    bytes += u->fns.len;
+  hset_reserve(&seen, bytes * sizeof(uint32_t));
+
+  for (Unit *u = units; u < units + b->units.len; ++u)
+  {
+    for (char *n = u->fns.buffer; n < (char *)u->fns.buffer + u->fns.len;
+         n += strlen(n) + 1)
+    {
+      uint32_t before = seen.inuse;
+      (void)insert(&seen, n, (uint32_t)strlen(n));
+      if (seen.inuse != before) continue;
+
+      fprintf(u->diag, "%s: %s is defined more than once\n", u->path, n);
+      u->nerrs++;
+    }
+
+    (void)fclose(u->diag);
+  }
+
+  free_hset(seen);
+
+  trace_end();
+}
+
+static bool has_ext(const char *path)
+{
+  size_t len = strlen(path);
+  return len > sizeof(EXT) - 1 &&
+         !strcmp(path + len - (sizeof(EXT) - 1), EXT);
+}
+
+// collects the paths of all source files below `path`
+static void collect(DynamicArray *restrict paths, const char *path, bool given)
+{
+  struct stat st;
+  if (stat(path, &st))
+  {
+    perror(path);
+    return;
+  }
+
+  if (!S_ISDIR(st.st_mode))
+  {
+    // files named on the command line are taken whatever their extension
+    if (!given && !has_ext(path)) return;
+
+    char *p = strdup(path);
+    co_push(paths, p);
+    return;
+  }
+
+  DIR *d = opendir(path);
+  if (!d)
+  {
+    perror(path);
+    return;
+  }
+
+  for (struct dirent *e; (e = readdir(d));)
+  {
+    if (e->d_name[0] == '.') continue;
+
+    size_t len  = strlen(path) + strlen(e->d_name) + 2;
+    char *child = malloc(len);
+    (void)snprintf(child, len, "%s/%s", path, e->d_name);
+    collect(paths, child, false);
+    free(child);
+  }
+
+  (void)closedir(d);
+}
+
+static int cmp_paths(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  long cores        = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t nthreads = cores > 0 ? (uint32_t)cores : 1;
+  size_t budget     = (size_t)256 << 20;
+  const char *trace = NULL;
+  int argi          = 1;
+
+  for (; argi + 1 < argc && argv[argi][0] == '-'; argi += 2)
+  {
+    if (!strcmp(argv[argi], "-j"))
+      nthreads = (uint32_t)strtoul(argv[argi + 1], NULL, 0);
+    else if (!strcmp(argv[argi], "-m"))
+      budget = (size_t)strtoull(argv[argi + 1], NULL, 0) << 20;
+    else if (!strcmp(argv[argi], "--trace")) trace = argv[argi + 1];
+    else usage(argv[0]);
+  }
+  if (argi >= argc || !nthreads) usage(argv[0]);
+  if (trace) trace_start();
+
+  DynamicArray paths = {}; // char *
+  for (; argi < argc; ++argi)
+    collect(&paths, argv[argi], true);
+
+  // a fixed order keeps the output stable
+  char **p = paths.buffer;
+  if (paths.len) qsort(p, paths.len, sizeof(char *), cmp_paths);
+
+  Build b = {.budget = budget, .cache = getenv("FUNLANG_CACHE")};
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.freed, NULL);
+
+  // units must not move once jobs point at them
+  b.units.buffer = calloc(paths.len + 1, sizeof(Unit));
+  b.units.len = b.units.cap = paths.len;
+  assert(b.units.buffer && "failed to allocate units");
+  Unit *units = b.units.buffer;
+
+  double start = now();
+
+  Sched s;
+  init_sched(&s, nthreads);
+
+  uint32_t link = sched_job(&s, link_job, &b);
+
+  for (uint32_t i = 0; i < paths.len; ++i)
+  {
+    Unit *u = units + i;
+    *u      = (Unit){.b = &b, .path = p[i]};
+
+    struct stat st;
+    size_t size = stat(p[i], &st) ? 0 : (size_t)st.st_size;
+
+    // always let one file through, however large
+    pthread_mutex_lock(&b.lock);
+    if (b.inflight && b.inflight + size > b.budget)
+    {
+      trace_begin("wait for budget", p[i]);
+      while (b.inflight && b.inflight + size > b.budget)
+        pthread_cond_wait(&b.freed, &b.lock);
+      trace_end();
+    }
+    b.inflight += size;
+    pthread_mutex_unlock(&b.lock);
+
+    u->charged = size;
+
+    uint32_t parse = sched_job(&s, parse_job, u);
+    uint32_t check = sched_job(&s, check_job, u);
+    sched_edge(&s, parse, check);
+    sched_edge(&s, check, link);
+    sched_submit(&s, parse);
+    sched_submit(&s, check);
+  }
+
+  sched_submit(&s, link);
+  sched_wait(&s);
+  free_sched(&s);
+
+  double secs = now() - start;
+
+  // the paths in the events are freed below
+  if (trace && !trace_write(trace)) perror(trace);
+
+  uint32_t nerrs = 0, nfns = 0;
+  IncrStats incr = {};
+  for (Unit *u = units; u < units + paths.len; ++u)
+  {
+    (void)fwrite(u->diag_buf, 1, u->diag_len, stderr);
+    nerrs += u->nerrs;
+    incr.reused += u->incr.reused;
+    incr.redone += u->incr.redone;
+
+    for (char *n = u->fns.buffer; n < (char *)u->fns.buffer + u->fns.len;
+         n += strlen(n) + 1)
+      nfns++;
+
+    free(u->diag_buf);
+    free(u->fns.buffer);
+    free(p[u - units]);
+  }
+
+  printf("%u files, %u functions, %u errors in %.3fs on %u threads\n",
+         paths.len, nfns, nerrs, secs, nthreads);
+  if (b.cache)
+    printf("%u functions reused, %u checked anew\n", incr.reused,
+           incr.redone);
+
+  free(units);
+  free(paths.buffer);
+  pthread_cond_destroy(&b.freed);
+  pthread_mutex_destroy(&b.lock);
+
+  return nerrs != 0;
+}
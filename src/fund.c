@@ -0,0 +1,585 @@
+/*
+ * A compile daemon and its client.
+ *
+ *  `fund -l` listens on a Unix socket and keeps every file it compiled
+ *  resident: its source, its parse with the interned names, the instances
+ *  of its generic functions and the result of its last compile. any other
+ *  invocation is a client taking the arguments of funaot, which it sends
+ *  with its working directory to the daemon, and writes out what comes
+ *  back. a build that runs the compiler once per file then pays for a
+ *  connect instead of a process with cold caches.
+ *
+ *  a file whose inode, size and modification time didn't change since the
+ *  last request for it is neither read nor parsed again, and asked for the
+ *  same way again it only has its object written out. a file that was
+ *  touched but has the same bytes keeps its parse too.
+ *
+ *  requests are served one at a time. without a daemon listening the client
+ *  compiles in process, the same way. the daemon compiles and writes files
+ *  as its user, so either side hangs up on a peer running as another user.
+ */
+
+#define _GNU_SOURCE // struct ucred
+#include "aot.h"
+#include "front.h"
+#include "live.h"
+#include "opt.h"
+#include "range.h"
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+#define FUND_MAGIC 0x444e5546 /* "FUND" */
+
+typedef enum
+{
+  REQ_COMPILE,
+  REQ_QUIT,
+} ReqOp;
+
+typedef struct
+{
+  uint32_t magic, op;
+  uint32_t args_len; // the working directory, then the arguments, each NUL
+                     // terminated
+  uint32_t buf_len;  // the source read from stdin for a file named `-`
+} ReqHeader;
+
+typedef struct
+{
+  int32_t status;
+  uint32_t diag_len; // followed by what would have gone to stderr
+} RepHeader;
+
+typedef struct
+{
+  char *path; // absolute, or `-` for a source sent with the request
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+
+  char *src;
+  size_t len;
+  ParseRes pr;
+  Mono mono;
+
+  // the last compile, reused when asked for with the same key
+  DynamicArray key; // char, the arguments that matter, NUL terminated
+  char *obj, *hdr, *diag;
+  size_t obj_len, hdr_len, diag_len;
+  int status;
+} Unit;
+
+static DynamicArray units; // Unit *
+static bool verbose;
+
+typedef struct
+{
+  const char *obj_path, *hdr_path, *path;
+  char **insts;
+  int ninsts;
+} Args;
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-S socket] [-o out.o] [-H out.h] <file> "
+          "[fn[Ty, ...]...]\n"
+          "       %s [-S socket] -l [-v]\n"
+          "       %s [-S socket] -q\n"
+          "  compiles like funaot, through the daemon on the socket if one\n"
+          "  listens there. <file> may be - for stdin\n"
+          "  -l  be the daemon, -v reports the time every request took\n"
+          "  -q  stop the daemon\n"
+          "the socket is $FUNLANG_SOCKET, or $XDG_RUNTIME_DIR/fund.sock,\n"
+          "or /tmp/fund-<uid>.sock without a runtime directory\n",
+          argv0, argv0, argv0);
+  exit(1);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// the arguments of funaot, false if they aren't
+static bool parse_args(int argc, char **argv, Args *a)
+{
+  *a       = (Args){.obj_path = "a.o"};
+  int argi = 0;
+
+  for (; argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]; argi += 2)
+  {
+    if (!strcmp(argv[argi], "-o")) a->obj_path = argv[argi + 1];
+    else if (!strcmp(argv[argi], "-H")) a->hdr_path = argv[argi + 1];
+    else return false;
+  }
+  if (argi >= argc) return false;
+
+  a->path   = argv[argi++];
+  a->insts  = argv + argi;
+  a->ninsts = argc - argi;
+  return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+  for (char *p = buf; len;)
+  {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+  for (const char *p = buf; len;)
+  {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return false;
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+static void release(Unit *restrict u)
+{
+  if (u->src)
+  {
+    free_mono(u->mono);
+    free_parseres(u->pr);
+  }
+  free(u->src);
+  free(u->obj);
+  free(u->hdr);
+  free(u->diag);
+
+  u->src = u->obj = u->hdr = u->diag = NULL;
+  u->key.len                         = 0;
+}
+
+// the resident unit of `path` with its source up to date, NULL after
+// reporting to `diag` if the file can't be read
+static Unit *unit_for(const char *path, const char *buf, size_t buf_len,
+                      FILE *diag)
+{
+  char abs[PATH_MAX] = "-";
+  struct stat st     = {};
+  bool stdin_src     = !strcmp(path, "-");
+
+  if (!stdin_src && (!realpath(path, abs) || stat(abs, &st)))
+  {
+    fprintf(diag, "%s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  Unit **us = units.buffer, *u = NULL;
+  for (uint32_t i = 0; i < units.len && !u; ++i)
+    if (!strcmp(us[i]->path, abs)) u = us[i];
+
+  if (!u)
+  {
+    u = calloc(1, sizeof(*u));
+    assert(u && "failed to allocate unit");
+    u->path = strdup(abs);
+    co_push(&units, u);
+  }
+
+  bool same_file = !stdin_src && u->src && u->dev == st.st_dev &&
+                   u->ino == st.st_ino && u->size == st.st_size &&
+                   u->mtime.tv_sec == st.st_mtim.tv_sec &&
+                   u->mtime.tv_nsec == st.st_mtim.tv_nsec;
+  if (same_file) return u;
+
+  size_t len;
+  char *src;
+  if (stdin_src)
+  {
+    len = buf_len;
+    src = malloc(len + 1);
+    assert(src && "failed to allocate source");
+    if (len) memcpy(src, buf, len);
+    src[len] = 0;
+  }
+  else if (!(src = read_file(abs, &len)))
+  {
+    fprintf(diag, "%s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  u->dev   = st.st_dev;
+  u->ino   = st.st_ino;
+  u->size  = st.st_size;
+  u->mtime = st.st_mtim;
+
+  if (u->src && u->len == len && !memcmp(u->src, src, len))
+  {
+    free(src);
+    return u;
+  }
+
+  release(u);
+  u->src  = src;
+  u->len  = len;
+  u->pr   = parse_source(src, len, NULL);
+  u->mono = init_mono(&u->pr);
+  return u;
+}
+
+// what a compile of `u` depends on besides its source: the path as given,
+// which diagnostics are reported with, and the instances
+static void key_of(DynamicArray *restrict key, const Args *a)
+{
+  key->len = 0;
+  co_append(key, a->path, strlen(a->path) + 1);
+  for (int i = 0; i < a->ninsts; ++i)
+    co_append(key, a->insts[i], strlen(a->insts[i]) + 1);
+}
+
+// what funaot does up to the output files, into the buffers of `u`
+static void compile_unit(Unit *restrict u, const Args *a)
+{
+  free(u->obj);
+  free(u->hdr);
+  free(u->diag);
+  u->obj = u->hdr = NULL;
+  u->obj_len = u->hdr_len = 0;
+
+  FILE *diag  = open_memstream(&u->diag, &u->diag_len);
+  Lines lines = lines_of(a->path, u->src, (uint32_t)u->len);
+  assert(diag && "failed to open diagnostics stream");
+
+  if (u->pr.err.msg)
+  {
+    print_pos(diag, &lines, u->pr.err.pos);
+    fprintf(diag, ": %s\n", u->pr.err.msg);
+  }
+
+  IR ir          = {};
+  uint32_t nerrs = lower_tree(&ir, &u->pr.tree, (uint32_t)u->pr.size, diag,
+                              &lines) +
+                   !!u->pr.err.msg;
+  for (int i = 0; i < a->ninsts; ++i)
+  {
+    StrView name;
+    nerrs += !lower_instance(&ir, &u->mono, &u->pr, a->insts[i], diag, &name);
+  }
+  nerrs += c_name_clashes(&ir, diag);
+
+  u->status = 1;
+  if (!nerrs)
+  {
+    fold_and_number(&ir);
+    relax_checks(&ir);
+    eliminate_dead(&ir);
+
+    FILE *obj        = open_memstream(&u->obj, &u->obj_len);
+    FILE *hdr        = open_memstream(&u->hdr, &u->hdr_len);
+    assert(obj && hdr && "failed to open output streams");
+    uint32_t skipped = write_elf(obj, &ir);
+    write_c_header(hdr, &ir);
+    (void)fclose(obj);
+    (void)fclose(hdr);
+
+    if (skipped)
+      fprintf(diag, "left out %u functions with too many parameters\n",
+              skipped);
+    u->status = 0;
+  }
+
+  (void)fclose(diag);
+  free_ir(ir);
+  free_lines(lines);
+}
+
+static bool write_out(const char *path, const char *buf, size_t len,
+                      FILE *diag)
+{
+  FILE *f = fopen(path, "wb");
+  bool ok = f && fwrite(buf, 1, len, f) == len;
+  ok &= f && !fclose(f);
+  if (!ok) fprintf(diag, "%s: %s\n", path, strerror(errno));
+  return ok;
+}
+
+// compiles like funaot with the arguments `a`, reporting to `diag`. returns
+// the exit status
+static int compile(const Args *a, const char *buf, size_t buf_len, FILE *diag)
+{
+  Unit *u = unit_for(a->path, buf, buf_len, diag);
+  if (!u) return 1;
+
+  DynamicArray key = {};
+  key_of(&key, a);
+  bool same = u->diag && key.len == u->key.len &&
+              !memcmp(key.buffer, u->key.buffer, key.len);
+  if (same) free(key.buffer);
+  else
+  {
+    free(u->key.buffer);
+    u->key = key;
+    compile_unit(u, a);
+  }
+
+  (void)fwrite(u->diag, 1, u->diag_len, diag);
+  if (u->status) return u->status;
+
+  bool ok = write_out(a->obj_path, u->obj, u->obj_len, diag);
+  if (a->hdr_path) ok &= write_out(a->hdr_path, u->hdr, u->hdr_len, diag);
+  return !ok;
+}
+
+// answers one connection, false if it asked the daemon to stop
+static bool serve_one(int c)
+{
+  ReqHeader h;
+  if (!read_all(c, &h, sizeof(h)) || h.magic != FUND_MAGIC) return true;
+
+  size_t len = (size_t)h.args_len + h.buf_len;
+  char *req  = malloc(len + 1);
+  assert(req && "failed to allocate request");
+  if (!read_all(c, req, len) || (h.args_len && req[h.args_len - 1]))
+  {
+    free(req);
+    return true;
+  }
+
+  char *diag      = NULL;
+  size_t diag_len = 0;
+  FILE *d         = open_memstream(&diag, &diag_len);
+  assert(d && "failed to open diagnostics stream");
+  RepHeader rep = {};
+
+  if (h.op == REQ_COMPILE)
+  {
+    // the working directory, then the arguments
+    DynamicArray argv = {}; // char *
+    for (char *s = req + strlen(req) + 1; s < req + h.args_len;
+         s += strlen(s) + 1)
+      co_push(&argv, s);
+
+    Args a;
+    if (!h.args_len || chdir(req))
+    {
+      fprintf(d, "%s: %s\n", h.args_len ? req : "?", strerror(errno));
+      rep.status = 1;
+    }
+    else if (!parse_args((int)argv.len, argv.buffer, &a))
+    {
+      fprintf(d, "bad arguments\n");
+      rep.status = 1;
+    }
+    else rep.status = compile(&a, req + h.args_len, h.buf_len, d);
+
+    free(argv.buffer);
+  }
+
+  (void)fclose(d);
+  rep.diag_len = (uint32_t)diag_len;
+  if (write_all(c, &rep, sizeof(rep))) (void)write_all(c, diag, diag_len);
+
+  free(diag);
+  free(req);
+  return h.op != REQ_QUIT;
+}
+
+// is the other end of the connection `fd` run by our user
+static bool same_user(int fd)
+{
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  return !getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) &&
+         cred.uid == getuid();
+}
+
+static bool sock_addr(const char *path, struct sockaddr_un *addr)
+{
+  *addr = (struct sockaddr_un){.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr->sun_path)) return false;
+  strcpy(addr->sun_path, path);
+  return true;
+}
+
+static int serve(const char *path)
+{
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || !sock_addr(path, &addr))
+  {
+    fprintf(stderr, "%s: can't listen there\n", path);
+    return 1;
+  }
+
+  (void)unlink(path); // a daemon that died leaves its socket behind
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 128))
+  {
+    perror(path);
+    close(fd);
+    return 1;
+  }
+
+  // a client that went away must not take the daemon with it
+  (void)signal(SIGPIPE, SIG_IGN);
+
+  for (bool more = true; more;)
+  {
+    int c = accept(fd, NULL, NULL);
+    if (c < 0)
+    {
+      if (errno == EINTR) continue;
+      perror("accept");
+      break;
+    }
+
+    double start = now();
+    more         = !same_user(c) || serve_one(c);
+    close(c);
+
+    if (verbose)
+      fprintf(stderr, "request in %.3fms, %u files resident\n",
+              (now() - start) * 1e3, units.len);
+  }
+
+  close(fd);
+  (void)unlink(path);
+  return 0;
+}
+
+// sends the request to the daemon and writes out its answer, -1 if no
+// daemon listens on `path`
+static int forward(const char *path, ReqOp op, int argc, char **argv,
+                   const DynamicArray *buf)
+{
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || !sock_addr(path, &addr) ||
+      connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+  {
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+
+  // anyone can bind a socket where ours would be, in a shared directory
+  if (!same_user(fd))
+  {
+    fprintf(stderr, "%s: the daemon runs as another user\n", path);
+    close(fd);
+    return -1;
+  }
+
+  DynamicArray req = {}; // char
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd))) cwd[0] = 0;
+  co_append(&req, cwd, strlen(cwd) + 1);
+  for (int i = 0; i < argc; ++i)
+    co_append(&req, argv[i], strlen(argv[i]) + 1);
+
+  ReqHeader h = {.magic    = FUND_MAGIC,
+                 .op       = op,
+                 .args_len = req.len,
+                 .buf_len  = buf->len};
+  RepHeader rep = {.status = 1};
+
+  bool ok = write_all(fd, &h, sizeof(h)) &&
+            write_all(fd, req.buffer, req.len) &&
+            (!buf->len || write_all(fd, buf->buffer, buf->len)) &&
+            read_all(fd, &rep, sizeof(rep));
+
+  char *diag = ok ? malloc(rep.diag_len + 1) : NULL;
+  if (ok && diag && read_all(fd, diag, rep.diag_len))
+    (void)fwrite(diag, 1, rep.diag_len, stderr);
+  else fprintf(stderr, "%s: the daemon went away\n", path);
+
+  free(diag);
+  free(req.buffer);
+  close(fd);
+  return ok ? rep.status : 1;
+}
+
+int main(int argc, char **argv)
+{
+  const char *sock = getenv("FUNLANG_SOCKET");
+  bool serving = false, quit = false;
+  int argi     = 1;
+
+  for (; argi < argc; ++argi)
+  {
+    if (!strcmp(argv[argi], "-S") && argi + 1 < argc) sock = argv[++argi];
+    else if (!strcmp(argv[argi], "-l")) serving = true;
+    else if (!strcmp(argv[argi], "-q")) quit = true;
+    else if (!strcmp(argv[argi], "-v")) verbose = true;
+    else break;
+  }
+
+  // the runtime directory is ours alone, /tmp is anyone's
+  char def[PATH_MAX];
+  const char *run = getenv("XDG_RUNTIME_DIR");
+  if (!sock && run && *run)
+  {
+    snprintf(def, sizeof(def), "%s/fund.sock", run);
+    sock = def;
+  }
+  else if (!sock)
+  {
+    snprintf(def, sizeof(def), "/tmp/fund-%u.sock", (unsigned)getuid());
+    sock = def;
+  }
+
+  Args a;
+  bool compiling = !serving && !quit;
+  if ((serving && quit) || (!compiling && argi < argc) ||
+      (compiling && !parse_args(argc - argi, argv + argi, &a)))
+    usage(argv[0]);
+
+  int ret;
+  if (serving) ret = serve(sock);
+  else if (quit)
+  {
+    DynamicArray none = {};
+    ret               = forward(sock, REQ_QUIT, 0, NULL, &none);
+    if (ret < 0) fprintf(stderr, "no daemon listens on %s\n", sock);
+    ret = ret != 0;
+  }
+  else
+  {
+    DynamicArray buf = {}; // char, stdin for a file named `-`
+    if (!strcmp(a.path, "-"))
+    {
+      char chunk[1 << 16];
+      for (size_t n; (n = fread(chunk, 1, sizeof(chunk), stdin));)
+        co_append(&buf, chunk, n);
+    }
+
+    ret = forward(sock, REQ_COMPILE, argc - argi, argv + argi, &buf);
+    if (ret < 0) ret = compile(&a, buf.buffer, buf.len, stderr);
+    free(buf.buffer);
+  }
+
+  Unit **us = units.buffer;
+  for (uint32_t i = 0; i < units.len; ++i)
+  {
+    release(us[i]);
+    free(us[i]->key.buffer);
+    free(us[i]->path);
+    free(us[i]);
+  }
+  free(units.buffer);
+
+  return ret;
+}
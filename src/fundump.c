@@ -0,0 +1,158 @@
+#include "dump.h"
+#include "front.h"
+#include <time.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-o dump | -d other] [-n max] [-v] <file>\n"
+          "  prints the tree of a source file or of a binary dump\n"
+          "  -o  write the binary dump of the tree of a source file instead\n"
+          "  -d  print the nodes that differ from the tree of `other`\n"
+          "  -n  print at most `max` differing nodes, 100 by default\n"
+          "  -v  report how long it took to stderr\n",
+          argv0);
+  exit(1);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// a tree from either a source or a dump
+typedef struct
+{
+  bool is_dump;
+  TreeDump dump;
+  ParseRes pr;
+  char *src;
+} Loaded;
+
+static bool load(const char *path, Loaded *l)
+{
+  *l = (Loaded){.is_dump = is_dump(path)};
+  if (l->is_dump)
+  {
+    if (!read_dump(path, &l->dump))
+    {
+      fprintf(stderr, "%s: not a dump this version can read\n", path);
+      return false;
+    }
+    if (l->dump.unknown)
+      fprintf(stderr, "%s: %u nodes of unknown kinds\n", path,
+              l->dump.unknown);
+    return true;
+  }
+
+  size_t fsize;
+  if (!(l->src = read_file(path, &fsize)))
+  {
+    perror(path);
+    return false;
+  }
+
+  l->pr = parse_source(l->src, fsize, NULL);
+  if (l->pr.err.msg)
+  {
+    Lines lines = lines_of(path, l->src, (uint32_t)fsize);
+    print_pos(stderr, &lines, l->pr.err.pos);
+    fprintf(stderr, ": %s\n", l->pr.err.msg);
+    free_lines(lines);
+  }
+  return true;
+}
+
+static const PTree *tree_of(const Loaded *l, uint32_t *size)
+{
+  *size = l->is_dump ? l->dump.size : (uint32_t)l->pr.size;
+  return l->is_dump ? &l->dump.tree : &l->pr.tree;
+}
+
+static void unload(Loaded l)
+{
+  if (l.is_dump) free_dump(l.dump);
+  else if (l.src)
+  {
+    free_parseres(l.pr);
+    free(l.src);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *out = NULL, *other = NULL;
+  uint32_t max    = 100;
+  bool verbose    = false;
+  int argi        = 1;
+
+  for (; argi < argc && argv[argi][0] == '-'; ++argi)
+  {
+    if (!strcmp(argv[argi], "-o") && argi + 1 < argc) out = argv[++argi];
+    else if (!strcmp(argv[argi], "-d") && argi + 1 < argc)
+      other = argv[++argi];
+    else if (!strcmp(argv[argi], "-n") && argi + 1 < argc)
+      max = (uint32_t)strtoul(argv[++argi], NULL, 0);
+    else if (!strcmp(argv[argi], "-v")) verbose = true;
+    else usage(argv[0]);
+  }
+  if (argc - argi != 1 || (out && other)) usage(argv[0]);
+
+  Loaded a;
+  if (!load(argv[argi], &a)) return 1;
+
+  uint32_t na;
+  const PTree *ta = tree_of(&a, &na);
+  int ret         = 0;
+  double start    = now();
+
+  if (out)
+  {
+    if (a.is_dump)
+    {
+      fprintf(stderr, "%s is a dump already\n", argv[argi]);
+      ret = 1;
+    }
+    else if (!dump_bin(out, &a.pr))
+    {
+      perror(out);
+      ret = 1;
+    }
+  }
+  else if (other)
+  {
+    Loaded b;
+    if (!load(other, &b))
+    {
+      unload(a);
+      return 1;
+    }
+
+    uint32_t nb;
+    const PTree *tb = tree_of(&b, &nb);
+    DumpBuf *dump   = dump_open(stdout);
+    uint32_t diffs  = dump_diff(dump, ta, na, tb, nb, max);
+    dump_close(dump);
+
+    if (diffs)
+      fprintf(stderr, "%u of %u and %u nodes differ\n", diffs, na, nb);
+    ret = diffs != 0;
+    unload(b);
+  }
+  else
+  {
+    DumpBuf *dump = dump_open(stdout);
+    dump_tree(dump, ta, na, NULL);
+    dump_close(dump);
+  }
+
+  if (verbose)
+    fprintf(stderr, "%u nodes in %.6fs\n", na, now() - start);
+
+  unload(a);
+  return ret;
+}
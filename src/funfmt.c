@@ -0,0 +1,149 @@
+#include "fmt.h"
+#include "front.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-i | -c] [-r beg:end] [-v] <file>...\n"
+          "  -i  rewrite the files that aren't formatted\n"
+          "  -c  list the files that aren't formatted, failing if any\n"
+          "  -r  only format the functions overlapping the bytes [beg, end)\n"
+          "  -v  report the throughput to stderr\n"
+          "without -i or -c the formatted files go to stdout\n",
+          argv0);
+  exit(1);
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// the output buffer, reserved for the worst case and reused for every file,
+// only the pages written to are ever backed
+static char *out;
+static size_t out_cap;
+
+static char *reserve(size_t size)
+{
+  if (size <= out_cap) return out;
+  if (out) munmap(out, out_cap);
+
+  out = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  assert(out != MAP_FAILED && "failed to mmap the output buffer");
+  out_cap = size;
+  return out;
+}
+
+// the buffer goes out in one write, unless the kernel takes less of it
+static bool write_all(int fd, const char *buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) return false;
+    buf += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  bool in_place = false, check = false, verbose = false;
+  uint32_t beg = 0, end = UINT32_MAX;
+  int argi     = 1;
+
+  for (; argi < argc && argv[argi][0] == '-'; ++argi)
+  {
+    if (!strcmp(argv[argi], "-i")) in_place = true;
+    else if (!strcmp(argv[argi], "-c")) check = true;
+    else if (!strcmp(argv[argi], "-v")) verbose = true;
+    else if (!strcmp(argv[argi], "-r") && argi + 1 < argc)
+    {
+      char *colon;
+      beg = (uint32_t)strtoul(argv[++argi], &colon, 0);
+      if (*colon != ':') usage(argv[0]);
+      end = (uint32_t)strtoul(colon + 1, NULL, 0);
+    }
+    else usage(argv[0]);
+  }
+  if (argi == argc || (in_place && check) || beg > end) usage(argv[0]);
+
+  int ret         = 0;
+  double lex_secs = 0, fmt_secs = 0;
+  size_t bytes    = 0;
+
+  for (; argi < argc; ++argi)
+  {
+    const char *path = argv[argi];
+
+    size_t fsize;
+    char *src = read_file(path, &fsize);
+    if (!src)
+    {
+      perror(path);
+      ret = 1;
+      continue;
+    }
+
+    double start = now();
+    Lexer l      = {.src = src, .cur = src, .end = src + fsize};
+    LexRes lr    = lex(l);
+    double mid   = now();
+
+    uint32_t len   = (uint32_t)fsize;
+    uint32_t ntoks = (uint32_t)(lr.tkeptr - lr.tokens);
+    char *buf      = reserve(fmt_bound(len, ntoks));
+    size_t n       = fmt_source(src, len, lr, beg, end, buf);
+    lex_secs += mid - start;
+    fmt_secs += now() - mid;
+    bytes += fsize;
+
+    bool same = n == fsize && !memcmp(buf, src, n);
+    if (check && !same)
+    {
+      fprintf(stdout, "%s\n", path);
+      ret = 1;
+    }
+    else if (in_place && !same)
+    {
+      int fd = open(path, O_WRONLY | O_TRUNC);
+      if (fd < 0 || !write_all(fd, buf, n))
+      {
+        perror(path);
+        ret = 1;
+      }
+      if (fd >= 0) close(fd);
+    }
+    else if (!check && !in_place && !write_all(STDOUT_FILENO, buf, n))
+    {
+      perror("stdout");
+      ret = 1;
+    }
+
+    destroy_lexres(lr);
+    free(src);
+  }
+
+  if (verbose)
+  {
+    double secs = lex_secs + fmt_secs;
+    fprintf(stderr,
+            "formatted %zu bytes in %.6fs, %.1f MB/s (lex %.6fs, format "
+            "%.6fs)\n",
+            bytes, secs, (double)bytes / secs * 1e-6, lex_secs, fmt_secs);
+  }
+
+  if (out) munmap(out, out_cap);
+  return ret;
+}
@@ -0,0 +1,660 @@
+/*
+ * A language server, JSON-RPC over stdin and stdout.
+ *
+ *  every open document keeps its tokens, tree, names and resolution around
+ *  between requests and is only lexed and parsed again when it changes.
+ *  semantic tokens are encoded once per version of a document and
+ *  definitions are a binary search over the names of the tree, so requests
+ *  on a document that didn't change never run the front end. symbols and
+ *  hovers go through the navigation index of the tree.
+ *
+ *  documents are synced whole. columns are counted in bytes, which is what
+ *  LSP counts as long as the source is ASCII.
+ */
+
+#include "check.h"
+#include "json.h"
+#include "lines.h"
+#include "nav.h"
+#include "resolve.h"
+#include <ctype.h>
+#include <strings.h>
+#include <time.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+#define SemTokMacro(X)                                                         \
+  X(SEM_KEYWORD, "keyword")                                                    \
+  X(SEM_TYPE, "type")                                                          \
+  X(SEM_TYPE_PARAM, "typeParameter")                                           \
+  X(SEM_FUNCTION, "function")                                                  \
+  X(SEM_VARIABLE, "variable")                                                  \
+  X(SEM_NUMBER, "number")                                                      \
+  X(SEM_STRING, "string")                                                      \
+  X(SEM_OPERATOR, "operator")
+
+#define SemTokMacroDeclare(V, ...) V,
+
+typedef enum
+{
+  SemTokMacro(SemTokMacroDeclare) SEM_NONE,
+} SemTok;
+
+typedef struct
+{
+  char *uri;         // NUL terminated
+  DynamicArray text; // char, NUL terminated
+
+  LexRes lr;
+  ParseRes pr; // with the names
+  Resolution res;
+  Lines lines;
+  Nav nav;
+
+  DynamicArray names;  // uint32_t, the nodes with a symbol, in source order
+  DynamicArray tokens; // char, the encoded semantic tokens, empty if stale
+} Doc;
+
+static DynamicArray docs; // Doc
+static DynamicArray out;  // char, the message being written
+static bool verbose;      // report the time every message took
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void put(const char *s) { co_append(&out, s, strlen(s)); }
+
+static void put_uint(uint64_t n)
+{
+  char buf[20], *p = buf + sizeof(buf);
+  do *--p = (char)('0' + n % 10);
+  while (n /= 10);
+  co_append(&out, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+static void put_raw(StrView v) { co_append(&out, v.txt, v.len); }
+
+// sends `out` as one message
+static void send(void)
+{
+  printf("Content-Length: %u\r\n\r\n", out.len);
+  (void)fwrite(out.buffer, 1, out.len, stdout);
+  (void)fflush(stdout);
+  out.len = 0;
+}
+
+// sends `out`, then `tail` and the end of a reply, as one message
+static void send_reply_with(StrView tail)
+{
+  printf("Content-Length: %u\r\n\r\n", out.len + tail.len + 1);
+  (void)fwrite(out.buffer, 1, out.len, stdout);
+  (void)fwrite(tail.txt, 1, tail.len, stdout);
+  (void)fwrite("}", 1, 1, stdout);
+  (void)fflush(stdout);
+  out.len = 0;
+}
+
+static void begin_reply(StrView id)
+{
+  put("{\"jsonrpc\":\"2.0\",\"id\":");
+  put_raw(id);
+  put(",\"result\":");
+}
+
+static Doc *find_doc(StrView uri)
+{
+  DynamicArray name = {};
+  json_unescape(&name, uri);
+
+  Doc *d = docs.buffer, *end = d + docs.len;
+  for (; d < end; ++d)
+    if (strlen(d->uri) == name.len && !memcmp(d->uri, name.buffer, name.len))
+      break;
+
+  free(name.buffer);
+  return d < end ? d : NULL;
+}
+
+static void release(Doc *restrict d)
+{
+  destroy_lexres(d->lr);
+  free_parseres(d->pr);
+  free_resolution(d->res);
+  free_lines(d->lines);
+  free_nav(d->nav);
+  free(d->names.buffer);
+  free(d->tokens.buffer);
+
+  d->lr     = (LexRes){};
+  d->pr     = (ParseRes){};
+  d->res    = (Resolution){};
+  d->lines  = (Lines){};
+  d->nav    = (Nav){};
+  d->names  = (DynamicArray){};
+  d->tokens = (DynamicArray){};
+}
+
+// the bytes of the token at `pos`
+static uint32_t token_len(const Doc *d, uint32_t pos)
+{
+  const char *src = d->text.buffer;
+  uint32_t len = d->text.len - 1, end = pos;
+
+  if (pos >= len) return 0;
+  if (src[pos] == '"')
+  {
+    while (++end < len && src[end] != '"')
+      ;
+    return MIN(end + 1, len) - pos;
+  }
+
+  while (end < len && (isalnum((uint8_t)src[end]) || src[end] == '_'))
+    end++;
+  if (end > pos) return end - pos;
+
+  // `->`, `<:`, `>>` and `<<`
+  bool two = pos + 1 < len && strchr("-<>", src[pos]) &&
+             strchr("><:", src[pos + 1]);
+  return two ? 2 : 1;
+}
+
+static void put_pos(Doc *restrict d, uint32_t off)
+{
+  LineCol lc = line_col(&d->lines, off);
+  put("{\"line\":");
+  put_uint(lc.line - 1);
+  put(",\"character\":");
+  put_uint(lc.col - 1);
+  put("}");
+}
+
+static void put_range(Doc *restrict d, uint32_t off)
+{
+  put("{\"start\":");
+  put_pos(d, off);
+  put(",\"end\":");
+  put_pos(d, off + token_len(d, off));
+  put("}");
+}
+
+static void put_diag(Doc *restrict d, uint32_t off, const char *msg,
+                     bool *first)
+{
+  if (!*first) put(",");
+  *first = false;
+
+  put("{\"range\":");
+  put_range(d, off);
+  put(",\"severity\":1,\"source\":\"funlang\",\"message\":");
+  json_escape(&out, (StrView){.txt = msg, .len = (uint32_t)strlen(msg)});
+  put("}");
+}
+
+// lexes, parses and resolves the text of `d` and publishes its diagnostics
+static void analyze(Doc *restrict d)
+{
+  release(d);
+
+  char *src     = d->text.buffer;
+  uint32_t len  = d->text.len - 1;
+  Lexer l       = {.src = src, .cur = src, .end = src + len};
+  d->lr         = lex(l);
+  d->pr         = parse(d->lr);
+  d->lines      = lines_of(d->uri, src, len);
+  uint32_t size = (uint32_t)d->pr.size;
+  d->res        = resolve(&d->pr.tree, size);
+  d->nav        = build_nav(&d->pr.tree, size);
+
+  const uint8_t *kind = d->pr.tree.kind;
+  for (uint32_t i = 0; i < size; ++i)
+    if (has_sym(kind[i])) co_push(&d->names, i);
+
+  put("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\","
+      "\"params\":{\"uri\":");
+  json_escape(&out, (StrView){.txt = d->uri, .len = (uint32_t)strlen(d->uri)});
+  put(",\"diagnostics\":[");
+
+  bool first = true;
+  if (d->pr.err.msg) put_diag(d, d->pr.err.pos, d->pr.err.msg, &first);
+
+  Typing typing = check(&d->pr.tree, size, &d->res);
+  for (CheckErr *e = typing.errs.buffer;
+       e < (CheckErr *)typing.errs.buffer + typing.errs.len; ++e)
+    put_diag(d, d->pr.tree.pos[e->node], e->msg, &first);
+  free_typing(typing);
+
+  put("]}}");
+  send();
+}
+
+static SemTok classify(TokTag tag, TokTag prev)
+{
+  switch (tag)
+  {
+  case TOK_LIT_INT: return SEM_NUMBER;
+  case TOK_LIT_STR: return SEM_STRING;
+  case TOK_VAL_ID:  return prev == TOK_KW_FN ? SEM_FUNCTION : SEM_VARIABLE;
+  case TOK_TYPE_ID: return SEM_TYPE_PARAM;
+  case TOK_KW_U8:
+  case TOK_KW_S8:
+  case TOK_KW_U16:
+  case TOK_KW_U32:
+  case TOK_KW_U64:
+  case TOK_KW_S16:
+  case TOK_KW_S32:
+  case TOK_KW_S64:  return SEM_TYPE;
+  case TOK_KW_ARROW:
+  case TOK_KW_SUBTY:
+  case TOK_KW_SHIFR:
+  case TOK_KW_SHIFL:
+  case TOK_PLUS:
+  case TOK_HYPHON:
+  case TOK_COLON:
+  case TOK_PIPE:    return SEM_OPERATOR;
+  default:          return tag & TOK_KEYOWRD_ ? SEM_KEYWORD : SEM_NONE;
+  }
+}
+
+// the semantic tokens of `d` as LSP encodes them, straight from the tokens
+// of the lexer
+static void encode_tokens(Doc *restrict d)
+{
+  DynamicArray *enc = &d->tokens;
+  DynamicArray keep = out;
+  out               = *enc;
+
+  put("{\"data\":[");
+
+  uint32_t line = 0, beg = 0, last_line = 0, last_beg = 0;
+  uint32_t next = line_start(&d->lines, 2);
+  TokTag prev   = TOK_INVALID;
+  bool first    = true;
+
+  for (const Token *t = d->lr.tokens; t < d->lr.tkeptr; ++t)
+  {
+    TokTag tag = t->tag & 0xff;
+    SemTok sem = classify(tag, prev);
+    prev       = tag;
+    if (sem == SEM_NONE) continue;
+
+    while (t->pos >= next && next < d->lines.len)
+    {
+      beg  = next;
+      next = line_start(&d->lines, ++line + 2);
+    }
+
+    uint32_t col = t->pos - beg;
+    uint32_t dl = line - last_line, dc = dl ? col : col - last_beg;
+
+    if (!first) put(",");
+    first = false;
+
+    put_uint(dl);
+    put(",");
+    put_uint(dc);
+    put(",");
+    put_uint(token_len(d, t->pos));
+    put(",");
+    put_uint(sem);
+    put(",0");
+
+    last_line = line;
+    last_beg  = col;
+  }
+
+  put("]}");
+
+  *enc = out;
+  out  = keep;
+}
+
+static void on_open(StrView params)
+{
+  Doc d = {};
+
+  DynamicArray uri = {};
+  json_unescape(&uri, json_get(params, "textDocument.uri"));
+  co_append(&uri, "", 1);
+  d.uri = uri.buffer;
+
+  json_unescape(&d.text, json_get(params, "textDocument.text"));
+  co_append(&d.text, "", 1);
+
+  co_push(&docs, d);
+  analyze((Doc *)docs.buffer + docs.len - 1);
+}
+
+static void on_change(StrView params)
+{
+  Doc *d = find_doc(json_get(params, "textDocument.uri"));
+  if (!d) return;
+
+  // synced whole, so the last change is the whole document
+  StrView changes = json_get(params, "contentChanges"), last = {};
+  for (uint32_t i = 0;; ++i)
+  {
+    StrView c = json_index(changes, i);
+    if (!c.len) break;
+    last = c;
+  }
+  if (!last.len) return;
+
+  d->text.len = 0;
+  json_unescape(&d->text, json_get(last, "text"));
+  co_append(&d->text, "", 1);
+
+  analyze(d);
+}
+
+static void on_close(StrView params)
+{
+  Doc *d = find_doc(json_get(params, "textDocument.uri"));
+  if (!d) return;
+
+  release(d);
+  free(d->uri);
+  free(d->text.buffer);
+
+  *d = ((Doc *)docs.buffer)[--docs.len];
+}
+
+static void on_semantic_tokens(StrView id, StrView params)
+{
+  Doc *d = find_doc(json_get(params, "textDocument.uri"));
+
+  begin_reply(id);
+  if (!d)
+  {
+    put("null}");
+    send();
+    return;
+  }
+
+  // the encoding can be large, it goes out without being copied
+  if (!d->tokens.len) encode_tokens(d);
+  send_reply_with((StrView){.txt = d->tokens.buffer, .len = d->tokens.len});
+}
+
+// the node of the name at `off`, UINT32_MAX if there is none
+static uint32_t name_at(const Doc *d, uint32_t off)
+{
+  const uint32_t *names = d->names.buffer;
+  const PTree *tree     = &d->pr.tree;
+
+  uint32_t lo = 0, hi = d->names.len;
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (tree->pos[names[mid]] <= off) lo = mid + 1;
+    else hi = mid;
+  }
+  if (!lo) return UINT32_MAX;
+
+  uint32_t node = names[lo - 1];
+  return off < tree->pos[node] + sym_str(tree, node).len ? node : UINT32_MAX;
+}
+
+static void on_definition(StrView id, StrView params)
+{
+  Doc *d        = find_doc(json_get(params, "textDocument.uri"));
+  uint32_t node = UINT32_MAX;
+
+  if (d)
+  {
+    uint32_t line = (uint32_t)json_uint(json_get(params, "position.line"));
+    uint32_t col = (uint32_t)json_uint(json_get(params, "position.character"));
+    node         = name_at(d, line_start(&d->lines, line + 1) + col);
+  }
+
+  // uses go to what they resolve into, bindings to themselves
+  if (node != UINT32_MAX && (d->pr.tree.kind[node] == BIND_USE ||
+                             d->pr.tree.kind[node] == BIND_TY_USE))
+    node = d->res.binding[node] == RES_UNBOUND ? UINT32_MAX
+                                                : d->res.binding[node];
+
+  begin_reply(id);
+  if (node == UINT32_MAX) put("null");
+  else
+  {
+    put("{\"uri\":");
+    json_escape(&out,
+                (StrView){.txt = d->uri, .len = (uint32_t)strlen(d->uri)});
+    put(",\"range\":");
+    put_range(d, d->pr.tree.pos[node]);
+    put("}");
+  }
+  put("}");
+  send();
+}
+
+// the child of `fn` that is its `{`, NAV_NONE for a function without one
+static uint32_t fn_block(const Doc *d, uint32_t fn)
+{
+  const PTree *tree = &d->pr.tree;
+  uint32_t c        = nav_first_child(&d->nav, tree, fn);
+  for (; c != NAV_NONE; c = nav_next_sibling(&d->nav, tree, c))
+    if (tree->kind[c] == FUN_BLOCK) break;
+  return c;
+}
+
+typedef struct
+{
+  Doc *d;
+  uint32_t fn_name;
+  bool first;
+} SymCtx;
+
+// the names bound in a function, as its children
+static NavStep put_child_sym(uint32_t node, void *ctx)
+{
+  SymCtx *c = ctx;
+  uint8_t k = c->d->pr.tree.kind[node];
+  bool ty   = k == BIND_TY_NAME;
+  if ((k != BIND_NAME && !ty) || node == c->fn_name) return NAV_CONTINUE;
+
+  if (!c->first) put(",");
+  c->first = false;
+
+  uint32_t at = c->d->pr.tree.pos[node];
+  put("{\"name\":");
+  json_escape(&out, sym_str(&c->d->pr.tree, node));
+  put(ty ? ",\"kind\":26,\"range\":" : ",\"kind\":13,\"range\":");
+  put_range(c->d, at);
+  put(",\"selectionRange\":");
+  put_range(c->d, at);
+  put("}");
+  return NAV_CONTINUE;
+}
+
+static void on_document_symbol(StrView id, StrView params)
+{
+  Doc *d = find_doc(json_get(params, "textDocument.uri"));
+
+  begin_reply(id);
+  if (!d)
+  {
+    put("null}");
+    send();
+    return;
+  }
+
+  const PTree *tree     = &d->pr.tree;
+  const uint32_t *roots = d->nav.roots.buffer;
+  bool first            = true;
+
+  put("[");
+  for (uint32_t r = 0; r < d->nav.roots.len; ++r)
+  {
+    uint32_t fn = roots[r], lo = fn - subtree_size(tree, fn);
+    if (tree->kind[fn] != FUN_END || tree->kind[lo + 1] != BIND_NAME) continue;
+
+    if (!first) put(",");
+    first = false;
+
+    put("{\"name\":");
+    json_escape(&out, sym_str(tree, lo + 1));
+    put(",\"kind\":12,\"range\":{\"start\":");
+    put_pos(d, tree->pos[lo]);
+    put(",\"end\":");
+    put_pos(d, tree->pos[fn] + 1);
+    put("},\"selectionRange\":");
+    put_range(d, tree->pos[lo + 1]);
+
+    put(",\"children\":[");
+    SymCtx ctx = {.d = d, .fn_name = lo + 1, .first = true};
+    (void)nav_walk(&d->nav, tree, fn, put_child_sym, NULL, &ctx);
+    put("]}");
+  }
+  put("]}");
+  send();
+}
+
+// the signature of the function around the position, up to its `{`
+static void on_hover(StrView id, StrView params)
+{
+  Doc *d      = find_doc(json_get(params, "textDocument.uri"));
+  uint32_t fn = NAV_NONE;
+
+  if (d)
+  {
+    uint32_t line = (uint32_t)json_uint(json_get(params, "position.line"));
+    uint32_t col = (uint32_t)json_uint(json_get(params, "position.character"));
+    fn = nav_fn_at(&d->nav, &d->pr.tree, line_start(&d->lines, line + 1) + col);
+  }
+
+  uint32_t block = fn == NAV_NONE ? NAV_NONE : fn_block(d, fn);
+
+  begin_reply(id);
+  if (block == NAV_NONE) put("null");
+  else
+  {
+    const PTree *tree = &d->pr.tree;
+    const char *src   = d->text.buffer;
+    uint32_t beg      = tree->pos[fn - subtree_size(tree, fn)];
+    uint32_t end      = tree->pos[block];
+    while (end > beg && isspace((uint8_t)src[end - 1]))
+      end--;
+
+    put("{\"contents\":{\"kind\":\"plaintext\",\"value\":");
+    json_escape(&out, (StrView){.txt = src + beg, .len = end - beg});
+    put("}}");
+  }
+  put("}");
+  send();
+}
+
+#define SemTokMacroName(V, S) "\"" S "\","
+
+static void on_initialize(StrView id)
+{
+  begin_reply(id);
+  put("{\"capabilities\":{\"textDocumentSync\":1,\"definitionProvider\":true,"
+      "\"documentSymbolProvider\":true,\"hoverProvider\":true,"
+      "\"semanticTokensProvider\":{\"full\":true,\"legend\":{"
+      "\"tokenModifiers\":[],\"tokenTypes\":[");
+  put(SemTokMacro(SemTokMacroName));
+  out.len--; // the last comma
+  put("]}}},\"serverInfo\":{\"name\":\"funlsp\"}}}");
+  send();
+}
+
+static void on_unknown(StrView id)
+{
+  put("{\"jsonrpc\":\"2.0\",\"id\":");
+  put_raw(id);
+  put(",\"error\":{\"code\":-32601,\"message\":\"method not found\"}}");
+  send();
+}
+
+// reads the next message into `msg`, false at the end of the input
+static bool read_message(DynamicArray *restrict msg)
+{
+  char header[256];
+  uint32_t len = 0;
+  bool any     = false;
+
+  while (fgets(header, sizeof(header), stdin))
+  {
+    any = true;
+    if (!strcmp(header, "\r\n") || !strcmp(header, "\n")) break;
+    if (!strncasecmp(header, "Content-Length:", 15))
+      len = (uint32_t)strtoul(header + 15, NULL, 10);
+  }
+  if (!any) return false;
+
+  msg->len = len;
+  if (msg->len >= msg->cap) grow_array(msg, sizeof(char));
+  return fread(msg->buffer, 1, len, stdin) == len;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-v]\n"
+          "  serves the language server protocol on stdin and stdout\n"
+          "  -v  report the time every message took on stderr\n",
+          argv0);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  for (int argi = 1; argi < argc; ++argi)
+  {
+    if (!strcmp(argv[argi], "-v")) verbose = true;
+    else usage(argv[0]);
+  }
+
+  DynamicArray msg  = {}; // char
+  bool shutdown     = false;
+
+  while (read_message(&msg))
+  {
+    double start  = now();
+    StrView m     = {.txt = msg.buffer, .len = msg.len};
+    StrView id    = json_get(m, "id");
+    StrView meth  = json_get(m, "method");
+    StrView param = json_get(m, "params");
+
+    if (json_is(meth, "initialize")) on_initialize(id);
+    else if (json_is(meth, "textDocument/didOpen")) on_open(param);
+    else if (json_is(meth, "textDocument/didChange")) on_change(param);
+    else if (json_is(meth, "textDocument/didClose")) on_close(param);
+    else if (json_is(meth, "textDocument/semanticTokens/full"))
+      on_semantic_tokens(id, param);
+    else if (json_is(meth, "textDocument/definition"))
+      on_definition(id, param);
+    else if (json_is(meth, "textDocument/documentSymbol"))
+      on_document_symbol(id, param);
+    else if (json_is(meth, "textDocument/hover")) on_hover(id, param);
+    else if (json_is(meth, "shutdown"))
+    {
+      shutdown = true;
+      begin_reply(id);
+      put("null}");
+      send();
+    }
+    else if (json_is(meth, "exit")) break;
+    else if (id.len) on_unknown(id); // notifications may go unanswered
+
+    if (verbose)
+      fprintf(stderr, "%.*s in %.3fms\n", (int)meth.len, meth.txt,
+              (now() - start) * 1e3);
+  }
+
+  for (Doc *d = docs.buffer; d < (Doc *)docs.buffer + docs.len; ++d)
+  {
+    release(d);
+    free(d->uri);
+    free(d->text.buffer);
+  }
+  free(docs.buffer);
+  free(out.buffer);
+  free(msg.buffer);
+
+  return shutdown ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+#include "front.h"
+#include "incr.h"
+#include "interp.h"
+#include "jit.h"
+#include "live.h"
+#include "opt.h"
+#include "range.h"
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-j | -b] [-n iterations] <file> <fn[Ty, ...]> "
+          "[args...]\n"
+          "  -j  run jitted machine code instead of the interpreter\n"
+          "  -b  run both and compare them\n",
+          argv0);
+  fprintf(stderr, "set FUNLANG_CACHE to a directory to cache parses and\n"
+                  "checked functions in\n");
+  exit(1);
+}
+
+// parses `s` as a value of type `ty`, false if it isn't one
+static bool parse_arg(const char *s, TypeId ty, uint64_t *restrict v)
+{
+  uint32_t bits = inbuilt_bits(ty);
+  char *end;
+  bool fits;
+
+  errno = 0;
+  if (inbuilt_signed(ty))
+  {
+    int64_t n   = strtoll(s, &end, 0);
+    int64_t max = (int64_t)(UINT64_MAX >> (65 - bits));
+    fits        = n <= max && n >= -max - 1;
+    *v          = (uint64_t)n;
+  }
+  else
+  {
+    // strtoull would take a minus sign and negate the value
+    uint64_t n = strtoull(s, &end, 0);
+    fits       = !strchr(s, '-') && n <= UINT64_MAX >> (64 - bits);
+    *v         = n;
+  }
+
+  return fits && !errno && end != s && !*end;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef struct
+{
+  uint64_t ret;
+  double secs;
+} Run;
+
+static Run run_interp(const Program *prog, uint32_t f, const uint64_t *args,
+                      uint64_t iters)
+{
+  uint64_t *regs = malloc((prog->max_regs + 1) * sizeof(uint64_t));
+  Run r          = {};
+
+  double start = now();
+  for (uint64_t i = 0; i < iters; ++i)
+  {
+    r.ret = interp_call(prog, f, args, regs);
+    __asm__ volatile("" ::: "memory"); // keep the calls
+  }
+  r.secs = now() - start;
+
+  free(regs);
+  return r;
+}
+
+static Run run_jit(JitFn fn, const uint64_t *a, uint64_t iters)
+{
+  Run r = {};
+
+  double start = now();
+  for (uint64_t i = 0; i < iters; ++i)
+  {
+    r.ret = fn(a[0], a[1], a[2], a[3], a[4], a[5]);
+    __asm__ volatile("" ::: "memory"); // keep the calls
+  }
+  r.secs = now() - start;
+
+  return r;
+}
+
+static void report(const char *what, Run r, uint64_t iters, uint32_t len)
+{
+  double ops = (double)iters * len;
+  fprintf(stderr, "%s: %lu calls, %.0f ops in %.6fs, %.3g ops/s\n", what,
+          iters, ops, r.secs, ops / r.secs);
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t iters = 1;
+  int argi       = 1;
+  bool jit = false, bench = false;
+
+  for (; argi < argc && argv[argi][0] == '-'; ++argi)
+  {
+    if (!strcmp(argv[argi], "-j")) jit = true;
+    else if (!strcmp(argv[argi], "-b")) bench = true;
+    else if (!strcmp(argv[argi], "-n") && argi + 1 < argc)
+      iters = strtoull(argv[++argi], NULL, 0);
+    else usage(argv[0]);
+  }
+  if (argc - argi < 2 || !iters) usage(argv[0]);
+
+  const char *path = argv[argi++];
+  const char *fn   = argv[argi++];
+
+  // everything is freed at `out`, whatever was made by then
+  ParseRes pr    = {};
+  Lines lines    = {};
+  IR ir          = {};
+  Mono m         = {};
+  Program prog   = {};
+  Jit j          = {};
+  uint64_t *args = NULL;
+  int ret        = 1;
+
+  size_t fsize;
+  char *src = read_file(path, &fsize);
+  if (!src)
+  {
+    perror(path);
+    goto out;
+  }
+
+  const char *cache = getenv("FUNLANG_CACHE");
+  pr                = parse_source(src, fsize, cache);
+  lines             = lines_of(path, src, (uint32_t)fsize);
+  if (pr.err.msg)
+  {
+    print_pos(stderr, &lines, pr.err.pos);
+    fprintf(stderr, ": %s\n", pr.err.msg);
+  }
+
+  if (cache)
+    lower_incremental(&ir, &pr.tree, (uint32_t)pr.size, stderr, &lines, cache,
+                      path, NULL);
+  else lower_tree(&ir, &pr.tree, (uint32_t)pr.size, stderr, &lines);
+
+  // `name[u32, s8]` asks for an instance of a generic function
+  m            = init_mono(&pr);
+  StrView want = {.txt = fn, .len = (uint32_t)strlen(fn)};
+  if (strchr(fn, '[') && !lower_instance(&ir, &m, &pr, fn, stderr, &want))
+    goto out;
+
+  fold_and_number(&ir);
+  relax_checks(&ir);
+  eliminate_dead(&ir);
+
+  prog = compile_program(&ir);
+  thread_program(&prog);
+
+  uint32_t f = find_bfunc(&prog, want);
+  if (f == UINT32_MAX)
+  {
+    fprintf(stderr, "no function %s\n", fn);
+    goto out;
+  }
+
+  const BFunc *bf = (const BFunc *)prog.funcs.buffer + f;
+  if ((uint32_t)(argc - argi) != bf->nparams)
+  {
+    fprintf(stderr, "%s takes %u arguments\n", fn, bf->nparams);
+    goto out;
+  }
+
+  // jitted code is always passed all the argument registers
+  uint32_t nargs = MAX(bf->nparams, X64_MAX_PARAMS);
+  args           = calloc(nargs, sizeof(uint64_t));
+  assert(args && "failed to allocate arguments");
+  const BParam *params = (const BParam *)prog.params.buffer + bf->params;
+  for (int i = argi; i < argc; ++i)
+  {
+    TypeId ty = params[i - argi].ty;
+    if (!parse_arg(argv[i], ty, args + i - argi))
+    {
+      fprintf(stderr, "%s isn't a %s\n", argv[i], inbuilt_name(ty));
+      goto out;
+    }
+  }
+
+  // the program and the jit both number functions like the IR
+  bool interp = bf->interpretable;
+  j           = jit || bench || !interp ? jit_compile(&ir) : (Jit){};
+  JitFn code  = j.entries ? j.entries[f] : NULL;
+  if (!code && !interp)
+  {
+    fprintf(stderr,
+            "%s needs %u registers, more than can be interpreted, and "
+            "can't be jitted\n",
+            fn, bf->nregs);
+    goto out;
+  }
+  if ((jit || bench) && !code)
+    fprintf(stderr, "%s can't be jitted, interpreting it\n", fn);
+
+  bool compare = bench && interp && code;
+  Run r;
+  if (!code || compare)
+  {
+    r = run_interp(&prog, f, args, iters);
+    report("interp", r, iters, bf->len);
+  }
+  if (code)
+  {
+    Run jr = run_jit(code, args, iters);
+    // without bytecode, the values of the IR count as the operations
+    report("jit", jr, iters, interp ? bf->len : bf->nregs);
+
+    if (compare)
+    {
+      fprintf(stderr, "jit is %.2fx the speed of the interpreter\n",
+              r.secs / jr.secs);
+      if (jr.ret != r.ret)
+        fprintf(stderr, "results differ: %lu (jit) vs %lu (interp)\n",
+                jr.ret, r.ret);
+    }
+    r = jr;
+  }
+
+  if (inbuilt_signed(bf->ret)) printf("%ld\n", (int64_t)r.ret);
+  else printf("%lu\n", r.ret);
+  ret = 0;
+
+out:
+  free(args);
+  free_jit(j);
+  free_program(prog);
+  free_ir(ir);
+  free_mono(m);
+  free_parseres(pr);
+  free_lines(lines);
+  free(src);
+
+  return ret;
+}
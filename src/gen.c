@@ -0,0 +1,159 @@
+/*
+ * Deterministic generation of synthetic funlang sources for benchmarks.
+ */
+
+#include "gen.h"
+
+#define GenShapeMacroName(V, S) [V] = S,
+
+static const char *gen_shape_names[] = {GenShapeMacro(GenShapeMacroName)};
+
+const char *gen_shape_name(GenShape shape) { return gen_shape_names[shape]; }
+
+typedef struct
+{
+  DynamicArray *out;
+  uint64_t state;
+  uint32_t fn;
+} Gen;
+
+// splitmix64, so the output doesn't depend on the libc
+static uint64_t next(Gen *restrict g)
+{
+  uint64_t z = (g->state += 0x9e3779b97f4a7c15ull);
+  z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z          = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static uint32_t below(Gen *restrict g, uint32_t n)
+{
+  return (uint32_t)(next(g) % n);
+}
+
+static void put(Gen *restrict g, const char *s)
+{
+  co_append(g->out, s, strlen(s));
+}
+
+static void putf(Gen *restrict g, const char *fmt, uint64_t v)
+{
+  char buf[32];
+  int len = snprintf(buf, sizeof(buf), fmt, v);
+  co_append(g->out, buf, (size_t)len);
+}
+
+// identifiers start with `v`, which no keyword does
+static void ident(Gen *restrict g, StrView *restrict name, char *buf,
+                  uint32_t len)
+{
+  static const char chars[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+
+  buf[0] = 'v';
+  for (uint32_t i = 1; i < len; ++i)
+    buf[i] = chars[below(g, i == 1 ? 26 : 37)];
+
+  name->txt = buf;
+  name->len = len;
+}
+
+static void put_name(Gen *restrict g, StrView name)
+{
+  co_append(g->out, name.txt, name.len);
+}
+
+// an expression over the names in scope. `+` is left associative, so a
+// long chain nests `depth` deep
+static void expr(Gen *restrict g, const StrView *names, uint32_t nnames,
+                 uint32_t depth, uint32_t lit_pct)
+{
+  for (uint32_t d = 0; d <= depth; ++d)
+  {
+    if (d) put(g, " + ");
+    if (!below(g, 4)) put(g, "-");
+
+    if (below(g, 100) < lit_pct) putf(g, "%lu", next(g) >> 40);
+    else put_name(g, names[below(g, nnames)]);
+  }
+}
+
+static void comment(Gen *restrict g)
+{
+  static const char *words[] = {"the", "value", "is", "folded", "later",
+                                "because", "wraps", "around", "TODO:"};
+
+  bool block = below(g, 2);
+  put(g, block ? "/* " : "// ");
+
+  for (uint32_t w = 0, n = 3 + below(g, 12); w < n; ++w)
+  {
+    put(g, words[below(g, sizeof(words) / sizeof(*words))]);
+    put(g, block && !below(g, 4) ? "\n   " : " ");
+  }
+
+  put(g, block ? "*/\n" : "\n");
+}
+
+static void function(Gen *restrict g, GenShape shape)
+{
+  if (shape == GEN_MIXED) shape = below(g, GEN_MIXED);
+
+  uint32_t nparams = 1 + below(g, 3), nlets = 1 + below(g, 3);
+  uint32_t depth = 2 + below(g, 4), name_len = 2 + below(g, 6);
+  uint32_t lit_pct = 30;
+
+  switch (shape)
+  {
+  case GEN_DEEP:
+    nlets = 2;
+    depth = 64 + below(g, 192);
+    break;
+  case GEN_IDENTS:  name_len = 64 + below(g, 160); break;
+  case GEN_LITERALS:
+    lit_pct = 90;
+    depth   = 8 + below(g, 24);
+    break;
+  case GEN_COMMENTS: comment(g); [[fallthrough]];
+  default:           break;
+  }
+
+  char bufs[6][256];
+  StrView names[6];
+  uint32_t nnames = 0;
+
+  putf(g, "fn f%lu(", g->fn++);
+  for (uint32_t p = 0; p < nparams; ++p, ++nnames)
+  {
+    ident(g, names + nnames, bufs[nnames], name_len);
+    if (p) put(g, ", ");
+    put_name(g, names[nnames]);
+    put(g, ": u64");
+  }
+  put(g, ") -> u64 {\n");
+
+  for (uint32_t l = 0; l < nlets; ++l, ++nnames)
+  {
+    if (shape == GEN_COMMENTS) comment(g);
+
+    ident(g, names + nnames, bufs[nnames], name_len);
+    put(g, "\tlet ");
+    put_name(g, names[nnames]);
+    put(g, ": u64 = ");
+    expr(g, names, nnames, depth, lit_pct);
+    put(g, ";\n");
+  }
+
+  put(g, "\treturn ");
+  expr(g, names, nnames, depth, lit_pct);
+  put(g, ";\n}\n\n");
+}
+
+void gen_source(DynamicArray *restrict out, GenShape shape, uint64_t seed,
+                size_t bytes)
+{
+  Gen g       = {.out = out, .state = seed};
+  size_t stop = out->len + bytes;
+
+  while (out->len < stop)
+    function(&g, shape);
+}
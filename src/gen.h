@@ -0,0 +1,28 @@
+#ifndef _GEN_H
+#define _GEN_H
+
+#include "common.h"
+
+#define GenShapeMacro(X)                                                       \
+  X(GEN_SMALL, "small")       /* many small functions */                      \
+  X(GEN_DEEP, "deep")         /* few functions with deep expressions */       \
+  X(GEN_IDENTS, "idents")     /* long identifiers */                          \
+  X(GEN_LITERALS, "literals") /* mostly integer literals */                   \
+  X(GEN_COMMENTS, "comments") /* more comment than code */                    \
+  X(GEN_MIXED, "mixed")       /* all of the above */
+
+#define GenShapeMacroDeclare(V, ...) V,
+
+typedef enum
+{
+  GenShapeMacro(GenShapeMacroDeclare) GEN_SHAPES
+} GenShape;
+
+const char *gen_shape_name(GenShape shape);
+
+// appends about `bytes` of funlang that checks without errors to `out`
+// (char). the same seed always gives the same source
+void gen_source(DynamicArray *restrict out, GenShape shape, uint64_t seed,
+                size_t bytes);
+
+#endif // _GEN_H
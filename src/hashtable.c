@@ -2,10 +2,18 @@
 #include <stdio.h>
 #include <sys/mman.h>
 
-static uint32_t fnv_32_str(StrView str)
+// interned strings are never moved, so that a StrView handed out by the set
+// stays valid (and comparable by pointer) for the lifetime of the set.
+// we reserve the address space up front, inaccessible so that it isn't
+// charged to the process, and make it usable a chunk at a time
+#define INTERN_RESERVE (1u << 26) // for sets nobody sized
+#define INTERN_CHUNK (1u << 16)
+#define INTERN_MAX (1u << 31)
+
+uint32_t fnv_32_buf(const void *buf, uint32_t len)
 {
-  uint8_t *bp = (uint8_t *)str.txt; /* start of buffer */
-  uint8_t *be = bp + str.len;       /* beyond end of buffer */
+  uint8_t *bp = (uint8_t *)buf; /* start of buffer */
+  uint8_t *be = bp + len;       /* beyond end of buffer */
 
   // TODO: param?
   uint32_t hval = 0;
@@ -22,6 +30,77 @@ static uint32_t fnv_32_str(StrView str)
   return hval;
 }
 
+// FNV-1a, for hashing whole files
+uint64_t fnv_64_buf(const void *buf, size_t len)
+{
+  const uint8_t *bp = buf, *be = bp + len;
+
+  uint64_t hval = 0xcbf29ce484222325ull; // fnv 64 bit offset basis
+  while (bp < be)
+  {
+    hval ^= (uint64_t)*bp++;
+    hval *= 0x100000001b3ull; // fnv 64 bit prime
+  }
+
+  return hval;
+}
+
+static uint32_t fnv_32_str(StrView str) { return fnv_32_buf(str.txt, str.len); }
+
+static size_t committed(uint32_t len) { return (len + 0xfffu) & ~0xfffu; }
+
+// the accessible part of a region holding `len` bytes
+static size_t usable(uint32_t len, uint32_t cap)
+{
+  size_t mask = INTERN_CHUNK - 1, chunks = ((size_t)len + mask) & ~mask;
+  return MIN(chunks, (size_t)cap);
+}
+
+void hset_reserve(HSet *restrict hs, size_t bytes)
+{
+  assert(!hs->intrn.buffer && "HSet intern region already reserved");
+
+  // symbols are 32 bit offsets into the region
+  bytes        = MIN(MAX(bytes, (size_t)1), (size_t)INTERN_MAX);
+  uint32_t cap = (uint32_t)committed((uint32_t)bytes);
+  void *region = mmap(NULL, cap, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+  assert(region != MAP_FAILED && "failed to mmap HSet intern region");
+
+  hs->intrn.buffer = region;
+  hs->intrn.cap    = cap;
+}
+
+// makes room for `bytes` more in the region, false if the reservation is
+// used up or the room can't be committed
+static bool make_room(HSet *restrict hs, size_t bytes)
+{
+  if (!hs->intrn.buffer) hset_reserve(hs, INTERN_RESERVE);
+
+  uint32_t cap = hs->intrn.cap, len = hs->intrn.len;
+  if (cap - len < bytes) return false;
+
+  size_t from = usable(len, cap), to = usable(len + (uint32_t)bytes, cap);
+  return from == to || !mprotect((char *)hs->intrn.buffer + from, to - from,
+                                 PROT_READ | PROT_WRITE);
+}
+
+// copies `str` into room made for it
+static const char *intern_bytes(HSet *restrict hs, StrView str)
+{
+  char *dst = (char *)hs->intrn.buffer + hs->intrn.len;
+  memcpy(dst, str.txt, str.len);
+
+  // the kernel commits the region page by page, nothing is ever copied
+  size_t old = committed(hs->intrn.len);
+  hs->intrn.len += str.len;
+  if (committed(hs->intrn.len) != old)
+    mem_grow(MEM_NAMES, old, committed(hs->intrn.len), 0);
+
+  return dst;
+}
+
 static void insert_unique_in_cap(SetEntry *restrict ens, StrView str,
                                  uint32_t cap_mask)
 {
@@ -49,15 +128,19 @@ static void grow(HSet *restrict hs)
 
   uint32_t mask = new_cap - 1;
 
-  while (ben++ < een)
+  for (; ben < een; ben++)
   {
     if (!ben->skey.txt) continue;
 
     insert_unique_in_cap(nentrs, ben->skey, mask);
   }
 
+  munmap(hs->entrs, hs->encap * sizeof(SetEntry));
+
 end:
-  munmap(hs->entrs, hs->encap);
+  // rehashing copies every entry in use
+  mem_grow(MEM_HSET, hs->encap * sizeof(SetEntry), new_cap * sizeof(SetEntry),
+           hs->inuse * sizeof(SetEntry));
   hs->entrs = nentrs;
   hs->encap = new_cap;
 }
@@ -72,14 +155,20 @@ StrView insert_str(HSet *restrict hs, StrView str)
   uint32_t cap_mask = hs->encap - 1;
   uint32_t idx      = fnv_32_str(str) & cap_mask;
 
-  for (SetEntry ent = hs->entrs[idx]; ent.skey.txt; idx = (idx + 1) & cap_mask)
+  for (SetEntry ent; (ent = hs->entrs[idx]).skey.txt;
+       idx = (idx + 1) & cap_mask)
   {
     if (ent.skey.len == str.len &&
         !memcmp(ent.skey.txt, str.txt, MIN(ent.skey.len, str.len)))
       return ent.skey;
   }
 
-  str.txt = co_append(&hs->intrn, str.txt, str.len);
+  // the length and the text go in together or not at all
+  if (!make_room(hs, sizeof(str.len) + (size_t)str.len)) return (StrView){};
+
+  StrView len = {.txt = (const char *)&str.len, .len = sizeof(str.len)};
+  (void)intern_bytes(hs, len);
+  str.txt = intern_bytes(hs, str);
 
   hs->entrs[idx].skey = str;
 
@@ -109,11 +198,33 @@ bool remove_str(HSet *restrict hs, StrView str)
     idx = (idx + 1) & cap_mask;
   }
 
-  hs->inuse--;
+  if (there) hs->inuse--;
 
   return there;
 }
 
+HSet hset_from_bytes(const char *bytes, uint32_t len, size_t reserve,
+                     uint32_t encap)
+{
+  HSet hs = {};
+  hset_reserve(&hs, MAX(reserve, (size_t)len));
+
+  // the region was sized for `len`, so only committing it fails, like a
+  // malloc would, and not only in debug builds
+  if (!make_room(&hs, len)) abort();
+  (void)intern_bytes(&hs, (StrView){.txt = bytes, .len = len});
+
+  if (!encap) return hs;
+
+  hs.entrs = mmap(NULL, encap * sizeof(SetEntry), PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(hs.entrs != MAP_FAILED && "failed to mmap HSet");
+  hs.encap = encap;
+  mem_grow(MEM_HSET, 0, encap * sizeof(SetEntry), 0);
+
+  return hs;
+}
+
 StrView insert(HSet *restrict hs, char *to_insert, uint32_t len)
 {
   return insert_str(hs, (StrView){.len = len, .txt = to_insert});
@@ -121,6 +232,9 @@ StrView insert(HSet *restrict hs, char *to_insert, uint32_t len)
 
 void free_hset(HSet hs)
 {
-  munmap(hs.entrs, hs.encap);
-  free(hs.intrn.buffer);
+  if (hs.entrs) munmap(hs.entrs, hs.encap * sizeof(SetEntry));
+  if (hs.intrn.buffer) munmap(hs.intrn.buffer, hs.intrn.cap);
+
+  mem_release(MEM_HSET, hs.encap * sizeof(SetEntry));
+  mem_release(MEM_NAMES, committed(hs.intrn.len));
 }
@@ -16,9 +16,39 @@ typedef struct
   DynamicArray intrn;
 } HSet;
 
+uint32_t fnv_32_buf(const void *buf, uint32_t len);
+uint64_t fnv_64_buf(const void *buf, size_t len);
+
+// reserves room for `bytes` of interned strings, length prefixes included,
+// in a set that hasn't interned anything yet. a set that isn't sized this
+// way gets a default reservation on its first insert. the room only costs
+// address space until strings fill it
+void hset_reserve(HSet *restrict hs, size_t bytes);
+
+// a set whose intern region starts out as a copy of `bytes` with room for
+// `reserve` bytes in total, with an empty table of `encap` (a power of two
+// or 0) entries to be filled in directly
+[[nodiscard]] HSet hset_from_bytes(const char *bytes, uint32_t len,
+                                   size_t reserve, uint32_t encap);
+
+// interned strings are preceded by their length in the intern region, so
+// the offset of the text is all it takes to get one back. a string that
+// isn't in the set yet and doesn't fit its region gives an empty StrView
 StrView insert_str(HSet *restrict hs, StrView str);
 StrView insert(HSet *restrict hs, char *text, uint32_t len);
 bool remove_str(HSet *restrict hs, StrView str);
 void free_hset(HSet hs);
 
+static inline uint32_t interned_off(const HSet *hs, StrView str)
+{
+  return (uint32_t)(str.txt - (const char *)hs->intrn.buffer);
+}
+
+static inline StrView interned_at(const char *intrn, uint32_t off)
+{
+  StrView str = {.txt = intrn + off};
+  memcpy(&str.len, str.txt - sizeof(str.len), sizeof(str.len));
+  return str;
+}
+
 #endif // _HASHTABLE_H
@@ -0,0 +1,430 @@
+/*
+ * Incremental checking and lowering, one function at a time.
+ *
+ *  a function is a contiguous slice of the tree, so it can be checked and
+ *  lowered on its own, together with the functions its names resolve into.
+ *  a fingerprint covers the nodes of the slice, their payloads and what
+ *  they resolve to, including the fingerprints of those other functions.
+ *  the results of all functions of a file are kept in one pack, indexed by
+ *  fingerprint:
+ *
+ *    PackHeader | PackEntry[nfns], sorted by fingerprint | entries...
+ *
+ *  where an entry is
+ *
+ *    IncrHeader | (node, len, msg)[nerrs] | op[n] | ty[n] | a[n] | b[n]
+ *
+ *  node indices and operands are relative to the function, so moving a
+ *  function within its file doesn't change its entry.
+ */
+
+#include "incr.h"
+#include "cache.h"
+#include "front.h"
+
+#define INCR_MAGIC 0x4e46464c /* "LFFN" */
+#define INCR_VERSION 2        /* bump whenever checking or lowering changes */
+
+typedef struct
+{
+  uint32_t magic, version;
+  uint32_t nerrs, ninsns, nparams;
+  TypeId ret;
+  bool lowered;
+} IncrHeader;
+
+typedef struct
+{
+  uint32_t node, len;
+} IncrErr; // followed by the message
+
+typedef struct
+{
+  uint32_t magic, version;
+  uint32_t nfns;
+} PackHeader;
+
+typedef struct
+{
+  uint64_t fp;
+  uint32_t off, len; // of the entry, from the start of the pack
+} PackEntry;
+
+static uint64_t mix(uint64_t h, uint64_t v)
+{
+  return (h ^ fnv_64_buf(&v, sizeof(v))) * 0x100000001b3ull;
+}
+
+static uint32_t fn_start(const PTree *tree, uint32_t end)
+{
+  return end - tree->data[end];
+}
+
+// the function containing node `n`, as an index into `ends`
+static uint32_t owner(const uint32_t *ends, uint32_t nfns, uint32_t n)
+{
+  uint32_t lo = 0, hi = nfns;
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (ends[mid] < n) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// names only resolve backwards, so every function a use can resolve into
+// has its fingerprint in `fps` already
+static uint64_t fingerprint(const PTree *tree, uint32_t end,
+                            const Resolution *res, const uint64_t *fps,
+                            const uint32_t *ends, uint32_t nfns)
+{
+  uint32_t beg = fn_start(tree, end);
+  uint64_t h   = mix(0, INCR_VERSION);
+
+  for (uint32_t i = beg; i <= end; ++i)
+  {
+    h = mix(h, (uint64_t)tree->kind[i] << 32 | subtree_size(tree, i));
+
+    // symbols depend on the order names were first seen in, not just on
+    // the function, so names are hashed by their text
+    switch (tree->kind[i])
+    {
+    case LITERAL_INT: h = mix(h, lit_val(tree, i)); break;
+    case BUILTIN_TY:  h = mix(h, tree->data[i]); break;
+    case BIND_NAME:
+    case BIND_TY_NAME:
+    case BIND_USE:
+    case BIND_TY_USE:
+    {
+      StrView name = sym_str(tree, i);
+      h            = mix(h, fnv_64_buf(name.txt, name.len));
+      break;
+    }
+    default: break;
+    }
+
+    uint32_t b = res->binding[i];
+    if (b == RES_UNBOUND) continue;
+
+    if (b >= beg) h = mix(h, b - beg);
+    else
+    {
+      uint32_t dep = owner(ends, nfns, b);
+      h            = mix(mix(h, fps[dep]), b - fn_start(tree, ends[dep]));
+    }
+  }
+
+  return h;
+}
+
+static void append_fn(IR *restrict ir, StrView name, const IncrHeader *h,
+                      const uint8_t *op, const TypeId *ty, const uint32_t *a,
+                      const uint32_t *b)
+{
+  IRFunc f    = {.name    = name,
+                 .ret     = h->ret,
+                 .nparams = h->nparams,
+                 .blk_beg = ir->blocks.len};
+  IRBlock blk = {.beg = ir->len};
+
+  for (uint32_t v = 0; v < h->ninsns; ++v)
+  {
+    uint32_t x = a[v], y = b[v], n = ir_nvals(op[v]);
+    if (n > 0) x += blk.beg;
+    if (n > 1) y += blk.beg;
+    push_insn(ir, op[v], ty[v], x, y);
+  }
+
+  blk.end = ir->len;
+  co_push(&ir->blocks, blk);
+
+  f.blk_end = ir->blocks.len;
+  co_push(&ir->funcs, f);
+}
+
+// replays an entry, returns false without doing anything if it's unusable
+static bool reuse(IR *restrict ir, const PTree *tree, uint32_t beg,
+                  FILE *diag, Lines *lines, const uint8_t *img, size_t size,
+                  uint32_t *restrict nerrs)
+{
+  IncrHeader h;
+  if (size < sizeof(h)) return false;
+  memcpy(&h, img, sizeof(h));
+  if (h.magic != INCR_MAGIC || h.version != INCR_VERSION) return false;
+
+  const uint8_t *errs = img + sizeof(h), *p = errs, *end = img + size;
+  for (uint32_t e = 0; e < h.nerrs; ++e)
+  {
+    IncrErr err;
+    if ((size_t)(end - p) < sizeof(err)) return false;
+    memcpy(&err, p, sizeof(err));
+    p += sizeof(err);
+
+    if ((size_t)(end - p) < err.len) return false;
+    p += err.len;
+  }
+
+  size_t n = h.ninsns;
+  if ((size_t)(end - p) != n * (2 + 2 * sizeof(uint32_t))) return false;
+
+  p = errs;
+  for (uint32_t e = 0; e < h.nerrs; ++e)
+  {
+    IncrErr err;
+    memcpy(&err, p, sizeof(err));
+    p += sizeof(err);
+
+    report_node(diag, lines, tree, beg + err.node,
+                (StrView){.txt = (const char *)p, .len = err.len});
+    p += err.len;
+  }
+  *nerrs += h.nerrs;
+
+  if (!h.lowered) return true;
+
+  // the operands may be unaligned in the image
+  uint32_t *ab = malloc(2 * n * sizeof(uint32_t) + 1);
+  assert(ab && "failed to allocate operands");
+  memcpy(ab, p + 2 * n, 2 * n * sizeof(uint32_t));
+
+  append_fn(ir, sym_str(tree, beg + 1), &h, p, p + n, ab, ab + n);
+  free(ab);
+
+  return true;
+}
+
+static void push_operands(DynamicArray *restrict img, const uint8_t *op,
+                          const uint32_t *x, uint32_t n, uint32_t base,
+                          bool second)
+{
+  for (uint32_t v = 0; v < n; ++v)
+  {
+    bool rel = ir_nvals(op[v]) > second;
+
+    uint32_t o = rel ? x[v] - base : x[v];
+    co_append(img, (uint8_t *)&o, sizeof(o));
+  }
+}
+
+// checks and lowers the function ending at `end` on its own, behind the
+// functions ending at `deps` (in tree order), and appends its entry to `out`
+static void redo(DynamicArray *restrict out, const PTree *tree, uint32_t end,
+                 const uint32_t *deps, uint32_t ndeps)
+{
+  PTree sub = {.lits = tree->lits, .names = tree->names};
+  for (uint32_t d = 0; d < ndeps; ++d)
+  {
+    uint32_t beg = fn_start(tree, deps[d]);
+    append_nodes(&sub, tree, beg, deps[d] - beg + 1);
+  }
+  uint32_t beg = fn_start(tree, end), off = sub.len;
+  append_nodes(&sub, tree, beg, end - beg + 1);
+
+  Resolution res = resolve(&sub, sub.len);
+  Typing typing  = check(&sub, sub.len, &res);
+
+  IR sir = {};
+  lower(&sir, &sub, sub.len, &res, &typing);
+
+  uint32_t at  = out->len;
+  IncrHeader h = {.magic   = INCR_MAGIC,
+                  .version = INCR_VERSION,
+                  .ret     = typing.types[sub.len - 1]};
+  co_append(out, (uint8_t *)&h, sizeof(h));
+
+  for (CheckErr *e = typing.errs.buffer;
+       e < (CheckErr *)typing.errs.buffer + typing.errs.len; ++e)
+  {
+    if (e->node < off) continue; // a dependency's own problem
+
+    IncrErr err = {.node = e->node - off, .len = (uint32_t)strlen(e->msg)};
+    co_append(out, (uint8_t *)&err, sizeof(err));
+    co_append(out, (const uint8_t *)e->msg, err.len);
+    h.nerrs++;
+  }
+
+  // if the function was lowered, it was lowered last
+  if (h.ret != TY_NONE)
+  {
+    const IRFunc *f    = (IRFunc *)sir.funcs.buffer + sir.funcs.len - 1;
+    const IRBlock *blk = (IRBlock *)sir.blocks.buffer + f->blk_beg;
+    uint32_t base = blk->beg, n = blk->end - base;
+
+    h.lowered = true;
+    h.ninsns  = n;
+    h.nparams = f->nparams;
+
+    co_append(out, sir.op + base, n);
+    co_append(out, sir.ty + base, n);
+    push_operands(out, sir.op + base, sir.a + base, n, base, false);
+    push_operands(out, sir.op + base, sir.b + base, n, base, true);
+  }
+  memcpy((uint8_t *)out->buffer + at, &h, sizeof(h));
+
+  free_ir(sir);
+  free_typing(typing);
+  free_resolution(res);
+  free_ptree(sub);
+}
+
+// the entry for `fp` in a mapped pack, NULL if there is none
+static const uint8_t *lookup(const uint8_t *pack, size_t size, uint64_t fp,
+                             size_t *len)
+{
+  PackHeader h;
+  if (!pack || size < sizeof(h)) return NULL;
+  memcpy(&h, pack, sizeof(h));
+
+  if (h.magic != INCR_MAGIC || h.version != INCR_VERSION ||
+      (size - sizeof(h)) / sizeof(PackEntry) < h.nfns)
+    return NULL;
+
+  const uint8_t *index = pack + sizeof(h);
+  uint32_t lo = 0, hi = h.nfns;
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    PackEntry e;
+    memcpy(&e, index + mid * sizeof(e), sizeof(e));
+
+    if (e.fp < fp) lo = mid + 1;
+    else if (e.fp > fp) hi = mid;
+    else if ((size_t)e.off + e.len > size) return NULL;
+    else
+    {
+      *len = e.len;
+      return pack + e.off;
+    }
+  }
+
+  return NULL;
+}
+
+static int cmp_entries(const void *a, const void *b)
+{
+  const PackEntry *x = a, *y = b;
+  return (x->fp > y->fp) - (x->fp < y->fp);
+}
+
+static void write_pack(const char *dir, const char *path, DynamicArray *index,
+                       const DynamicArray *entries)
+{
+  PackHeader h = {
+      .magic = INCR_MAGIC, .version = INCR_VERSION, .nfns = index->len};
+  size_t head = sizeof(h) + index->len * sizeof(PackEntry);
+
+  PackEntry *e = index->buffer;
+  for (uint32_t i = 0; i < index->len; ++i)
+    e[i].off += (uint32_t)head;
+  if (index->len) qsort(e, index->len, sizeof(PackEntry), cmp_entries);
+
+  uint8_t *img = malloc(head + entries->len);
+  assert(img && "failed to allocate pack");
+
+  memcpy(img, &h, sizeof(h));
+  memcpy(img + sizeof(h), e, index->len * sizeof(PackEntry));
+  if (entries->len) memcpy(img + head, entries->buffer, entries->len);
+
+  cache_put(dir, path, img, head + entries->len);
+  free(img);
+}
+
+// the functions the uses in [beg, end] resolve into, in tree order
+static void collect_deps(DynamicArray *restrict deps, const Resolution *res,
+                         uint32_t beg, uint32_t end, const uint32_t *ends,
+                         uint32_t nfns)
+{
+  deps->len = 0;
+
+  for (uint32_t i = beg; i <= end; ++i)
+  {
+    uint32_t b = res->binding[i];
+    if (b == RES_UNBOUND || b >= beg) continue;
+
+    uint32_t d = ends[owner(ends, nfns, b)];
+    uint32_t *e = deps->buffer, at = 0;
+    while (at < deps->len && e[at] < d)
+      at++;
+
+    if (at == deps->len || e[at] != d) co_insert(deps, d, at);
+  }
+}
+
+uint32_t lower_incremental(IR *restrict ir, const PTree *tree, uint32_t size,
+                           FILE *diag, Lines *lines, const char *dir,
+                           const char *unit, IncrStats *restrict stats)
+{
+  Resolution res = resolve(tree, size);
+
+  uint32_t nfns = 0;
+  for (uint32_t i = 0; i < size; ++i)
+    nfns += tree->kind[i] == FUN_END;
+
+  uint32_t *ends = malloc((nfns + 1) * sizeof(uint32_t));
+  uint64_t *fps  = malloc((nfns + 1) * sizeof(uint64_t));
+  assert(ends && fps && "failed to allocate fingerprints");
+
+  char path[4096];
+  cache_path(path, sizeof(path), dir, fnv_64_buf(unit, strlen(unit)), "fns");
+
+  size_t psize        = 0;
+  const uint8_t *pack = cache_map(path, &psize);
+
+  DynamicArray entries = {}; // uint8_t, of the new pack
+  DynamicArray index   = {}; // PackEntry
+  DynamicArray deps    = {}; // uint32_t
+  uint32_t nerrs = 0, fn = 0, redone = 0;
+
+  for (uint32_t end = 0; end < size; ++end)
+  {
+    if (tree->kind[end] != FUN_END) continue;
+
+    uint32_t beg = fn_start(tree, end);
+    ends[fn]     = end;
+    fps[fn]      = fingerprint(tree, end, &res, fps, ends, fn);
+
+    size_t len;
+    const uint8_t *old = lookup(pack, psize, fps[fn], &len);
+
+    PackEntry e = {.fp = fps[fn], .off = entries.len};
+    if (old && reuse(ir, tree, beg, diag, lines, old, len, &nerrs))
+      co_append(&entries, old, len);
+    else
+    {
+      collect_deps(&deps, &res, beg, end, ends, fn);
+      redo(&entries, tree, end, deps.buffer, deps.len);
+
+      bool ok = reuse(ir, tree, beg, diag, lines,
+                      (uint8_t *)entries.buffer + e.off, entries.len - e.off,
+                      &nerrs);
+      assert(ok && "produced an unusable entry");
+      (void)ok;
+      redone++;
+    }
+
+    e.len = entries.len - e.off;
+    co_push(&index, e);
+    fn++;
+  }
+
+  // functions that went away only leave stale entries behind
+  if (redone) write_pack(dir, path, &index, &entries);
+  if (pack) cache_unmap(pack, psize);
+
+  if (stats)
+  {
+    stats->reused += fn - redone;
+    stats->redone += redone;
+  }
+
+  free(entries.buffer);
+  free(index.buffer);
+  free(deps.buffer);
+  free(fps);
+  free(ends);
+  free_resolution(res);
+
+  return nerrs;
+}
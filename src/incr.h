@@ -0,0 +1,19 @@
+#ifndef _INCR_H
+#define _INCR_H
+
+#include "ir.h"
+#include "lines.h"
+
+typedef struct
+{
+  uint32_t reused, redone; // functions taken from the cache or checked anew
+} IncrStats;
+
+// does what `lower_tree` does, but reuses the diagnostics and IR of every
+// function whose fingerprint is found in the pack for `unit` (a path) in the
+// cache directory `dir`, and updates the pack if anything had to be redone
+uint32_t lower_incremental(IR *restrict ir, const PTree *tree, uint32_t size,
+                           FILE *diag, Lines *lines, const char *dir,
+                           const char *unit, IncrStats *restrict stats);
+
+#endif // _INCR_H
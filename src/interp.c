@@ -0,0 +1,334 @@
+/*
+ * A register based bytecode interpreter.
+ *
+ *  every SSA value of a function gets its own register, so compiling the IR
+ *  is a single pass that mostly renumbers operands. constants live in a
+ *  pool instead of registers whenever all their users can take them as an
+ *  immediate, and an add that is immediately returned becomes a single
+ *  instruction.
+ *
+ *  dispatch is direct threaded: once the program is threaded each
+ *  instruction holds the address of its handler and every handler jumps
+ *  straight to the next one.
+ *
+ *  a checked instruction or assertion that fails traps the process the way
+ *  jitted code does, so both agree on which calls don't return.
+ */
+
+#include "interp.h"
+
+static void emit(Program *restrict p, BOp op, uint32_t dst, uint32_t a,
+                 uint32_t b, TypeId ty)
+{
+  BInsn in = {.op  = op,
+              .dst = (uint16_t)dst,
+              .a   = (uint16_t)a,
+              .b   = (uint16_t)b,
+              .sh  = (uint8_t)(64 - inbuilt_bits(ty))};
+  co_push(&p->code, in);
+}
+
+static uint32_t push_const(Program *restrict p, uint64_t k)
+{
+  return co_push(&p->consts, k);
+}
+
+// signed and unsigned variants are always adjacent
+static BOp variant(BOp unsigned_op, TypeId ty)
+{
+  return unsigned_op + inbuilt_signed(ty);
+}
+
+static void compile_fn(Program *restrict p, const IR *ir, const IRFunc *f,
+                       bool *restrict in_reg)
+{
+  const IRBlock *blocks = ir->blocks.buffer;
+
+  uint32_t base = blocks[f->blk_beg].beg;
+  uint32_t end  = blocks[f->blk_end - 1].end;
+
+  BFunc bf = {.name    = f->name,
+              .code    = p->code.len,
+              .params  = p->params.len,
+              .nparams = f->nparams,
+              .nregs   = end - base,
+              .ret     = f->ret};
+
+  // registers are numbered in 16 bits, a bigger function keeps its entry
+  // so that indices stay those of the IR, but has no code
+  bf.interpretable = bf.nregs <= 0xffff;
+  if (!bf.interpretable)
+  {
+    // the parameters come first, so their registers still fit
+    for (uint32_t v = base; v < end && ir->op[v] == IR_PARAM; ++v)
+    {
+      BParam par = {.reg = (uint16_t)(v - base), .ty = ir->ty[v]};
+      co_push(&p->params, par);
+    }
+    co_push(&p->funcs, bf);
+    return;
+  }
+
+  // does a constant need to be loaded into its register?
+  for (uint32_t v = base; v < end; ++v)
+    in_reg[v - base] = false;
+  for (uint32_t v = base; v < end; ++v)
+  {
+    uint8_t op = ir->op[v];
+    bool neg = op == IR_NEG || op == IR_NEGC || op == IR_NEGX;
+    bool add = op == IR_ADD || op == IR_ADDC || op == IR_ADDX;
+    if (neg) in_reg[ir->a[v] - base] = true;
+    if (op == IR_ASSERT || (add && ir->op[ir->a[v]] == IR_CONST &&
+                            ir->op[ir->b[v]] == IR_CONST))
+      in_reg[ir->a[v] - base] = in_reg[ir->b[v] - base] = true;
+  }
+
+  for (uint32_t v = base; v < end; ++v)
+  {
+    uint32_t dst = v - base, a = ir->a[v] - base, b = ir->b[v] - base;
+    TypeId ty    = ir->ty[v];
+
+    switch (ir->op[v])
+    {
+    case IR_PARAM:
+    {
+      BParam par = {.reg = (uint16_t)dst, .ty = ty};
+      co_push(&p->params, par);
+      break;
+    }
+    case IR_CONST:
+    {
+      if (!in_reg[dst]) break;
+
+      uint32_t k = push_const(p, ir_const(ir, v));
+      emit(p, BOP_LOADK, dst, 0, k, ty);
+      break;
+    }
+    case IR_NEG:  emit(p, variant(BOP_NEG_U, ty), dst, a, 0, ty); break;
+    case IR_NEGX: emit(p, BOP_NEGX, dst, a, 0, ty); break;
+    case IR_ADD:
+    case IR_ADDX:
+    {
+      bool ka = ir->op[ir->a[v]] == IR_CONST, kb = ir->op[ir->b[v]] == IR_CONST;
+      bool x  = ir->op[v] == IR_ADDX;
+
+      if (ka != kb)
+      {
+        uint32_t k = push_const(p, ir_const(ir, ka ? ir->a[v] : ir->b[v]));
+        emit(p, x ? BOP_ADDXI : variant(BOP_ADDI_U, ty), dst, ka ? b : a, k,
+             ty);
+      }
+      else if (v + 1 < end && ir->op[v + 1] == IR_RET && ir->a[v + 1] == v)
+      {
+        emit(p, x ? BOP_ADDXRET : variant(BOP_ADDRET_U, ty), dst, a, b, ty);
+        v = end; // the return is part of this instruction
+      }
+      else { emit(p, x ? BOP_ADDX : variant(BOP_ADD_U, ty), dst, a, b, ty); }
+      break;
+    }
+    case IR_NEGC: emit(p, variant(BOP_NEGC_U, ty), dst, a, 0, ty); break;
+    case IR_ADDC:
+    {
+      bool ka = ir->op[ir->a[v]] == IR_CONST, kb = ir->op[ir->b[v]] == IR_CONST;
+
+      if (ka != kb)
+      {
+        uint32_t k = push_const(p, ir_const(ir, ka ? ir->a[v] : ir->b[v]));
+        emit(p, variant(BOP_ADDCI_U, ty), dst, ka ? b : a, k, ty);
+      }
+      else { emit(p, variant(BOP_ADDC_U, ty), dst, a, b, ty); }
+      break;
+    }
+    case IR_ASSERT: emit(p, variant(BOP_ASSERT_U, ty), 0, a, b, ty); break;
+    case IR_RET:
+      if (ir->op[ir->a[v]] == IR_CONST && !in_reg[a])
+        emit(p, BOP_RETK, 0, 0, push_const(p, ir_const(ir, ir->a[v])), ty);
+      else emit(p, BOP_RET, 0, a, 0, ty);
+      v = end; // anything after it is unreachable
+      break;
+    default: break;
+    }
+  }
+
+  bf.len      = p->code.len - bf.code;
+  p->max_regs = MAX(p->max_regs, bf.nregs);
+  co_push(&p->funcs, bf);
+}
+
+Program compile_program(const IR *ir)
+{
+  Program p    = {};
+  bool *in_reg = malloc(ir->len * sizeof(bool));
+  assert((in_reg || !ir->len) && "failed to allocate constant map");
+
+  const IRFunc *funcs = ir->funcs.buffer;
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+    compile_fn(&p, ir, funcs + fn, in_reg);
+
+  free(in_reg);
+
+  return p;
+}
+
+#define BOpMacroLabel(V) [V] = &&V##_h,
+#define DISPATCH() goto *ip->h
+#define NEXT()                                                                 \
+  do                                                                           \
+  {                                                                            \
+    ++ip;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+
+#define ZEXT(v, sh) ((uint64_t)(v) << (sh) >> (sh))
+#define SEXT(v, sh) ((uint64_t)((int64_t)((uint64_t)(v) << (sh)) >> (sh)))
+
+// with `ip` NULL, this only hands out the table of handler addresses
+static uint64_t exec(const BInsn *ip, uint64_t *restrict r, const uint64_t *k,
+                     const void *const **handlers)
+{
+  static const void *const labels[] = {BOpMacro(BOpMacroLabel)};
+
+  if (!ip)
+  {
+    *handlers = labels;
+    return 0;
+  }
+
+  uint64_t x; // the exact result of a checked instruction
+  DISPATCH();
+
+BOP_LOADK_h:
+  r[ip->dst] = k[ip->b];
+  NEXT();
+BOP_NEG_U_h:
+  r[ip->dst] = ZEXT(-r[ip->a], ip->sh);
+  NEXT();
+BOP_NEG_S_h:
+  r[ip->dst] = SEXT(-r[ip->a], ip->sh);
+  NEXT();
+BOP_ADD_U_h:
+  r[ip->dst] = ZEXT(r[ip->a] + r[ip->b], ip->sh);
+  NEXT();
+BOP_ADD_S_h:
+  r[ip->dst] = SEXT(r[ip->a] + r[ip->b], ip->sh);
+  NEXT();
+BOP_ADDI_U_h:
+  r[ip->dst] = ZEXT(r[ip->a] + k[ip->b], ip->sh);
+  NEXT();
+BOP_ADDI_S_h:
+  r[ip->dst] = SEXT(r[ip->a] + k[ip->b], ip->sh);
+  NEXT();
+BOP_RET_h:
+  return r[ip->a];
+BOP_RETK_h:
+  return k[ip->b];
+BOP_ADDRET_U_h:
+  return ZEXT(r[ip->a] + r[ip->b], ip->sh);
+BOP_ADDRET_S_h:
+  return SEXT(r[ip->a] + r[ip->b], ip->sh);
+
+BOP_NEGC_U_h:
+  if (r[ip->a]) goto trap;
+  r[ip->dst] = 0;
+  NEXT();
+BOP_NEGC_S_h:
+  if (__builtin_sub_overflow(0, (int64_t)r[ip->a], (int64_t *)&x) ||
+      SEXT(x, ip->sh) != x)
+    goto trap;
+  r[ip->dst] = x;
+  NEXT();
+BOP_ADDC_U_h:
+  if (__builtin_add_overflow(r[ip->a], r[ip->b], &x) || ZEXT(x, ip->sh) != x)
+    goto trap;
+  r[ip->dst] = x;
+  NEXT();
+BOP_ADDC_S_h:
+  if (__builtin_add_overflow((int64_t)r[ip->a], (int64_t)r[ip->b],
+                             (int64_t *)&x) ||
+      SEXT(x, ip->sh) != x)
+    goto trap;
+  r[ip->dst] = x;
+  NEXT();
+BOP_ADDCI_U_h:
+  if (__builtin_add_overflow(r[ip->a], k[ip->b], &x) || ZEXT(x, ip->sh) != x)
+    goto trap;
+  r[ip->dst] = x;
+  NEXT();
+BOP_ADDCI_S_h:
+  if (__builtin_add_overflow((int64_t)r[ip->a], (int64_t)k[ip->b],
+                             (int64_t *)&x) ||
+      SEXT(x, ip->sh) != x)
+    goto trap;
+  r[ip->dst] = x;
+  NEXT();
+BOP_ASSERT_U_h:
+  if (r[ip->a] >= r[ip->b]) goto trap;
+  NEXT();
+BOP_ASSERT_S_h:
+  if ((int64_t)r[ip->a] >= (int64_t)r[ip->b]) goto trap;
+  NEXT();
+BOP_NEGX_h:
+  r[ip->dst] = -r[ip->a];
+  NEXT();
+BOP_ADDX_h:
+  r[ip->dst] = r[ip->a] + r[ip->b];
+  NEXT();
+BOP_ADDXI_h:
+  r[ip->dst] = r[ip->a] + k[ip->b];
+  NEXT();
+BOP_ADDXRET_h:
+  return r[ip->a] + r[ip->b];
+
+trap:
+  __builtin_trap();
+}
+
+void thread_program(Program *restrict p)
+{
+  if (p->threaded) return;
+
+  const void *const *handlers;
+  exec(NULL, NULL, NULL, &handlers);
+
+  BInsn *code = p->code.buffer;
+  for (uint32_t i = 0; i < p->code.len; ++i)
+    code[i].h = handlers[code[i].op];
+
+  p->threaded = true;
+}
+
+uint32_t find_bfunc(const Program *p, StrView name)
+{
+  const BFunc *funcs = p->funcs.buffer;
+
+  for (uint32_t fn = 0; fn < p->funcs.len; ++fn)
+    if (funcs[fn].name.len == name.len &&
+        !memcmp(funcs[fn].name.txt, name.txt, name.len))
+      return fn;
+
+  return UINT32_MAX;
+}
+
+uint64_t interp_call(const Program *p, uint32_t fn, const uint64_t *args,
+                     uint64_t *restrict regs)
+{
+  assert(p->threaded && "program needs to be threaded before running it");
+
+  const BFunc *f       = (const BFunc *)p->funcs.buffer + fn;
+  const BParam *params = (const BParam *)p->params.buffer + f->params;
+  assert(f->interpretable && "function needs too many registers");
+
+  for (uint32_t i = 0; i < f->nparams; ++i)
+    regs[params[i].reg] = wrap_to(args[i], params[i].ty);
+
+  return exec((const BInsn *)p->code.buffer + f->code, regs, p->consts.buffer,
+              NULL);
+}
+
+void free_program(Program p)
+{
+  free(p.code.buffer);
+  free(p.consts.buffer);
+  free(p.params.buffer);
+  free(p.funcs.buffer);
+}
@@ -0,0 +1,98 @@
+#ifndef _INTERP_H
+#define _INTERP_H
+
+#include "ir.h"
+
+#define BOpMacro(X)                                                            \
+  X(BOP_LOADK)   /* r[dst] = k[b] */                                          \
+  X(BOP_NEG_U)   /* r[dst] = -r[a] */                                         \
+  X(BOP_NEG_S)                                                                 \
+  X(BOP_ADD_U)   /* r[dst] = r[a] + r[b] */                                   \
+  X(BOP_ADD_S)                                                                 \
+  X(BOP_ADDI_U)  /* r[dst] = r[a] + k[b] */                                   \
+  X(BOP_ADDI_S)                                                                \
+  X(BOP_RET)     /* return r[a] */                                            \
+  X(BOP_RETK)    /* return k[b] */                                            \
+  X(BOP_ADDRET_U) /* return r[a] + r[b] */                                    \
+  X(BOP_ADDRET_S)                                                              \
+  X(BOP_NEGC_U)  /* the checked ones trap instead of wrapping */              \
+  X(BOP_NEGC_S)                                                                \
+  X(BOP_ADDC_U)                                                                \
+  X(BOP_ADDC_S)                                                                \
+  X(BOP_ADDCI_U)                                                               \
+  X(BOP_ADDCI_S)                                                               \
+  X(BOP_ASSERT_U) /* trap unless r[a] < r[b] */                               \
+  X(BOP_ASSERT_S)                                                              \
+  X(BOP_NEGX)    /* the exact ones can't overflow, so they need no shifts */  \
+  X(BOP_ADDX)                                                                  \
+  X(BOP_ADDXI)                                                                 \
+  X(BOP_ADDXRET)
+
+#define BOpMacroDeclare(V) V,
+
+typedef enum
+{
+  BOpMacro(BOpMacroDeclare)
+} BOp;
+
+// every instruction is 16 bytes. the _U and _S variants zero or sign extend
+// their result from bit 64 - sh, so registers always hold values in the
+// canonical form of their type
+typedef struct
+{
+  union
+  {
+    uintptr_t op;    // BOp, before the program is threaded
+    const void *h;   // address of the handler, after
+  };
+  uint16_t dst, a, b;
+  uint8_t sh;
+} BInsn;
+
+typedef struct
+{
+  uint16_t reg;
+  TypeId ty;
+} BParam;
+
+typedef struct
+{
+  StrView name;
+  uint32_t code, len; // instruction range
+  uint32_t params;    // first BParam
+  uint32_t nparams;
+  uint32_t nregs;
+  TypeId ret;
+  bool interpretable; // false if it needs more than 0xffff registers
+} BFunc;
+
+typedef struct
+{
+  DynamicArray code;   // BInsn
+  DynamicArray consts; // uint64_t
+  DynamicArray params; // BParam
+  DynamicArray funcs;  // BFunc
+  uint32_t max_regs;
+  bool threaded;
+} Program;
+
+// compiles every function of `ir`, function `i` of the program is function
+// `i` of the IR. functions that need more than 0xffff registers only get
+// their parameters and aren't interpretable
+[[nodiscard]] Program compile_program(const IR *ir);
+
+// swaps the opcodes for the addresses of their handlers, needs to happen
+// once before the program can run
+void thread_program(Program *restrict p);
+
+// returns the index of the function called `name`, or UINT32_MAX
+uint32_t find_bfunc(const Program *p, StrView name);
+
+// `regs` needs room for `p->max_regs` values, `args` are wrapped to the
+// types of the parameters. `fn` has to be interpretable
+uint64_t interp_call(const Program *p, uint32_t fn, const uint64_t *args,
+                     uint64_t *restrict regs);
+
+void free_program(Program p);
+
+#endif // _INTERP_H
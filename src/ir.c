@@ -0,0 +1,214 @@
+/*
+ * Lowering of the checked tree into SSA.
+ *
+ *  in postorder every operand precedes its user, so lowering is one forward
+ *  walk per function that maps nodes to the values they produce. bindings
+ *  don't produce instructions, they just alias the value of their
+ *  initializer (or parameter).
+ *
+ *  unsigned arithmetic wraps, signed arithmetic traps when it overflows, so
+ *  it is lowered to the checked instructions. see range.h for how they get
+ *  relaxed again.
+ */
+
+#include "ir.h"
+#include "perf.h"
+
+// grows one column of the IR, charging it to MEM_IR
+static void *grow_column(void *col, size_t size)
+{
+  uintptr_t old = (uintptr_t)col;
+  size_t old_size = mem_size(col);
+
+  col = realloc(col, size);
+
+  // TODO: actual error handling
+  assert(col && "failed to grow IR");
+
+  mem_grow(MEM_IR, old_size, mem_size(col),
+           (uintptr_t)col != old ? old_size : 0);
+  return col;
+}
+
+static void grow_ir(IR *restrict ir)
+{
+  uint32_t new_cap = ir->cap ? ir->cap << 1 : 0x100;
+
+  ir->op = grow_column(ir->op, new_cap * sizeof(*ir->op));
+  ir->ty = grow_column(ir->ty, new_cap * sizeof(*ir->ty));
+  ir->a  = grow_column(ir->a, new_cap * sizeof(*ir->a));
+  ir->b  = grow_column(ir->b, new_cap * sizeof(*ir->b));
+
+  ir->cap = new_cap;
+}
+
+uint32_t push_insn(IR *restrict ir, IROp op, TypeId ty, uint32_t a,
+                   uint32_t b)
+{
+  if (ir->len == ir->cap) grow_ir(ir);
+
+  ir->op[ir->len] = (uint8_t)op;
+  ir->ty[ir->len] = ty;
+  ir->a[ir->len]  = a;
+  ir->b[ir->len]  = b;
+
+  return ir->len++;
+}
+
+static void lower_fn(IR *restrict ir, const PTree *tree, uint32_t start,
+                     uint32_t end, const Resolution *res, const TypeId *types,
+                     uint32_t *restrict val)
+{
+  IRFunc f    = {.name    = sym_str(tree, start + 1),
+                 .ret     = types[end],
+                 .blk_beg = ir->blocks.len};
+  IRBlock blk = {.beg = ir->len};
+
+  bool in_args = false;
+  for (uint32_t i = start; i < end; ++i)
+  {
+    switch (tree->kind[i])
+    {
+    case EXP_ARGLIST_BEG: in_args = true; break;
+    case EXP_ARGLIST_END: in_args = false; break;
+    case BIND_NAME:
+      if (in_args) val[i] = push_insn(ir, IR_PARAM, types[i], f.nparams++, 0);
+      break;
+    case LITERAL_INT:
+    {
+      uint64_t lit = lit_val(tree, i);
+      val[i] = push_insn(ir, IR_CONST, types[i], (uint32_t)lit,
+                         (uint32_t)(lit >> 32));
+      break;
+    }
+    case BIND_USE: val[i] = val[res->binding[i]]; break;
+    case PREFIX_MINUS:
+    {
+      IROp op = inbuilt_signed(types[i]) ? IR_NEGC : IR_NEG;
+      val[i]  = push_insn(ir, op, types[i], val[i - 1], 0);
+      break;
+    }
+    case INFIX_PLUS:
+    {
+      uint32_t r = i - 1;
+      uint32_t l = r - subtree_size(tree, r) - 1;
+
+      IROp op = inbuilt_signed(types[i]) ? IR_ADDC : IR_ADD;
+      val[i]  = push_insn(ir, op, types[i], val[l], val[r]);
+      break;
+    }
+    case STMT_SEMI:
+    {
+      uint32_t first = i - tree->data[i];
+
+      if (tree->kind[first] == STMT_LET_BIND)
+      {
+        val[first + 1] = val[i - 1];
+        break;
+      }
+
+      if (tree->kind[first] == STMT_ASSERT ||
+          tree->kind[first] == STMT_ASSUME)
+      { // `l > r` is `r < l`
+        uint32_t r   = i - 1;
+        uint32_t cmp = r - subtree_size(tree, r) - 1;
+        uint32_t l   = cmp - 1;
+        if (tree->kind[cmp] == STMT_CMP_GT)
+        {
+          uint32_t t = l;
+          l          = r;
+          r          = t;
+        }
+
+        IROp op = tree->kind[first] == STMT_ASSERT ? IR_ASSERT : IR_ASSUME;
+        push_insn(ir, op, types[l], val[l], val[r]);
+        break;
+      }
+
+      push_insn(ir, IR_RET, types[i - 1], val[i - 1], 0);
+      i = end; // anything after the return is unreachable
+      break;
+    }
+    default: break;
+    }
+  }
+
+  blk.end = ir->len;
+  co_push(&ir->blocks, blk);
+
+  f.blk_end = ir->blocks.len;
+  co_push(&ir->funcs, f);
+}
+
+void lower(IR *restrict ir, const PTree *tree, uint32_t size,
+           const Resolution *res, const Typing *typing)
+{
+  PERF_BEGIN(perf);
+
+  uint32_t *val = malloc(size * sizeof(uint32_t));
+  assert((val || !size) && "failed to allocate value map");
+
+  for (uint32_t i = 0; i < size; ++i)
+  {
+    if (tree->kind[i] != FUN_END || typing->types[i] == TY_NONE) continue;
+
+    uint32_t start = i - tree->data[i];
+
+    PERF_BEGIN_FN(perf_fn);
+    lower_fn(ir, tree, start, i, res, typing->types, val);
+    PERF_END_FN(PERF_LOWER, perf_fn, sym_str(tree, start + 1));
+  }
+
+  free(val);
+
+  PERF_END(PERF_LOWER, perf);
+}
+
+#define IROpMacroName(V, S) [V] = S,
+
+static const char *ir_op_names[] = {IROpMacro(IROpMacroName)};
+
+void print_ir(const IR *ir)
+{
+  const IRFunc *funcs   = ir->funcs.buffer;
+  const IRBlock *blocks = ir->blocks.buffer;
+
+  for (const IRFunc *f = funcs; f < funcs + ir->funcs.len; ++f)
+  {
+    printf("fn %.*s/%u -> %s\n", f->name.len, f->name.txt, f->nparams,
+           inbuilt_name(f->ret));
+
+    for (uint32_t bl = f->blk_beg; bl < f->blk_end; ++bl)
+    {
+      printf("b%u:\n", bl);
+
+      for (uint32_t v = blocks[bl].beg; v < blocks[bl].end; ++v)
+      {
+        printf("  %%%u = %s %s", v, ir_op_names[ir->op[v]],
+               inbuilt_name(ir->ty[v]));
+
+        switch (ir->op[v])
+        {
+        case IR_PARAM: printf(" #%u\n", ir->a[v]); break;
+        case IR_CONST: printf(" %lu\n", ir_const(ir, v)); break;
+        default:
+          if (ir_nvals(ir->op[v]) == 2)
+            printf(" %%%u, %%%u\n", ir->a[v], ir->b[v]);
+          else if (ir_nvals(ir->op[v])) printf(" %%%u\n", ir->a[v]);
+          else printf("\n");
+          break;
+        }
+      }
+    }
+  }
+}
+
+void free_ir(IR ir)
+{
+  mem_free(MEM_IR, ir.op);
+  mem_free(MEM_IR, ir.ty);
+  mem_free(MEM_IR, ir.a);
+  mem_free(MEM_IR, ir.b);
+  free(ir.blocks.buffer);
+  free(ir.funcs.buffer);
+}
@@ -0,0 +1,92 @@
+#ifndef _IR_H
+#define _IR_H
+
+#include "check.h"
+
+#define IROpMacro(X)                                                           \
+  X(IR_NOP, "nop")       /* placeholder, produces no value */                 \
+  X(IR_PARAM, "param")   /* a = index of the parameter */                     \
+  X(IR_CONST, "const")   /* a, b = low and high half of the value */          \
+  X(IR_NEG, "neg")       /* a = operand */                                    \
+  X(IR_ADD, "add")       /* a, b = operands */                                \
+  X(IR_NEGC, "negc")     /* neg, trapping if the result overflows */          \
+  X(IR_ADDC, "addc")     /* add, trapping if the result overflows */          \
+  X(IR_NEGX, "negx")     /* neg that can't overflow, so needs no wrapping */  \
+  X(IR_ADDX, "addx")     /* add that can't overflow, so needs no wrapping */  \
+  X(IR_ASSERT, "assert") /* traps unless a < b, produces no value */          \
+  X(IR_ASSUME, "assume") /* a < b is known to hold, no value or code */       \
+  X(IR_RET, "ret")       /* a = returned value */
+
+#define IROpMacroDeclare(V, ...) V,
+
+typedef enum
+{
+  IROpMacro(IROpMacroDeclare)
+} IROp;
+
+typedef struct
+{
+  uint32_t beg, end; // instruction range
+} IRBlock;
+
+typedef struct
+{
+  StrView name;
+  uint32_t blk_beg, blk_end; // block range
+  uint32_t nparams;
+  TypeId ret;
+} IRFunc;
+
+/*
+ * SSA form in structure of arrays layout.
+ *
+ *  an instruction is identified by its index, which also names the value it
+ *  produces. operands always refer to earlier instructions, so every pass
+ *  can be a single forward sweep. an instruction takes 10 bytes.
+ */
+typedef struct
+{
+  uint8_t *op;    // IROp
+  TypeId *ty;     // type of the produced value
+  uint32_t *a;    // first operand
+  uint32_t *b;    // second operand
+  uint32_t len, cap;
+
+  DynamicArray blocks; // IRBlock
+  DynamicArray funcs;  // IRFunc
+} IR;
+
+// lowers every function that checked successfully and appends it to `ir`
+void lower(IR *restrict ir, const PTree *tree, uint32_t size,
+           const Resolution *res, const Typing *typing);
+
+uint32_t push_insn(IR *restrict ir, IROp op, TypeId ty, uint32_t a,
+                   uint32_t b);
+
+static inline uint64_t ir_const(const IR *ir, uint32_t v)
+{
+  return (uint64_t)ir->b[v] << 32 | ir->a[v];
+}
+
+// how many of `a` and `b`, in that order, name values
+static inline uint32_t ir_nvals(uint8_t op)
+{
+  switch (op)
+  {
+  case IR_NEG:
+  case IR_NEGC:
+  case IR_NEGX:
+  case IR_RET:    return 1;
+  case IR_ADD:
+  case IR_ADDC:
+  case IR_ADDX:
+  case IR_ASSERT:
+  case IR_ASSUME: return 2;
+  default:        return 0;
+  }
+}
+
+void print_ir(const IR *ir);
+void free_ir(IR ir);
+
+#endif // _IR_H
@@ -0,0 +1,72 @@
+/*
+ * Just in time compilation.
+ *
+ *  all functions are emitted into one buffer first, which is then copied
+ *  into freshly mapped pages that are flipped from writable to executable
+ *  once, so no page is ever writable and executable at the same time.
+ */
+
+#include "jit.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define NO_ENTRY UINT32_MAX
+
+Jit jit_compile(const IR *ir)
+{
+  Jit j = {.nfuncs = ir->funcs.len};
+
+  DynamicArray code = {};
+  uint32_t *offs    = malloc(ir->funcs.len * sizeof(uint32_t));
+  assert((offs || !ir->funcs.len) && "failed to allocate entry offsets");
+
+  const IRFunc *funcs = ir->funcs.buffer;
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+  {
+    // keep entry points 16 byte aligned
+    while (code.len & 0xf)
+    {
+      uint8_t int3 = 0xcc;
+      co_push(&code, int3);
+    }
+
+    uint32_t off = code.len;
+    offs[fn]     = emit_x64(&code, ir, funcs + fn) ? off : NO_ENTRY;
+  }
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  j.size      = (code.len + page - 1) & ~(page - 1);
+  j.entries   = calloc(ir->funcs.len, sizeof(JitFn));
+  assert((j.entries || !ir->funcs.len) && "failed to allocate entries");
+
+  if (j.size)
+  {
+    j.mem = mmap(NULL, j.size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(j.mem != MAP_FAILED && "failed to mmap JIT code");
+
+    memcpy(j.mem, code.buffer, code.len);
+
+    int err = mprotect(j.mem, j.size, PROT_READ | PROT_EXEC);
+    assert(!err && "failed to make JIT code executable");
+  }
+
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+  {
+    if (offs[fn] == NO_ENTRY) continue;
+
+    void *entry = j.mem + offs[fn];
+    memcpy(&j.entries[fn], &entry, sizeof(entry));
+  }
+
+  free(offs);
+  free(code.buffer);
+
+  return j;
+}
+
+void free_jit(Jit j)
+{
+  if (j.mem) munmap(j.mem, j.size);
+  free(j.entries);
+}
@@ -0,0 +1,23 @@
+#ifndef _JIT_H
+#define _JIT_H
+
+#include "x64.h"
+
+// every jitted function can be called through this, surplus arguments are
+// ignored. arguments are wrapped to the types of the parameters
+typedef uint64_t (*JitFn)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                          uint64_t);
+
+typedef struct
+{
+  uint8_t *mem;
+  size_t size;
+
+  JitFn *entries; // per IR function, NULL if it has to be interpreted
+  uint32_t nfuncs;
+} Jit;
+
+[[nodiscard]] Jit jit_compile(const IR *ir);
+void free_jit(Jit j);
+
+#endif // _JIT_H
@@ -0,0 +1,221 @@
+/*
+ * A JSON scanner, see json.h.
+ *
+ *  the messages come from an editor, so they are trusted to be well formed
+ *  as far as not reading out of bounds goes, but nothing more.
+ */
+
+#include "json.h"
+
+static const char *skip_ws(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    p++;
+  return p;
+}
+
+static const char *skip_str(const char *p, const char *end)
+{
+  for (p++; p < end && *p != '"'; ++p)
+    if (*p == '\\') p++;
+  return p < end ? p + 1 : end;
+}
+
+// past the value starting at `p`
+static const char *skip_value(const char *p, const char *end)
+{
+  if (p >= end) return end;
+  if (*p == '"') return skip_str(p, end);
+
+  if (*p != '{' && *p != '[')
+  {
+    while (p < end && !strchr(",}] \t\r\n", *p))
+      p++;
+    return p;
+  }
+
+  uint32_t depth = 0;
+  while (p < end)
+  {
+    if (*p == '"')
+    {
+      p = skip_str(p, end);
+      continue;
+    }
+
+    depth += *p == '{' || *p == '[';
+    depth -= *p == '}' || *p == ']';
+    p++;
+    if (!depth) break;
+  }
+  return p;
+}
+
+// the member `key` of the object `v`
+static StrView member(StrView v, const char *key, size_t klen)
+{
+  const char *p = v.txt, *end = v.txt + v.len;
+  if (!v.len || *p != '{') return (StrView){};
+
+  for (p = skip_ws(p + 1, end); p < end && *p == '"';)
+  {
+    const char *kend = skip_str(p, end);
+    bool hit = (size_t)(kend - p) == klen + 2 && !memcmp(p + 1, key, klen);
+
+    p = skip_ws(kend, end);
+    if (p < end && *p == ':') p = skip_ws(p + 1, end);
+
+    const char *vend = skip_value(p, end);
+    if (hit) return (StrView){.txt = p, .len = (uint32_t)(vend - p)};
+
+    p = skip_ws(vend, end);
+    if (p < end && *p == ',') p = skip_ws(p + 1, end);
+  }
+
+  return (StrView){};
+}
+
+StrView json_get(StrView v, const char *path)
+{
+  while (*path && v.len)
+  {
+    size_t klen = strcspn(path, ".");
+    v           = member(v, path, klen);
+    path += klen + !!path[klen];
+  }
+  return v;
+}
+
+StrView json_index(StrView v, uint32_t i)
+{
+  const char *p = v.txt, *end = v.txt + v.len;
+  if (!v.len || *p != '[') return (StrView){};
+
+  for (p = skip_ws(p + 1, end); p < end && *p != ']'; --i)
+  {
+    const char *vend = skip_value(p, end);
+    if (!i) return (StrView){.txt = p, .len = (uint32_t)(vend - p)};
+
+    p = skip_ws(vend, end);
+    if (p < end && *p == ',') p = skip_ws(p + 1, end);
+  }
+
+  return (StrView){};
+}
+
+uint64_t json_uint(StrView v)
+{
+  uint64_t n = 0;
+  for (uint32_t i = 0; i < v.len && v.txt[i] >= '0' && v.txt[i] <= '9'; ++i)
+    n = n * 10 + (uint64_t)(v.txt[i] - '0');
+  return n;
+}
+
+bool json_is(StrView v, const char *str)
+{
+  size_t len = strlen(str);
+  return v.len == len + 2 && v.txt[0] == '"' && !memcmp(v.txt + 1, str, len);
+}
+
+static uint32_t hex4(const char *p)
+{
+  char hex[5] = {p[0], p[1], p[2], p[3], 0};
+  return (uint32_t)strtoul(hex, NULL, 16);
+}
+
+static void put_utf8(DynamicArray *restrict out, uint32_t cp)
+{
+  char buf[4];
+  uint32_t n = 0;
+
+  if (cp < 0x80) buf[n++] = (char)cp;
+  else if (cp < 0x800)
+  {
+    buf[n++] = (char)(0xc0 | cp >> 6);
+    buf[n++] = (char)(0x80 | (cp & 0x3f));
+  }
+  else if (cp < 0x10000)
+  {
+    buf[n++] = (char)(0xe0 | cp >> 12);
+    buf[n++] = (char)(0x80 | (cp >> 6 & 0x3f));
+    buf[n++] = (char)(0x80 | (cp & 0x3f));
+  }
+  else
+  {
+    buf[n++] = (char)(0xf0 | cp >> 18);
+    buf[n++] = (char)(0x80 | (cp >> 12 & 0x3f));
+    buf[n++] = (char)(0x80 | (cp >> 6 & 0x3f));
+    buf[n++] = (char)(0x80 | (cp & 0x3f));
+  }
+
+  co_append(out, buf, n);
+}
+
+void json_unescape(DynamicArray *restrict out, StrView v)
+{
+  if (v.len < 2 || v.txt[0] != '"') return;
+
+  const char *p = v.txt + 1, *end = v.txt + v.len - 1;
+  while (p < end)
+  {
+    // plain runs are copied in one go, they are most of any document
+    const char *run = p;
+    while (p < end && *p != '\\')
+      p++;
+    if (p > run) co_append(out, run, (size_t)(p - run));
+    if (p + 1 >= end) break;
+
+    char c = p[1];
+    p += 2;
+    switch (c)
+    {
+    case 'n': c = '\n'; break;
+    case 't': c = '\t'; break;
+    case 'r': c = '\r'; break;
+    case 'b': c = '\b'; break;
+    case 'f': c = '\f'; break;
+    case 'u':
+    {
+      if (end - p < 4) return;
+      uint32_t cp = hex4(p);
+      p += 4;
+
+      // a surrogate pair, for anything past the basic plane
+      if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' &&
+          p[1] == 'u')
+      {
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (hex4(p + 2) - 0xdc00);
+        p += 6;
+      }
+      put_utf8(out, cp);
+      continue;
+    }
+    default: break; // `"`, `\` and `/` stand for themselves
+    }
+    co_push(out, c);
+  }
+}
+
+void json_escape(DynamicArray *restrict out, StrView str)
+{
+  co_append(out, "\"", 1);
+
+  const char *p = str.txt, *end = str.txt + str.len;
+  while (p < end)
+  {
+    const char *run = p;
+    while (p < end && *p != '"' && *p != '\\' && (uint8_t)*p >= 0x20)
+      p++;
+    if (p > run) co_append(out, run, (size_t)(p - run));
+    if (p == end) break;
+
+    char esc[8];
+    int n = (uint8_t)*p >= 0x20
+                ? snprintf(esc, sizeof(esc), "\\%c", *p)
+                : snprintf(esc, sizeof(esc), "\\u%04x", (unsigned)*p);
+    co_append(out, esc, (size_t)n);
+    p++;
+  }
+
+  co_append(out, "\"", 1);
+}
@@ -0,0 +1,32 @@
+#ifndef _JSON_H
+#define _JSON_H
+
+#include "common.h"
+
+/*
+ * Just enough JSON for JSON-RPC.
+ *
+ *  nothing is parsed into a tree, a value is the span of the message it
+ *  covers and lookups skip over everything they don't descend into. a
+ *  missing value is the empty view.
+ */
+
+// the value at `path` in `v`, object keys separated by dots
+[[nodiscard]] StrView json_get(StrView v, const char *path);
+
+// the element `i` of the array `v`
+[[nodiscard]] StrView json_index(StrView v, uint32_t i);
+
+// a number, 0 for anything else
+[[nodiscard]] uint64_t json_uint(StrView v);
+
+// is `v` the string `str`, which must not need escapes
+[[nodiscard]] bool json_is(StrView v, const char *str);
+
+// appends the contents of the string `v` to `out`, without the escapes
+void json_unescape(DynamicArray *restrict out, StrView v);
+
+// appends `str` to `out` as a JSON string
+void json_escape(DynamicArray *restrict out, StrView str);
+
+#endif // _JSON_H
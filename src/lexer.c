@@ -1,12 +1,13 @@
 #include "lexer.h"
 #include "common.h"
+#include "perf.h"
 #include <ctype.h>
 #include <stdbit.h>
 #include <stdint.h>
 #include <string.h>
 #include <xmmintrin.h>
 
-#define MAX_INTERN_LEN 0xff
+#define MAX_INTERN_LEN ((1u << 24) - 1) // what fits over the tag
 
 typedef struct
 {
@@ -15,6 +16,10 @@ typedef struct
   DynamicArray tokens;
 
   DynamicArray lits;
+
+  // open addressed, from a value in `lits` to its index + 1, 0 when empty
+  uint32_t *lit_map;
+  uint32_t lit_cap;
 } LexBuf;
 
 static void intern_char(LexBuf *restrict lexbuf, char c)
@@ -22,10 +27,7 @@ static void intern_char(LexBuf *restrict lexbuf, char c)
   co_push(&lexbuf->intern, c);
 }
 
-static uint16_t intern_mark(LexBuf lexbuf)
-{
-  return (uint16_t)lexbuf.intern.len;
-}
+static uint32_t intern_mark(LexBuf lexbuf) { return lexbuf.intern.len; }
 
 static Intern intern_strview(LexBuf *restrict lexbuf, StrView s)
 {
@@ -35,8 +37,7 @@ static Intern intern_strview(LexBuf *restrict lexbuf, StrView s)
   if (lexbuf->intern.len > lexbuf->intern.cap)
     grow_array(&lexbuf->intern, sizeof(char));
 
-  Intern i = {.idx = (uint16_t)(lexbuf->intern.len - len),
-              .len = (uint16_t)(s.len << 8)};
+  Intern i = {.idx = lexbuf->intern.len - len, .len = len << 8};
 
   memcpy(lexbuf->intern.buffer + lexbuf->intern.len - len, s.txt,
          len * sizeof(char));
@@ -44,21 +45,79 @@ static Intern intern_strview(LexBuf *restrict lexbuf, StrView s)
   return i;
 }
 
-static uint32_t push_lit(LexBuf *restrict lexbuf, uint64_t val)
+static uint32_t lit_slot(uint64_t val, uint32_t mask)
+{
+  return (uint32_t)((val * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+}
+
+static void grow_lit_map(LexBuf *restrict lexbuf)
+{
+  uint32_t cap = lexbuf->lit_cap ? lexbuf->lit_cap * 2 : 64, mask = cap - 1;
+  uint32_t *map = calloc(cap, sizeof(uint32_t));
+  assert(map && "failed to allocate literal map");
+
+  const uint64_t *lits = lexbuf->lits.buffer;
+  for (uint32_t i = 0; i < lexbuf->lits.len; ++i)
+  {
+    uint32_t s = lit_slot(lits[i], mask);
+    while (map[s])
+      s = (s + 1) & mask;
+    map[s] = i + 1;
+  }
+
+  mem_grow(MEM_LITS, lexbuf->lit_cap * sizeof(uint32_t),
+           cap * sizeof(uint32_t), 0);
+  free(lexbuf->lit_map);
+  lexbuf->lit_map = map;
+  lexbuf->lit_cap = cap;
+}
+
+// the payload of an integer token, see TOK_LIT_INLINE, false if there is
+// no index left for another large literal
+static bool push_lit(LexBuf *restrict lexbuf, uint64_t val,
+                     uint32_t *payload)
 {
-  return co_push(&lexbuf->lits, val);
+  if (val <= TOK_LIT_INLINE_MAX)
+  {
+    *payload = (uint32_t)val << 9 | TOK_LIT_INLINE;
+    return true;
+  }
+
+  // kept at most half full
+  if (lexbuf->lits.len * 2 >= lexbuf->lit_cap) grow_lit_map(lexbuf);
+
+  const uint64_t *lits = lexbuf->lits.buffer;
+  uint32_t mask        = lexbuf->lit_cap - 1;
+  uint32_t s           = lit_slot(val, mask);
+  for (; lexbuf->lit_map[s]; s = (s + 1) & mask)
+    if (lits[lexbuf->lit_map[s] - 1] == val)
+    {
+      *payload = (lexbuf->lit_map[s] - 1) << 9;
+      return true;
+    }
+
+  if (lexbuf->lits.len > TOK_LIT_INLINE_MAX) return false;
+
+  uint32_t idx       = co_push(&lexbuf->lits, val);
+  lexbuf->lit_map[s] = idx + 1;
+  *payload           = idx << 9;
+  return true;
 }
 
+// the hottest push of all, stored directly rather than copied through
+// push_elem by a size only known at run time
 static void push_token(LexBuf *restrict lexbuf, Token tok)
 {
-  co_push(&lexbuf->tokens, tok);
+  DynamicArray *tokens = &lexbuf->tokens;
+  if (++tokens->len >= tokens->cap) grow_array(tokens, sizeof(Token));
+  ((Token *)tokens->buffer)[tokens->len - 1] = tok;
 }
 
 void destroy_lexres(LexRes lex_res)
 {
-  free(lex_res.intern);
-  free(lex_res.tokens);
-  free(lex_res.lits);
+  mem_free(MEM_LEX_INTERN, lex_res.intern);
+  mem_free(MEM_TOKENS, lex_res.tokens);
+  mem_free(MEM_LITS, lex_res.lits);
 }
 
 static bool consume_ws(Lexer *restrict l)
@@ -197,6 +256,8 @@ static TokTag hash_kw(const char *s, uint32_t len)
 //       because it's extremely easy to extend
 static TokTag hash_kw(const char *s, uint32_t len)
 {
+  if (len > 6) return TOK_VAL_ID; // no keyword is longer than `return`
+
   __mmask16 mask = (uint8_t)(1u << len) - 1u;
   // keyword candidate
   int64_t kw_can = _mm_maskz_loadu_epi8(mask, s)[0];
@@ -277,7 +338,11 @@ typedef struct ScopeStacks
 // TODO: actually take the effort to optimize this
 [[nodiscard]] LexRes lex(Lexer l)
 {
-  LexBuf res_buf     = {};
+  PERF_BEGIN(perf);
+
+  LexBuf res_buf     = {.intern.mem = MEM_LEX_INTERN,
+                        .tokens.mem = MEM_TOKENS,
+                        .lits.mem   = MEM_LITS};
   ScopeStacks scopes = {};
 
   while (l.cur < l.end)
@@ -308,11 +373,11 @@ typedef struct ScopeStacks
       //       will evoke ub when there is a number right
       //       before eof and `l.source` isn't null terminated
       uint64_t num   = (uint64_t)strtoll(start, &l.cur, 0);
-      printf("num = %lu\n", num);
-      uint32_t idx   = push_lit(&res_buf, num);
-      tok.pos        = (uint32_t)(l.src - l.cur);
-      tok.as_lit_idx = idx << 8;
-      tok.tag |= TOK_LIT_INT;
+      tok.pos = (uint32_t)(start - l.src);
+
+      // past the last index the literal is INVALID, and the parse stops
+      // there
+      if (push_lit(&res_buf, num, &tok.as_lit_idx)) tok.tag |= TOK_LIT_INT;
     }
     else if (islower(char_at))
     {
@@ -333,7 +398,7 @@ typedef struct ScopeStacks
       }
 
       tok.tag |= kind;
-      tok.pos = (uint32_t)(l.src - start);
+      tok.pos = (uint32_t)(start - l.src);
     }
     else if (isupper(char_at))
     {
@@ -344,14 +409,14 @@ typedef struct ScopeStacks
 
       StrView s     = {.txt = start, .len = (uint32_t)(l.cur - start)};
       Intern i      = intern_strview(&res_buf, s);
-      tok.pos       = (uint32_t)(l.src - start);
+      tok.pos       = (uint32_t)(start - l.src);
       tok.as_intern = i;
       tok.tag |= TOK_TYPE_ID;
     }
     else if (char_at == '"')
     {
       char *start   = ++l.cur; // skip first quote
-      uint16_t mark = intern_mark(res_buf);
+      uint32_t mark = intern_mark(res_buf);
 
       bool escaped = false;
       while (l.cur < l.end && !(*l.cur == '"' && !escaped))
@@ -367,14 +432,13 @@ typedef struct ScopeStacks
         escaped = *l.cur == '\\';
         l.cur++;
       }
-      Intern i = {.idx = mark,
-                  .len = (uint16_t)((uint16_t)(l.cur - start) << 8u)};
+      Intern i = {.idx = mark, .len = (uint32_t)(l.cur - start) << 8};
       l.cur++; // skip closing quote
-      tok.pos       = (uint32_t)(l.src - start);
+      tok.pos       = (uint32_t)(start - l.src);
       tok.as_intern = i;
-      tok.tag |= TOK_LIT_INT;
+      tok.tag |= TOK_LIT_STR;
     }
-    else if (strchr("({[", char_at))
+    else if (char_at && strchr("({[", char_at)) // strchr finds the NUL too
     {
 
       uint8_t hash = (uint8_t)((char_at & 0xf) + (char_at >> 4));
@@ -386,10 +450,10 @@ typedef struct ScopeStacks
         goto next_token; // scope exceeded max depth,
                          // so this token is INVALID
       scopes.stacks[hash][cursor] = res_buf.tokens.len;
-      tok.pos                     = (uint32_t)(l.src - l.cur++);
+      tok.pos                     = (uint32_t)(l.cur++ - l.src);
       tok.tag                     = (uint32_t)char_at;
     }
-    else if (strchr(")}]", char_at))
+    else if (char_at && strchr(")}]", char_at))
     {
 
       uint8_t hash = (uint8_t)((char_at & 0xf) + (char_at >> 4));
@@ -415,14 +479,14 @@ typedef struct ScopeStacks
       ((Token *)res_buf.tokens.buffer)[opening_delim].matching_scp |=
           (int32_t)((res_buf.tokens.len - opening_delim) << 8);
 
-      tok.pos = (uint32_t)(l.src - l.cur - 1);
+      tok.pos = (uint32_t)(l.cur - 1 - l.src);
       tok.tag = (uint32_t)char_at;
       tok.matching_scp |= (int32_t)((opening_delim - res_buf.tokens.len) << 8);
     }
     else if (ispunct(char_at))
     {
     punct:
-      tok.pos = (uint32_t)(l.src - l.cur++);
+      tok.pos = (uint32_t)(l.cur++ - l.src);
       if (char_at == '-')
       {
         if (*l.cur == '>')
@@ -450,10 +514,17 @@ typedef struct ScopeStacks
   }
 
   LexRes res;
-  res.intern = res_buf.intern.buffer;
-  res.tokens = res_buf.tokens.buffer;
-  res.tkeptr = res_buf.tokens.buffer + res_buf.tokens.len * sizeof(Token);
-  res.lits   = res_buf.lits.buffer;
+  res.intern  = res_buf.intern.buffer;
+  res.tokens  = res_buf.tokens.buffer;
+  res.tkeptr  = res_buf.tokens.buffer + res_buf.tokens.len * sizeof(Token);
+  res.lits    = res_buf.lits.buffer;
+  res.nlits   = res_buf.lits.len;
+  res.nintern = res_buf.intern.len;
+
+  mem_release(MEM_LITS, res_buf.lit_cap * sizeof(uint32_t));
+  free(res_buf.lit_map);
+
+  PERF_END(PERF_LEX, perf);
 
   return res;
 }
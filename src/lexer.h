@@ -12,9 +12,8 @@ typedef struct Lexer
 
 typedef struct Intern
 {
-  // TODO: think of a distribution of bits
-  uint16_t len;
-  uint16_t idx;
+  uint32_t len; // the length over the 8 bits of the token's tag
+  uint32_t idx; // offset into LexRes.intern
 } Intern;
 
 typedef enum
@@ -70,6 +69,13 @@ typedef enum
   TOK_KW_RETRN = 0xb0,
 } TokTag;
 
+// an integer token holds its value in the 24 bits of payload over the tag
+// when it fits, with TOK_LIT_INLINE set. a larger value goes into `lits`,
+// once for every distinct value, and the payload holds its index. a large
+// literal past the last index is lexed as TOK_INVALID
+#define TOK_LIT_INLINE 0x100u
+#define TOK_LIT_INLINE_MAX ((1u << 23) - 1)
+
 typedef struct Token
 {
   uint32_t pos;
@@ -80,7 +86,7 @@ typedef struct Token
     int32_t matching_scp;
     Intern as_intern;
   };
-} __attribute__((aligned(8))) Token;
+} Token;
 
 typedef struct
 {
@@ -88,8 +94,17 @@ typedef struct
   Token *tokens;
   uint64_t *lits;
   Token *tkeptr;
+  uint32_t nlits;
+  uint32_t nintern; // bytes in `intern`
 } LexRes;
 
+// the value of an integer token
+static inline uint64_t tok_lit(const LexRes *lr, Token t)
+{
+  return t.as_lit_idx & TOK_LIT_INLINE ? t.as_lit_idx >> 9
+                                       : lr->lits[t.as_lit_idx >> 9];
+}
+
 void destroy_lexres(LexRes lex_res);
 [[nodiscard]] LexRes lex(Lexer l);
 
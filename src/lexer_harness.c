@@ -36,7 +36,7 @@ int main()
     if (!len)
       continue;
 
-    Lexer l = {.src = (char *)buf, .cur = (char *)buf, .end = (char *)(buf + len - 1)};
+    Lexer l = {.src = (char *)buf, .cur = (char *)buf, .end = (char *)(buf + len)};
 
     LexRes res = lex(l);
 
@@ -0,0 +1,119 @@
+/*
+ * Lazy line index, see lines.h.
+ *
+ *  the newlines of a whole vector are found with one compare and a mask,
+ *  then taken out of the mask lowest bit first. the array of line starts is
+ *  sized by the density of the first chunk, so a typical file grows it
+ *  once or twice at most.
+ */
+
+#include "lines.h"
+#include <immintrin.h>
+
+Lines lines_of(const char *path, const char *src, uint32_t len)
+{
+  return (Lines){.path = path, .src = src, .len = len};
+}
+
+#if defined(__AVX512BW__)
+
+#define VEC 64
+
+static uint64_t newlines(const char *p)
+{
+  __m512i v = _mm512_loadu_si512(p);
+  return _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8('\n'));
+}
+
+#elif defined(__AVX2__)
+
+#define VEC 32
+
+static uint64_t newlines(const char *p)
+{
+  __m256i v = _mm256_loadu_si256((const __m256i *)p);
+  __m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+  return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+#else
+
+#define VEC 16
+
+static uint64_t newlines(const char *p)
+{
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+  return (uint32_t)_mm_movemask_epi8(m);
+}
+
+#endif
+
+static void build(Lines *restrict lines)
+{
+  const char *src = lines->src;
+  uint32_t len    = lines->len, i = 0;
+
+  // a guess from the first few KiB saves most of the regrowing
+  uint32_t sample = MIN(len, 4096u), in_sample = 0;
+  for (uint32_t j = 0; j < sample; ++j)
+    in_sample += src[j] == '\n';
+  if (in_sample)
+  {
+    uint64_t guess = (uint64_t)in_sample * len / sample + 16;
+    lines->starts.buffer = malloc(guess * sizeof(uint32_t));
+    assert(lines->starts.buffer && "failed to allocate line index");
+    lines->starts.cap = (uint32_t)guess;
+  }
+
+  for (; i + VEC <= len; i += VEC)
+    for (uint64_t m = newlines(src + i); m; m &= m - 1)
+    {
+      uint32_t start = i + stdc_trailing_zeros_ull(m) + 1;
+      co_push(&lines->starts, start);
+    }
+
+  for (; i < len; ++i)
+  {
+    uint32_t start = i + 1;
+    if (src[i] == '\n') co_push(&lines->starts, start);
+  }
+
+  lines->built = true;
+}
+
+LineCol line_col(Lines *restrict lines, uint32_t off)
+{
+  if (!lines->built) build(lines);
+
+  // the number of lines starting at or before `off`, after the first
+  const uint32_t *starts = lines->starts.buffer;
+  uint32_t lo = 0, hi = lines->starts.len;
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (starts[mid] <= off) lo = mid + 1;
+    else hi = mid;
+  }
+
+  uint32_t start = lo ? starts[lo - 1] : 0;
+  return (LineCol){.line = lo + 1, .col = off - start + 1};
+}
+
+uint32_t line_start(Lines *restrict lines, uint32_t line)
+{
+  if (!lines->built) build(lines);
+
+  if (line <= 1) return 0;
+  if (line - 2 >= lines->starts.len) return lines->len;
+
+  return ((uint32_t *)lines->starts.buffer)[line - 2];
+}
+
+void print_pos(FILE *f, Lines *restrict lines, uint32_t off)
+{
+  LineCol lc = line_col(lines, off);
+  fprintf(f, "%s:%u:%u", lines->path, lc.line, lc.col);
+}
+
+void free_lines(Lines lines) { free(lines.starts.buffer); }
@@ -0,0 +1,40 @@
+#ifndef _LINES_H
+#define _LINES_H
+
+#include "common.h"
+
+/*
+ * Maps byte offsets into a source to lines and columns.
+ *
+ *  the index of where lines start is only built by the first lookup, in
+ *  one vectorized pass over the source, so a file without diagnostics
+ *  never pays for it. lookups are a binary search over the line starts.
+ */
+typedef struct
+{
+  const char *path, *src;
+  uint32_t len;
+  bool built;
+  DynamicArray starts; // uint32_t, the offset of every line after the first
+} Lines;
+
+typedef struct
+{
+  uint32_t line, col; // both counted from 1, columns in bytes
+} LineCol;
+
+// the source must outlive the index, nothing is done until a lookup
+[[nodiscard]] Lines lines_of(const char *path, const char *src, uint32_t len);
+
+[[nodiscard]] LineCol line_col(Lines *restrict lines, uint32_t off);
+
+// the offset `line` (counted from 1) starts at, the length of the source for
+// lines past the last
+[[nodiscard]] uint32_t line_start(Lines *restrict lines, uint32_t line);
+
+// prints `path:line:col` for `off`
+void print_pos(FILE *f, Lines *restrict lines, uint32_t off);
+
+void free_lines(Lines lines);
+
+#endif // _LINES_H
@@ -0,0 +1,177 @@
+/*
+ * Liveness and dead code elimination, see live.h.
+ *
+ *  the IR has no branches yet, so the only successor of a block is the one
+ *  after it and the last block of a function returns. the solver iterates
+ *  over the blocks backwards until nothing changes anyway, so it stays
+ *  correct once blocks get other successors. with fall through only it is
+ *  done after one sweep and one to check.
+ *
+ *  the transfer of a block is a backwards sweep over it: an instruction
+ *  that returns, takes a parameter, may trap or whose value is live makes
+ *  its operands live, and its own value is dead above it.
+ */
+
+#include "live.h"
+#include "perf.h"
+
+// instructions that stay whether their value is used or not. a checked
+// operation may trap, so it stays unless ranges relaxed it into an exact one
+static bool is_root(uint8_t op)
+{
+  return op == IR_RET || op == IR_PARAM || op == IR_ASSERT || op == IR_NEGC ||
+         op == IR_ADDC;
+}
+
+static void use_operands(const IR *ir, uint32_t base, uint32_t v,
+                         uint64_t *restrict set)
+{
+  uint32_t n = ir_nvals(ir->op[v]);
+  if (n > 0) bit_set(set, ir->a[v] - base);
+  if (n > 1) bit_set(set, ir->b[v] - base);
+}
+
+// turns the values live below `b` into those live above it, in place. every
+// instruction that stays gets its bit set in `keep`, if given
+static void transfer(const IR *ir, const IRBlock *b, uint32_t base,
+                     uint64_t *restrict set, uint64_t *restrict keep)
+{
+  for (uint32_t v = b->end; v-- > b->beg;)
+  {
+    uint32_t i = v - base;
+    if (!is_root(ir->op[v]) && !bit_get(set, i)) continue;
+
+    if (keep) bit_set(keep, i);
+    bit_clear(set, i);
+    use_operands(ir, base, v, set);
+  }
+}
+
+void live_func(Liveness *restrict l, const IR *ir, const IRFunc *f)
+{
+  const IRBlock *blocks = ir->blocks.buffer;
+
+  l->nblocks = f->blk_end - f->blk_beg;
+  l->base    = l->nblocks ? blocks[f->blk_beg].beg : 0;
+  uint32_t n = l->nblocks ? blocks[f->blk_end - 1].end - l->base : 0;
+  l->words   = (n + 63) / 64;
+
+  // `in` has a row more than there are blocks, to compute a block into
+  uint32_t words = l->words, need = (l->nblocks + 1) * words;
+  if (need > l->cap)
+  {
+    free(l->in);
+    free(l->out);
+    l->in  = malloc(need * sizeof(uint64_t));
+    l->out = malloc(need * sizeof(uint64_t));
+    l->cap = need;
+    assert(l->in && l->out && "failed to allocate liveness sets");
+  }
+  if (!words) return;
+
+  memset(l->in, 0, need * sizeof(uint64_t));
+  memset(l->out, 0, need * sizeof(uint64_t));
+
+  uint64_t *tmp = l->in + l->nblocks * words;
+  for (bool changed = true; changed;)
+  {
+    changed = false;
+    for (uint32_t b = l->nblocks; b-- > 0;)
+    {
+      uint64_t *in = l->in + b * words, *out = l->out + b * words;
+
+      // the union over the successors, which is just the next block
+      if (b + 1 < l->nblocks)
+        for (uint32_t w = 0; w < words; ++w)
+          out[w] |= l->in[(b + 1) * words + w];
+
+      memcpy(tmp, out, words * sizeof(uint64_t));
+      transfer(ir, blocks + f->blk_beg + b, l->base, tmp, NULL);
+
+      uint64_t diff = 0;
+      for (uint32_t w = 0; w < words; ++w)
+        diff |= tmp[w] ^ in[w];
+      if (!diff) continue;
+
+      memcpy(in, tmp, words * sizeof(uint64_t));
+      changed = true;
+    }
+  }
+}
+
+void free_liveness(Liveness l)
+{
+  free(l.in);
+  free(l.out);
+}
+
+uint32_t eliminate_dead(IR *restrict ir)
+{
+  PERF_BEGIN(perf);
+
+  uint32_t len  = ir->len;
+  uint32_t *map = malloc(len * sizeof(uint32_t) + 1);
+  assert(map && "failed to allocate value map");
+
+  Liveness l      = {};
+  uint64_t *keep  = NULL;
+  uint32_t kcap   = 0;
+  IRFunc *funcs   = ir->funcs.buffer;
+  IRBlock *blocks = ir->blocks.buffer;
+
+  uint32_t w = 0; // where the next surviving instruction goes
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+  {
+    live_func(&l, ir, funcs + fn);
+    if (l.words > kcap)
+    {
+      free(keep);
+      keep = malloc(l.words * sizeof(uint64_t));
+      kcap = l.words;
+      assert(keep && "failed to allocate liveness sets");
+    }
+    if (l.words) memset(keep, 0, l.words * sizeof(uint64_t));
+
+    // which instructions stay has to be known for the whole function before
+    // it is compacted over itself
+    uint64_t *tmp = l.in + l.nblocks * l.words;
+    for (uint32_t b = 0; l.words && b < l.nblocks; ++b)
+    {
+      memcpy(tmp, l.out + b * l.words, l.words * sizeof(uint64_t));
+      transfer(ir, blocks + funcs[fn].blk_beg + b, l.base, tmp, keep);
+    }
+
+    for (uint32_t bl = funcs[fn].blk_beg; bl < funcs[fn].blk_end; ++bl)
+    {
+      uint32_t beg = w;
+
+      for (uint32_t v = blocks[bl].beg; v < blocks[bl].end; ++v)
+      {
+        if (!bit_get(keep, v - l.base)) continue;
+
+        uint8_t op = ir->op[v];
+        uint32_t a = ir->a[v], b = ir->b[v], n = ir_nvals(op);
+        if (n > 0) a = map[a];
+        if (n > 1) b = map[b];
+
+        ir->op[w] = op;
+        ir->ty[w] = ir->ty[v];
+        ir->a[w]  = a;
+        ir->b[w]  = b;
+        map[v]    = w++;
+      }
+
+      blocks[bl] = (IRBlock){.beg = beg, .end = w};
+    }
+  }
+
+  ir->len = w;
+
+  free(map);
+  free(keep);
+  free_liveness(l);
+
+  PERF_END(PERF_DCE, perf);
+
+  return len - w;
+}
@@ -0,0 +1,49 @@
+#ifndef _LIVE_H
+#define _LIVE_H
+
+#include "ir.h"
+
+/*
+ * Liveness of the values of a function and removal of the dead ones.
+ *
+ *  sets of values are dense bitsets, bit `v - base` for value `v` of a
+ *  function starting at `base`, so the transfer of a block and the meet of
+ *  its successors are loops over 64 bit words. a value counts as live only
+ *  if a live instruction uses it, so a chain of values that only feed each
+ *  other and never reach a return is dead as a whole.
+ */
+
+typedef struct
+{
+  uint64_t *in, *out; // per block of the function, `words` words each
+  uint32_t words, nblocks;
+  uint32_t base; // the first value of the function
+  uint32_t cap;  // words allocated for `in` and `out` each
+} Liveness;
+
+static inline bool bit_get(const uint64_t *set, uint32_t i)
+{
+  return set[i / 64] >> (i % 64) & 1;
+}
+
+static inline void bit_set(uint64_t *set, uint32_t i)
+{
+  set[i / 64] |= 1ull << (i % 64);
+}
+
+static inline void bit_clear(uint64_t *set, uint32_t i)
+{
+  set[i / 64] &= ~(1ull << (i % 64));
+}
+
+// computes the live in and live out sets of the blocks of `f`, reusing the
+// buffers of `l`
+void live_func(Liveness *restrict l, const IR *ir, const IRFunc *f);
+void free_liveness(Liveness l);
+
+// removes every instruction whose value isn't live where it is defined,
+// other than parameters, returns, assertions and checked operations,
+// compacting the IR in place. returns the number of removed instructions
+uint32_t eliminate_dead(IR *restrict ir);
+
+#endif // _LIVE_H
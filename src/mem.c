@@ -0,0 +1,98 @@
+/*
+ * Memory accounting per subsystem, see mem.h.
+ *
+ *  the counters are updated atomically, since the parses of different files
+ *  run on different threads, but only when a buffer grows or is freed, so
+ *  a push that fits costs nothing extra.
+ */
+
+#include "mem.h"
+#include "common.h"
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct
+{
+  _Atomic uint64_t cur, peak, grows, copied;
+} MemCounters;
+
+#define MemSysMacroName(V, S) [V] = S,
+
+static const char *sys_names[] = {MemSysMacro(MemSysMacroName)};
+
+static MemCounters counters[MEM_SYSTEMS];
+static MemCounters total;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void report(void);
+
+static void setup(void)
+{
+  if (getenv("FUNLANG_MEM")) (void)atexit(report);
+}
+
+static void raise_peak(_Atomic uint64_t *peak, uint64_t cur)
+{
+  uint64_t seen = atomic_load_explicit(peak, memory_order_relaxed);
+  while (seen < cur && !atomic_compare_exchange_weak(peak, &seen, cur))
+    ;
+}
+
+static void charge(MemCounters *c, size_t old, size_t new, size_t copied)
+{
+  uint64_t cur = atomic_fetch_add_explicit(&c->cur, new - old,
+                                           memory_order_relaxed) +
+                 (new - old);
+  raise_peak(&c->peak, cur);
+
+  if (!old) return; // a first allocation isn't growth
+  atomic_fetch_add_explicit(&c->grows, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&c->copied, copied, memory_order_relaxed);
+}
+
+void mem_grow(MemSys sys, size_t old, size_t new, size_t copied)
+{
+  if (sys == MEM_NONE) return;
+  (void)pthread_once(&once, setup);
+
+  // unsigned wrap around makes a shrink subtract
+  charge(counters + sys, old, new, copied);
+  charge(&total, old, new, copied);
+}
+
+void mem_release(MemSys sys, size_t size)
+{
+  if (sys == MEM_NONE || !size) return;
+
+  atomic_fetch_sub_explicit(&counters[sys].cur, size, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&total.cur, size, memory_order_relaxed);
+}
+
+size_t mem_size(const void *p) { return p ? malloc_usable_size((void *)p) : 0; }
+
+void mem_free(MemSys sys, void *p)
+{
+  mem_release(sys, mem_size(p));
+  free(p);
+}
+
+static void print_row(const char *name, const MemCounters *c)
+{
+  fprintf(stderr, "%-14s %14lu %14lu %10lu %14lu\n", name,
+          atomic_load(&c->cur), atomic_load(&c->peak), atomic_load(&c->grows),
+          atomic_load(&c->copied));
+}
+
+static void report(void)
+{
+  fprintf(stderr, "%-14s %14s %14s %10s %14s\n", "memory", "current",
+          "peak", "grows", "copied");
+
+  for (MemSys s = MEM_NONE + 1; s < MEM_SYSTEMS; ++s)
+    if (atomic_load(&counters[s].peak)) print_row(sys_names[s], counters + s);
+
+  // the peaks of the parts may have been at different times
+  print_row("total", &total);
+}
@@ -0,0 +1,48 @@
+#ifndef _MEM_H
+#define _MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Accounting of the memory held by the big buffers of the compiler.
+ *
+ *  every buffer is charged to a subsystem, which keeps how much it holds
+ *  now and at most, how often it grew and how many bytes growing copied.
+ *  arrays are charged through the `mem` tag of their DynamicArray, sizes
+ *  are what the allocator actually handed out. with FUNLANG_MEM set a
+ *  report is printed to stderr at exit.
+ */
+
+#define MemSysMacro(X)                                                         \
+  X(MEM_NONE, "untracked")                                                     \
+  X(MEM_TOKENS, "tokens")                                                      \
+  X(MEM_LITS, "literals")                                                      \
+  X(MEM_LEX_INTERN, "lexer intern")                                            \
+  X(MEM_PSTACK, "parse stack")                                                 \
+  X(MEM_TREE, "tree")                                                          \
+  X(MEM_HSET, "hset entries")                                                  \
+  X(MEM_NAMES, "hset names")                                                   \
+  X(MEM_IR, "ir")
+
+#define MemSysMacroDeclare(V, ...) V,
+
+typedef enum
+{
+  MemSysMacro(MemSysMacroDeclare) MEM_SYSTEMS
+} MemSys;
+
+// `sys` went from holding `old` to `new` bytes in one buffer, and `copied`
+// bytes were moved to get there
+void mem_grow(MemSys sys, size_t old, size_t new, size_t copied);
+
+// `sys` gave back `size` bytes
+void mem_release(MemSys sys, size_t size);
+
+// the usable size of the malloc'd `p`, 0 for NULL
+[[nodiscard]] size_t mem_size(const void *p);
+
+// frees the malloc'd `p`, releasing it from `sys`
+void mem_free(MemSys sys, void *p);
+
+#endif // _MEM_H
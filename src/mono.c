@@ -0,0 +1,213 @@
+/*
+ * Monomorphization of functions with implicit type arguments.
+ *
+ *  a function is the contiguous node slice [end - subtree_sz, end], so an
+ *  instance is produced by copying that slice (minus the implicit argument
+ *  list) and rewriting the uses of the implicit arguments into the concrete
+ *  types, without ever walking the tree recursively.
+ */
+
+#include "mono.h"
+#include "hashtable.h"
+#include <sys/mman.h>
+
+typedef struct
+{
+  uint32_t beg, end; // IMP_ARGLIST_BEG and IMP_ARGLIST_END, if any
+} ImpList;
+
+static ImpList find_imp_list(const PTree *tree, uint32_t fn)
+{
+  uint32_t start = fn - tree->data[fn];
+  uint32_t beg   = start + 2; // skip `fn` and the function name
+
+  if (beg >= fn || tree->kind[beg] != IMP_ARGLIST_BEG) return (ImpList){};
+
+  uint32_t end = beg;
+  while (tree->kind[end] != IMP_ARGLIST_END)
+    end++;
+
+  return (ImpList){.beg = beg, .end = end};
+}
+
+uint32_t mono_arity(const PTree *tree, uint32_t fn)
+{
+  ImpList il = find_imp_list(tree, fn);
+
+  uint32_t arity = 0;
+  for (uint32_t i = il.beg; i < il.end; ++i)
+    arity += tree->kind[i] == BIND_TY_NAME;
+
+  return arity;
+}
+
+Mono init_mono(ParseRes *pr)
+{
+  // instances keep the literals and symbols of the source tree
+  PTree out = {.lits = pr->tree.lits, .names = pr->tree.names};
+  return (Mono){.tree = &pr->tree, .names = &pr->names, .out = out};
+}
+
+static uint32_t hash_key(uint32_t fn, const uint8_t *args, uint32_t nargs)
+{
+  uint8_t key[sizeof(fn) + MONO_MAX_ARGS];
+
+  memcpy(key, &fn, sizeof(fn));
+  memcpy(key + sizeof(fn), args, nargs);
+
+  return fnv_32_buf(key, (uint32_t)sizeof(fn) + nargs);
+}
+
+static void insert_unique_in_cap(MonoEntry *restrict ens, MonoEntry e,
+                                 uint32_t cap_mask)
+{
+  uint32_t idx = e.hash & cap_mask;
+
+  while (ens[idx].inst)
+    idx = (idx + 1) & cap_mask;
+
+  ens[idx] = e;
+}
+
+static void grow(Mono *restrict m)
+{
+  uint32_t new_cap = m->encap ? m->encap << 1 : 0x100;
+  MonoEntry *nentrs =
+      mmap(NULL, new_cap * sizeof(MonoEntry), PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  assert(nentrs != MAP_FAILED && "failed to mmap Mono cache");
+
+  if (m->entrs)
+  {
+    for (MonoEntry *e = m->entrs; e < m->entrs + m->encap; ++e)
+      if (e->inst) insert_unique_in_cap(nentrs, *e, new_cap - 1);
+
+    munmap(m->entrs, m->encap * sizeof(MonoEntry));
+  }
+
+  m->entrs = nentrs;
+  m->encap = new_cap;
+}
+
+// the symbol of `name[u32,s8]` into `sym`, with the whole name so that
+// instances of different functions never share one. false if the names
+// have no room left for it
+static bool mangle(HSet *restrict names, StrView name, const uint8_t *args,
+                   uint32_t nargs, uint32_t *restrict sym)
+{
+  char *buf = malloc(name.len + MONO_MAX_ARGS * 4 + 2);
+  assert(buf && "failed to allocate mangled name");
+  uint32_t len = name.len;
+
+  memcpy(buf, name.txt, len);
+  buf[len++] = '[';
+  for (uint32_t i = 0; i < nargs; ++i)
+  {
+    const char *ty = inbuilt_name(args[i]);
+    uint32_t tlen  = (uint32_t)strlen(ty);
+
+    if (i) buf[len++] = ',';
+    memcpy(buf + len, ty, tlen);
+    len += tlen;
+  }
+  buf[len++] = ']';
+
+  StrView s = insert(names, buf, len);
+  free(buf);
+
+  if (!s.txt) return false;
+  *sym = interned_off(names, s);
+  return true;
+}
+
+static uint32_t copy_instance(Mono *restrict m, uint32_t fn, ImpList il,
+                              uint32_t sym, const uint8_t *args)
+{
+  const PTree *tree = m->tree;
+  PTree *out        = &m->out;
+  uint32_t start    = fn - tree->data[fn];
+
+  uint32_t params[MONO_MAX_ARGS]; // symbols
+  uint32_t nparams = 0;
+  for (uint32_t i = il.beg; i < il.end; ++i)
+    if (tree->kind[i] == BIND_TY_NAME) params[nparams++] = tree->data[i];
+
+  uint32_t base = out->len;
+
+  // `fn name`, then everything after the implicit argument list
+  append_nodes(out, tree, start, il.beg - start);
+  uint32_t body = out->len;
+  append_nodes(out, tree, il.end + 1, fn - il.end);
+
+  out->data[base + 1] = sym;
+
+  for (uint32_t i = body; i < out->len; ++i)
+  {
+    if (out->kind[i] != BIND_TY_USE) continue;
+
+    for (uint32_t p = 0; p < nparams; ++p)
+    {
+      if (out->data[i] != params[p]) continue;
+
+      out->kind[i] = BUILTIN_TY;
+      out->data[i] = args[p];
+      break;
+    }
+  }
+
+  uint32_t end   = out->len - 1;
+  out->data[end] = end - base;
+
+  return end;
+}
+
+uint32_t instantiate(Mono *restrict m, uint32_t fn, const InbuiltType *args,
+                     uint32_t nargs)
+{
+  ImpList il = find_imp_list(m->tree, fn);
+
+  if (nargs > MONO_MAX_ARGS || nargs != mono_arity(m->tree, fn))
+    return MONO_NONE;
+
+  if (!il.end) return MONO_NONE; // not generic, nothing to instantiate
+
+  uint8_t key[MONO_MAX_ARGS];
+  for (uint32_t i = 0; i < nargs; ++i)
+    key[i] = (uint8_t)args[i];
+
+  if ((float)m->inuse * PHI >= (float)m->encap) grow(m);
+
+  uint32_t hash     = hash_key(fn, key, nargs);
+  uint32_t cap_mask = m->encap - 1;
+  uint32_t idx      = hash & cap_mask;
+
+  for (MonoEntry e; (e = m->entrs[idx]).inst; idx = (idx + 1) & cap_mask)
+  {
+    if (e.hash == hash && e.fn == fn &&
+        !memcmp((uint8_t *)m->args.buffer + e.args, key, nargs))
+      return e.inst;
+  }
+
+  // named first, so that running out of room for names leaves nothing
+  // behind
+  uint32_t sym;
+  StrView name = sym_str(m->tree, fn - m->tree->data[fn] + 1);
+  if (!mangle(m->names, name, key, nargs, &sym)) return MONO_NONE;
+
+  MonoEntry e = {.hash = hash, .fn = fn, .args = m->args.len};
+  co_append(&m->args, key, nargs);
+  e.inst = copy_instance(m, fn, il, sym, key);
+
+  m->entrs[idx] = e;
+  m->inuse++;
+
+  return e.inst;
+}
+
+void free_mono(Mono m)
+{
+  if (m.entrs) munmap(m.entrs, m.encap * sizeof(MonoEntry));
+  free_ptree(m.out);
+  free(m.args.buffer);
+}
@@ -0,0 +1,49 @@
+#ifndef _MONO_H
+#define _MONO_H
+
+#include "parser.h"
+
+#define MONO_MAX_ARGS 16
+#define MONO_NONE UINT32_MAX
+
+typedef struct
+{
+  uint32_t hash;
+  uint32_t fn;   // FUN_END of the generic function in the source tree
+  uint32_t args; // offset of the type arguments in Mono.args
+  uint32_t inst; // FUN_END of the instance in Mono.out, 0 if unused
+} MonoEntry;
+
+/*
+ * instantiation cache for functions with implicit type arguments.
+ *
+ *  every distinct (function, type arguments) pair is instantiated exactly
+ *  once, by copying the postorder slice of the generic function into `out`
+ *  and substituting the uses of its implicit arguments.
+ */
+typedef struct
+{
+  const PTree *tree; // the generic source tree, not owned
+  HSet *names;       // interner for the mangled instance names
+
+  PTree out;         // instantiated functions back to back
+  DynamicArray args; // uint8_t, the InbuiltType arguments of each entry
+
+  MonoEntry *entrs;
+  uint32_t inuse, encap;
+} Mono;
+
+[[nodiscard]] Mono init_mono(ParseRes *pr);
+
+// number of implicit type arguments the function ending at `fn` takes
+uint32_t mono_arity(const PTree *tree, uint32_t fn);
+
+// returns the FUN_END of the instance in `m->out`, or MONO_NONE if the
+// function isn't generic, the arguments don't match its arity or the names
+// have no room left for the instance's
+[[nodiscard]] uint32_t instantiate(Mono *restrict m, uint32_t fn,
+                                   const InbuiltType *args, uint32_t nargs);
+
+void free_mono(Mono m);
+
+#endif // _MONO_H
@@ -0,0 +1,264 @@
+/*
+ * A grammar aware mutator, see mutator.h.
+ *
+ *  a mutation keeps the tokens before a random boundary, emits something
+ *  there and resumes the input at some token after it. the buffers are
+ *  kept between calls, so a warm mutator doesn't allocate.
+ *
+ *  built with -DFUNLANG_MUTATOR_SO it also carries the common helpers, to
+ *  be loaded by AFL++ as AFL_CUSTOM_MUTATOR_LIBRARY on its own.
+ */
+
+#ifdef FUNLANG_MUTATOR_SO
+#define __FUNLANG_COMMON_H_IMPL
+#endif
+
+#include "mutator.h"
+#include "gen.h"
+#include <ctype.h>
+
+typedef struct
+{
+  uint32_t beg, len;
+} Span;
+
+static DynamicArray dict_text; // char
+static DynamicArray dict;      // Span, into dict_text
+
+static DynamicArray spans; // Span, the tokens of the input
+static DynamicArray out;   // char
+
+typedef enum
+{
+  OP_INSERT,    // a dictionary token
+  OP_REPLACE,   // a token with a dictionary token
+  OP_DELETE,    // a token or a bracketed group
+  OP_DUPLICATE, // a token or a bracketed group
+  OP_SWAP,      // two neighbouring tokens or groups
+  OP_SPLICE,    // a whole generated function
+  OP_BYTE,      // any byte, now and then
+  OPS,
+} MutOp;
+
+static uint64_t next(uint64_t *restrict state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+  z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z          = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+static uint32_t below(uint64_t *restrict state, uint32_t n)
+{
+  return (uint32_t)(((next(state) >> 32) * n) >> 32);
+}
+
+uint32_t mutator_load_dict(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f) return 0;
+
+  char line[1024];
+  while (fgets(line, sizeof(line), f))
+  {
+    // entries look like `"text"` or `name="text"`
+    char *beg = strchr(line, '"'), *end = strrchr(line, '"');
+    if (!beg || end == beg) continue;
+
+    Span s = {.beg = dict_text.len};
+    for (char *c = beg + 1; c < end; ++c)
+    {
+      char ch = *c;
+      if (ch == '\\' && c + 1 < end)
+      {
+        ch = *++c;
+        if (ch == 'x' && c + 2 < end)
+        {
+          char hex[3] = {c[1], c[2], 0};
+          ch          = (char)strtol(hex, NULL, 16);
+          c += 2;
+        }
+      }
+      co_push(&dict_text, ch);
+    }
+
+    s.len = dict_text.len - s.beg;
+    if (s.len) co_push(&dict, s);
+  }
+
+  (void)fclose(f);
+  return dict.len;
+}
+
+static bool is_word(uint8_t c) { return isalnum(c) || c == '_'; }
+
+static void split(const uint8_t *data, size_t size)
+{
+  spans.len = 0;
+
+  for (size_t i = 0; i < size;)
+  {
+    size_t j = i + 1;
+    if (is_word(data[i]))
+      while (j < size && is_word(data[j]))
+        j++;
+    else if (isspace(data[i]))
+      while (j < size && isspace(data[j]))
+        j++;
+    else if (j < size && data[j] == '>' && (data[i] == '-' || data[i] == ':'))
+      j++;
+
+    Span s = {.beg = (uint32_t)i, .len = (uint32_t)(j - i)};
+    co_push(&spans, s);
+    i = j;
+  }
+}
+
+// past the end of the group starting at token `at`, which is the bracketed
+// region when it opens one
+static uint32_t group_end(const uint8_t *data, uint32_t at)
+{
+  const Span *sp = spans.buffer;
+  if (at >= spans.len) return at;
+
+  uint8_t open = data[sp[at].beg];
+  if (sp[at].len != 1 || !strchr("({[", open)) return at + 1;
+
+  uint8_t close = open == '(' ? ')' : open + 2; // `{}` and `[]` are 2 apart
+  uint32_t depth = 0, i = at;
+  for (; i < spans.len; ++i)
+  {
+    uint8_t c = data[sp[i].beg];
+    if (sp[i].len != 1) continue;
+
+    depth += c == open;
+    depth -= c == close;
+    if (!depth) return i + 1;
+  }
+  return i;
+}
+
+static void put_spans(const uint8_t *data, uint32_t from, uint32_t to)
+{
+  const Span *sp = spans.buffer;
+  if (from >= to) return;
+
+  uint32_t end = sp[to - 1].beg + sp[to - 1].len;
+  co_append(&out, (const char *)data + sp[from].beg, end - sp[from].beg);
+}
+
+static void put_dict(uint64_t *restrict rng)
+{
+  if (!dict.len) return;
+
+  // spaces keep keywords from gluing onto the names around them
+  Span s = ((Span *)dict.buffer)[below(rng, dict.len)];
+  co_append(&out, " ", 1);
+  co_append(&out, (char *)dict_text.buffer + s.beg, s.len);
+  co_append(&out, " ", 1);
+}
+
+size_t mutate(uint8_t *data, size_t size, size_t max, uint64_t seed)
+{
+  uint64_t rng = seed;
+
+  split(data, size);
+  out.len = 0;
+
+  uint32_t n    = spans.len;
+  uint32_t at   = below(&rng, n + 1); // a boundary between tokens
+  uint32_t from = at;                 // where the input resumes
+  MutOp op      = below(&rng, OPS);
+
+  if (!n || (!dict.len && op <= OP_REPLACE)) op = OP_SPLICE;
+
+  put_spans(data, 0, at);
+
+  switch (op)
+  {
+  case OP_INSERT: put_dict(&rng); break;
+  case OP_REPLACE:
+    put_dict(&rng);
+    from = MIN(at + 1, n);
+    break;
+  case OP_DELETE: from = group_end(data, at); break;
+  case OP_DUPLICATE: put_spans(data, at, group_end(data, at)); break;
+  case OP_SWAP:
+  {
+    uint32_t mid = group_end(data, at), end = group_end(data, mid);
+    put_spans(data, mid, end);
+    put_spans(data, at, mid);
+    from = end;
+    break;
+  }
+  case OP_SPLICE:
+    co_append(&out, "\n", 1);
+    gen_source(&out, below(&rng, GEN_SHAPES), next(&rng), 1);
+    break;
+  default: break;
+  }
+
+  put_spans(data, from, n);
+
+  if (op == OP_BYTE && out.len)
+    ((uint8_t *)out.buffer)[below(&rng, out.len)] = (uint8_t)next(&rng);
+
+  size_t len = MIN((size_t)out.len, max);
+  if (len) memcpy(data, out.buffer, len);
+  return len;
+}
+
+/*
+ * The AFL++ custom mutator interface.
+ */
+
+typedef struct
+{
+  uint64_t rng;
+  DynamicArray buf; // uint8_t
+} AflMutator;
+
+void *afl_custom_init(void *afl, unsigned int seed)
+{
+  (void)afl;
+
+  const char *path = getenv("FUNLANG_DICT");
+  (void)mutator_load_dict(path ? path : "funlang.dict");
+
+  AflMutator *m = calloc(1, sizeof(AflMutator));
+  assert(m && "failed to allocate mutator");
+  m->rng = seed;
+
+  return m;
+}
+
+size_t afl_custom_fuzz(void *data, uint8_t *buf, size_t buf_size,
+                       uint8_t **out_buf, uint8_t *add_buf, size_t add_buf_size,
+                       size_t max_size)
+{
+  (void)add_buf;
+  (void)add_buf_size;
+
+  AflMutator *m = data;
+
+  // mutating happens in place, so the copy needs room for the result
+  if (m->buf.cap < max_size)
+  {
+    m->buf.buffer = realloc(m->buf.buffer, max_size);
+    assert(m->buf.buffer && "failed to allocate mutator buffer");
+    m->buf.cap = (uint32_t)max_size;
+  }
+
+  size_t size = MIN(buf_size, max_size);
+  memcpy(m->buf.buffer, buf, size);
+
+  *out_buf = m->buf.buffer;
+  return mutate(m->buf.buffer, size, max_size, next(&m->rng));
+}
+
+void afl_custom_deinit(void *data)
+{
+  AflMutator *m = data;
+  free(m->buf.buffer);
+  free(m);
+}
@@ -0,0 +1,25 @@
+#ifndef _MUTATOR_H
+#define _MUTATOR_H
+
+#include "common.h"
+
+/*
+ * A mutator for fuzzing that knows what funlang looks like.
+ *
+ *  inputs are cut into tokens (names and numbers, `->`, `:>`, runs of
+ *  spaces and single characters) and mutated a token at a time: tokens of
+ *  a dictionary are inserted or put in place of others, tokens and
+ *  bracketed groups are dropped, duplicated or swapped, and whole generated
+ *  functions are spliced in. that keeps most inputs lexing into something
+ *  the parser gets deep into, instead of dying on the first byte.
+ */
+
+// loads the quoted entries of an AFL style dictionary, returns how many
+uint32_t mutator_load_dict(const char *path);
+
+// mutates the `size` bytes of `data` in place, into at most `max` bytes,
+// and returns the new size
+[[nodiscard]] size_t mutate(uint8_t *data, size_t size, size_t max,
+                            uint64_t seed);
+
+#endif // _MUTATOR_H
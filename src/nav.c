@@ -0,0 +1,156 @@
+/*
+ * Navigation indices, see nav.h.
+ *
+ *  the pass goes from the last node to the first keeping the ancestors of
+ *  the current node on a stack. a node is the parent of the nodes below it
+ *  down to the first of its subtree, so an ancestor is popped once the pass
+ *  goes past the start of its subtree and whatever is on top is the parent.
+ *
+ *  in preorder a subtree is a parent followed by its children in source
+ *  order, so a child comes right after its parent plus the nodes of the
+ *  siblings before it, which are the nodes between the start of the subtree
+ *  of the parent and the start of the subtree of the child.
+ */
+
+#include "nav.h"
+
+Nav build_nav(const PTree *t, uint32_t size)
+{
+  Nav nav       = {.size = size};
+  nav.parent    = malloc(size * sizeof(uint32_t) + 1);
+  nav.pre       = malloc(size * sizeof(uint32_t) + 1);
+  nav.post      = malloc(size * sizeof(uint32_t) + 1);
+  uint32_t *stk = malloc(size * sizeof(uint32_t) + 1);
+  assert(nav.parent && nav.pre && nav.post && stk &&
+         "failed to allocate navigation index");
+
+  uint32_t depth = 0;
+  for (uint32_t i = size; i-- > 0;)
+  {
+    uint32_t lo = i - subtree_size(t, i);
+    while (depth && stk[depth - 1] - subtree_size(t, stk[depth - 1]) > i)
+      --depth;
+
+    if (depth)
+    {
+      uint32_t p    = stk[depth - 1];
+      nav.parent[i] = p;
+      nav.pre[i]    = nav.pre[p] + 1 + lo - (p - subtree_size(t, p));
+    }
+    else
+    {
+      nav.parent[i] = NAV_NONE;
+      nav.pre[i]    = lo;
+      co_push(&nav.roots, i);
+    }
+    nav.post[nav.pre[i]] = i;
+
+    if (lo < i) stk[depth++] = i;
+  }
+  free(stk);
+
+  // the roots were found last first
+  uint32_t *roots = nav.roots.buffer;
+  for (uint32_t a = 0, b = nav.roots.len; a + 1 < b; ++a, --b)
+  {
+    uint32_t r   = roots[a];
+    roots[a]     = roots[b - 1];
+    roots[b - 1] = r;
+  }
+
+  return nav;
+}
+
+void free_nav(Nav nav)
+{
+  free(nav.parent);
+  free(nav.pre);
+  free(nav.post);
+  free(nav.roots.buffer);
+}
+
+uint32_t nav_first_child(const Nav *nav, const PTree *t, uint32_t i)
+{
+  return subtree_size(t, i) ? nav->post[nav->pre[i] + 1] : NAV_NONE;
+}
+
+uint32_t nav_next_sibling(const Nav *nav, const PTree *t, uint32_t i)
+{
+  // the next sibling starts where the subtree of `i` ends in preorder, as
+  // long as that is still in the subtree of the parent
+  uint32_t next = nav->pre[i] + subtree_size(t, i) + 1;
+  uint32_t p    = nav->parent[i];
+  uint32_t end =
+      p == NAV_NONE ? nav->size : nav->pre[p] + subtree_size(t, p) + 1;
+  return next < end ? nav->post[next] : NAV_NONE;
+}
+
+// does the subtree of `node` end before preorder number `k`
+static bool ends_before(const Nav *nav, const PTree *t, uint32_t node,
+                        uint32_t k)
+{
+  return nav->pre[node] + subtree_size(t, node) < k;
+}
+
+bool nav_walk(const Nav *nav, const PTree *t, uint32_t root, NavEnter enter,
+              NavLeave leave, void *ctx)
+{
+  // the nodes entered whose subtrees haven't been left yet
+  DynamicArray open = {}; // uint32_t
+  uint32_t beg = nav->pre[root], end = beg + subtree_size(t, root) + 1;
+  bool done = true;
+
+  for (uint32_t k = beg; k < end;)
+  {
+    uint32_t node = nav->post[k];
+    uint32_t *top = open.buffer;
+    while (open.len && ends_before(nav, t, top[open.len - 1], k))
+      leave(top[--open.len], ctx);
+
+    NavStep step = enter(node, ctx);
+    if (step == NAV_STOP)
+    {
+      done = false;
+      break;
+    }
+
+    if (step == NAV_SKIP) k += subtree_size(t, node) + 1;
+    else
+    {
+      if (leave) co_push(&open, node);
+      ++k;
+    }
+  }
+
+  if (done)
+    while (open.len)
+      leave(((uint32_t *)open.buffer)[--open.len], ctx);
+  free(open.buffer);
+  return done;
+}
+
+uint32_t nav_enclosing(const Nav *nav, const PTree *t, uint32_t node,
+                       PNodeKind kind)
+{
+  for (node = nav->parent[node]; node != NAV_NONE; node = nav->parent[node])
+    if (t->kind[node] == kind) return node;
+  return NAV_NONE;
+}
+
+uint32_t nav_fn_at(const Nav *nav, const PTree *t, uint32_t off)
+{
+  // the last root that starts at or before `off`
+  const uint32_t *roots = nav->roots.buffer;
+  uint32_t lo = 0, hi = nav->roots.len;
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint32_t r   = roots[mid];
+    if (t->pos[r - subtree_size(t, r)] <= off) lo = mid + 1;
+    else hi = mid;
+  }
+  if (!lo) return NAV_NONE;
+
+  uint32_t r = roots[lo - 1];
+  return t->kind[r] == FUN_END && off <= t->pos[r] ? r : NAV_NONE;
+}
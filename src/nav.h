@@ -0,0 +1,87 @@
+#ifndef _NAV_H
+#define _NAV_H
+
+#include "parser.h"
+
+/*
+ * Navigation over the postorder tree.
+ *
+ *  the tree only knows the size of the subtree of its closers, which is
+ *  enough to walk the children of a node backwards but not to go up or to
+ *  go forwards. the index adds, in one pass from the last node to the first,
+ *
+ *    the parent of every node
+ *    its number in preorder, and the node of every preorder number
+ *
+ *  so the parent, the first child and the next sibling of a node are each
+ *  a load or two. it is built on demand, passes that only go bottom up
+ *  don't need it.
+ */
+
+#define NAV_NONE UINT32_MAX
+
+typedef struct
+{
+  uint32_t *parent;   // NAV_NONE for the roots
+  uint32_t *pre;      // node to preorder number
+  uint32_t *post;     // preorder number to node
+  DynamicArray roots; // uint32_t, the top level nodes in source order
+  uint32_t size;
+} Nav;
+
+[[nodiscard]] Nav build_nav(const PTree *t, uint32_t size);
+void free_nav(Nav nav);
+
+// the children of `i` in source order, NAV_NONE after the last
+[[nodiscard]] uint32_t nav_first_child(const Nav *nav, const PTree *t,
+                                       uint32_t i);
+[[nodiscard]] uint32_t nav_next_sibling(const Nav *nav, const PTree *t,
+                                        uint32_t i);
+
+// the children of a node from the last to the first, which only needs the
+// sizes of the subtrees
+typedef struct
+{
+  uint32_t cur, lo; // the end of the next child, the start of the subtree
+} ChildIter;
+
+static inline ChildIter child_iter(const PTree *t, uint32_t i)
+{
+  return (ChildIter){.cur = i, .lo = i - subtree_size(t, i)};
+}
+
+// the next child, NAV_NONE once there are no more
+static inline uint32_t next_child(const PTree *t, ChildIter *restrict it)
+{
+  if (it->cur == it->lo) return NAV_NONE;
+  uint32_t child = it->cur - 1;
+  it->cur        = child - subtree_size(t, child);
+  return child;
+}
+
+typedef enum
+{
+  NAV_CONTINUE,
+  NAV_SKIP, // don't go into the subtree of the node
+  NAV_STOP,
+} NavStep;
+
+typedef NavStep (*NavEnter)(uint32_t node, void *ctx);
+typedef void (*NavLeave)(uint32_t node, void *ctx);
+
+// visits the subtree of `root` in preorder, calling `enter` before the
+// children of a node and `leave`, if given, after them unless the node was
+// skipped. returns false if `enter` stopped the walk
+bool nav_walk(const Nav *nav, const PTree *t, uint32_t root, NavEnter enter,
+              NavLeave leave, void *ctx);
+
+// the closest proper ancestor of `node` of kind `kind`, NAV_NONE if none
+[[nodiscard]] uint32_t nav_enclosing(const Nav *nav, const PTree *t,
+                                     uint32_t node, PNodeKind kind);
+
+// the top level function whose text, from `fn` to `}`, holds `off`, NAV_NONE
+// if there is none
+[[nodiscard]] uint32_t nav_fn_at(const Nav *nav, const PTree *t,
+                                 uint32_t off);
+
+#endif // _NAV_H
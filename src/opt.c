@@ -0,0 +1,179 @@
+/*
+ * Constant folding and value numbering.
+ *
+ *  both happen in the same forward sweep over the IR. operands are renamed
+ *  as they're read, so by the time an instruction is visited its operands
+ *  are already folded and numbered, and the instruction can be folded or
+ *  looked up in the value table right away. surviving instructions are
+ *  written back compacted, in the same sweep.
+ *
+ *  functions are straight line code, so every value computed earlier in the
+ *  function is available to every later instruction.
+ *
+ *  a checked operation on constants that overflows is left alone, it has to
+ *  trap if it is ever computed.
+ */
+
+#include "opt.h"
+#include "perf.h"
+
+typedef struct
+{
+  uint8_t op;
+  TypeId ty;
+  uint32_t a, b;
+  uint32_t val;
+  uint32_t stamp; // function the entry belongs to, 0 if unused
+} VNEntry;
+
+// the table is shared by all functions instead of being cleared between
+// them. a slot holding an entry of another function counts as free, so the
+// probe sequences of the current function only ever contain its own entries
+typedef struct
+{
+  VNEntry *entrs;
+  uint32_t mask;
+} VNTable;
+
+static uint32_t hash_insn(uint8_t op, TypeId ty, uint32_t a, uint32_t b)
+{
+  uint32_t h = (uint32_t)op << 8 | ty;
+
+  h ^= a * 0x9e3779b1u;
+  h ^= (b + 0x7f4a7c15u) * 0x85ebca77u;
+
+  return h ^ h >> 15;
+}
+
+// returns the earlier value computing the same thing, or `val` after
+// recording it
+static uint32_t number(VNTable *restrict vn, uint32_t stamp, uint8_t op,
+                       TypeId ty, uint32_t a, uint32_t b, uint32_t val)
+{
+  uint32_t idx = hash_insn(op, ty, a, b) & vn->mask;
+
+  for (VNEntry *e; (e = vn->entrs + idx)->stamp == stamp;
+       idx = (idx + 1) & vn->mask)
+  {
+    if (e->op == op && e->ty == ty && e->a == a && e->b == b) return e->val;
+  }
+
+  vn->entrs[idx] = (VNEntry){
+      .op = op, .ty = ty, .a = a, .b = b, .val = val, .stamp = stamp};
+
+  return val;
+}
+
+uint32_t fold_and_number(IR *restrict ir)
+{
+  PERF_BEGIN(perf);
+
+  uint32_t len  = ir->len;
+  uint32_t *map = malloc(len * sizeof(uint32_t));
+
+  // at most half full, even if all values of the IR were in one function
+  uint32_t cap = 1u << (32 - stdc_leading_zeros_ui(len | 1) + 1);
+  VNTable vn   = {.entrs = calloc(cap, sizeof(VNEntry)), .mask = cap - 1};
+
+  assert((map || !len) && vn.entrs && "failed to allocate numbering tables");
+
+  IRFunc *funcs   = ir->funcs.buffer;
+  IRBlock *blocks = ir->blocks.buffer;
+
+  uint32_t w = 0; // where the next surviving instruction goes
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+  {
+    uint32_t stamp = fn + 1;
+
+    for (uint32_t bl = funcs[fn].blk_beg; bl < funcs[fn].blk_end; ++bl)
+    {
+      uint32_t beg = w;
+
+      for (uint32_t v = blocks[bl].beg; v < blocks[bl].end; ++v)
+      {
+        uint8_t op = ir->op[v];
+        TypeId ty  = ir->ty[v];
+        uint32_t a = ir->a[v], b = ir->b[v];
+
+        switch (op)
+        {
+        case IR_NOP: continue;
+        case IR_NEG:
+        case IR_NEGC:
+        case IR_NEGX:
+          a = map[a];
+          if (ir->op[a] != IR_CONST) break;
+
+          uint64_t neg;
+          if (neg_overflows(ir_const(ir, a), ty, &neg) && op == IR_NEGC)
+            break;
+
+          op = IR_CONST;
+          a  = (uint32_t)neg;
+          b  = (uint32_t)(neg >> 32);
+          break;
+        case IR_ADD:
+        case IR_ADDC:
+        case IR_ADDX:
+          a = map[a];
+          b = map[b];
+          if (ir->op[a] != IR_CONST || ir->op[b] != IR_CONST)
+          {
+            if (a > b) // commutative, keep one canonical order
+            {
+              uint32_t t = a;
+              a          = b;
+              b          = t;
+            }
+            break;
+          }
+
+          uint64_t sum;
+          if (add_overflows(ir_const(ir, a), ir_const(ir, b), ty, &sum) &&
+              op == IR_ADDC)
+            break;
+
+          op = IR_CONST;
+          a  = (uint32_t)sum;
+          b  = (uint32_t)(sum >> 32);
+          break;
+        case IR_ASSERT:
+        case IR_ASSUME:
+          b = map[b];
+          [[fallthrough]];
+        case IR_RET:
+          a = map[a];
+          [[fallthrough]];
+        default: break;
+        }
+
+        if (op != IR_RET)
+        {
+          uint32_t prev = number(&vn, stamp, op, ty, a, b, w);
+          if (prev != w)
+          {
+            map[v] = prev;
+            continue;
+          }
+        }
+
+        ir->op[w] = op;
+        ir->ty[w] = ty;
+        ir->a[w]  = a;
+        ir->b[w]  = b;
+        map[v]    = w++;
+      }
+
+      blocks[bl] = (IRBlock){.beg = beg, .end = w};
+    }
+  }
+
+  ir->len = w;
+
+  free(map);
+  free(vn.entrs);
+
+  PERF_END(PERF_FOLD, perf);
+
+  return len - w;
+}
@@ -0,0 +1,12 @@
+#ifndef _OPT_H
+#define _OPT_H
+
+#include "ir.h"
+
+// folds constant operations (wrapping to the width of their type, checked
+// ones only if they don't overflow) and merges every value that was already
+// computed earlier in the same function, compacting the IR in place. returns
+// the number of removed instructions
+uint32_t fold_and_number(IR *restrict ir);
+
+#endif // _OPT_H
@@ -9,13 +9,14 @@
 #include "parser.h"
 #include "hashtable.h"
 #include "lexer.h"
+#include "perf.h"
 #include <stdio.h>
 #include <string.h>
 
 typedef struct
 {
-  DynamicArray buf;
-  DynamicArray cls;
+  PTree nodes;
+  DynamicArray lits; // uint64_t
   HSet names;
 } PBuf;
 
@@ -43,6 +44,7 @@ typedef enum
   EXPLICIT_ARG_LIST = 9,
 
   STATEMENT  = 0x10,
+  UNARY      = 0x50,
   EXPRESSION = 0x70,
   EXPR_CONT  = 0xc0,
 
@@ -60,9 +62,13 @@ typedef enum
   TERM_BIND_USE    = TERM(CONTENT_STR, BIND_USE, TOK_VAL_ID),     // name
   TERM_LITERAL_INT = TERM(CONTENT_LIT, LITERAL_INT, TOK_LIT_INT), // 12314
   TERM_ASSGN       = TERM(0, STMT_ASSGN_EQ, '='),                 // =
+  TERM_CMP_LT      = TERM(0, STMT_CMP_LT, '<'),                   // <
+  TERM_CMP_GT      = TERM(0, STMT_CMP_GT, '>'),                   // >
 
   INTRO_LET_BIND     = INTRO(0, STMT_LET_BIND, TOK_KW_LET),   // let
   INTRO_RETURN       = INTRO(0, STMT_RETURN, TOK_KW_RETRN),   // return
+  INTRO_ASSERT       = INTRO(0, STMT_ASSERT, TOK_KW_ASS),     // ass
+  INTRO_ASSUME       = INTRO(0, STMT_ASSUME, TOK_KW_ASU),     // asu
   INTRO_FN_INT       = INTRO(0, FUN_INT, TOK_KW_FN),          // fn
   INTRO_PREFIX_MINUS = INTRO(0, PREFIX_MINUS, '-'),           // -
   INTRO_CLOSE_SEMI   = INTRO(CLOSE(0, 0, 0), STMT_SEMI, ';'), // ;
@@ -130,66 +136,105 @@ static bool term_matches(PStateKind term, TokTag tag)
   return (tag & 0xff) == (term & 0xff);
 }
 
-static StrView intern_lex_intern(HSet *names, char *intern, Intern i)
+// the symbol of an interned name
+static uint32_t intern_lex_intern(HSet *names, char *intern, Intern i)
 {
-  return insert(names, intern + i.idx, i.len >> 8);
+  return interned_off(names, insert(names, intern + i.idx, i.len >> 8));
 }
 
-static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
-                           PBuf *tree)
+// the payload of the node of a terminal
+static uint32_t term_payload(Token word, PStateKind state, LexRes *lr,
+                             PBuf *tree)
 {
-
   if (state & CONTENT_STR)
-    n->str = intern_lex_intern(&tree->names, lr->intern, word.as_intern);
-  else if (state & CONTENT_LIT)
-  {
-    n->literal_int = lr->lits[word.as_lit_idx >> 8];
-    printf("word.as_lit_idx >> 8 = %d\n", word.as_lit_idx>>8);
-    printf("n->literal_int = %lu\n", n->literal_int);
-    
-  }
+    return intern_lex_intern(&tree->names, lr->intern, word.as_intern);
+
+  // the payload of the token as is, see LIT_INLINE
+  if (state & CONTENT_LIT) return word.as_lit_idx >> 8;
 
-  n->kind = (state >> 8) & 0xff;
+  if ((state & STATIC_MASK) == TERM_BUILTIN_TY) return word.tag & 0xff;
+
+  return 0;
 }
 
 [[nodiscard]] ParseRes parse(LexRes lr)
 {
-  PBuf tree;
-  PStack stack;
+  PERF_BEGIN(perf); // interning happens as part of parsing
+
+  PBuf tree    = {.lits.mem = MEM_TREE};
+  PStack stack = {.mem = MEM_PSTACK};
+
+  // every name is the text of a token with a length in front of it
+  size_t ntoks = (size_t)(lr.tkeptr - lr.tokens);
+  hset_reserve(&tree.names,
+               lr.nintern + ntoks * sizeof(uint32_t) + PARSE_NAMES_SLACK);
 
   PState focus = {.kind = ROOT};
-  Token word   = *lr.tokens;
-  uint32_t i   = 0;
+  Token word   = lr.tokens < lr.tkeptr ? *lr.tokens : (Token){}; // may be empty
+  ParseErr err = {};
+
+  // the tree is cut back to the last complete function on errors
+  uint32_t complete = 0;
 
   while (lr.tokens < lr.tkeptr) // TODO: handle eof
   {
-    PNode n = {};
-    n.pos   = word.pos;
+    PNodeKind kind = INVALID;
+    uint32_t data = 0, pos = word.pos;
 
     // printf("%d\n", i++);
     // printf("word = 0x%x\n", word.tag & 0xff);
     // printf("rule = 0x%x\n", focus.kind);
     // printf("rule & CLOSE = 0x%x\n", focus.kind & CLOSE);
-    printf("rule & STATIC_MASK = 0x%x, word.tag = 0x%x\n",
-           focus.kind & STATIC_MASK, word.tag & 0xff);
-    if (i > 90) abort();
+    // printf("rule & STATIC_MASK = 0x%x, word.tag = 0x%x\n",
+    //        focus.kind & STATIC_MASK, word.tag & 0xff);
 
     if ((focus.kind & TERM) && term_matches(focus.kind, word.tag))
     {
 
       if (focus.kind & CHOICE) stack.len -= focus.chsz;
 
-      term_into_node(word, focus.kind, &n, &lr, &tree);
+      kind = (focus.kind >> 8) & 0xff;
+      data = term_payload(word, focus.kind, &lr, &tree);
 
       if (focus.kind & INTRO)
       {
         switch (focus.kind & STATIC_MASK)
         {
         case INTRO_FN_INT: focus.kind = FUNC; break;
+        case INTRO_IMP_ARGL:
+
+          focus.kind = TERM_IMP_ARGL_END;
+          focus.tpos = tree.nodes.len;
+          co_push(&stack, focus);
+
+          focus.kind = INTRO_IMP_ARG | CHOICE;
+          focus.chsz = 0;
+          break;
+        case INTRO_IMP_ARG:
+
+          focus.kind = INTRO_IMP_ARG_SEP | CHOICE;
+          co_push(&stack, focus);
+          focus.kind = INTRO_SUBTY | CHOICE;
+          focus.chsz = 0;
+          break;
+        case INTRO_IMP_ARG_SEP:
+
+          focus.kind = INTRO_IMP_ARG;
+          focus.chsz = 0;
+          break;
+        case INTRO_SUBTY:
+
+          focus.kind         = CLOSE_TY_SUBTY;
+          focus.dclo.nod_pos = tree.nodes.len - 1;
+          focus.dclo.tok_pos = word.pos;
+          co_push(&stack, focus);
+          focus.kind = TYPE;
+          // TODO: hacky
+          goto delay_closing;
         case INTRO_EXP_ARGL:
 
           focus.kind = TERM_EXP_ARGL_END;
-          focus.tpos = tree.buf.len;
+          focus.tpos = tree.nodes.len;
           co_push(&stack, focus);
 
           focus.kind = INTRO_EXP_ARG | CHOICE;
@@ -208,8 +253,9 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
           break;
         case INTRO_JUDGE:
 
+          // the judgement spans the name it annotates
           focus.kind         = CLOSE_TY_JUDGE;
-          focus.dclo.nod_pos = tree.buf.len;
+          focus.dclo.nod_pos = tree.nodes.len - 1;
           focus.dclo.tok_pos = word.pos;
           co_push(&stack, focus);
           focus.kind = TYPE;
@@ -217,13 +263,19 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
           goto delay_closing;
         case INTRO_FN_ARROW:
 
-          focus.kind         = TYPE;
-          focus.dclo.nod_pos = tree.buf.len;
+          focus.kind         = CLOSE_FN_ARROW;
+          focus.dclo.nod_pos = tree.nodes.len;
           focus.dclo.tok_pos = word.pos;
-          break;
+          co_push(&stack, focus);
+          focus.kind = TYPE;
+          // TODO: hacky
+          goto delay_closing;
         case INTRO_LET_BIND:
 
-          // TODO: maybe move semi stuff here
+          focus.kind = INTRO_CLOSE_SEMI;
+          focus.tpos = tree.nodes.len;
+          co_push(&stack, focus);
+
           focus.kind = EXPRESSION;
           co_push(&stack, focus);
 
@@ -231,33 +283,68 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
           co_push(&stack, focus);
 
           focus.kind = INTRO_JUDGE | CHOICE;
-          focus.tpos = tree.buf.len;
+          focus.tpos = tree.nodes.len;
           co_push(&stack, focus);
 
           focus.kind = TERM_BIND_NAME;
           break;
         case INTRO_ADD_CONT:
+        {
+          // `+` is left associative: the left operand is everything since
+          // the expression started, the right one a single unary, and the
+          // sum is the left operand of whatever `+` follows
+          uint32_t lhs = focus.tpos;
+
+          focus.kind = EXPR_CONT;
+          co_push(&stack, focus);
+
           focus.kind         = CLOSE_IFX_ADD;
-          focus.dclo.nod_pos = tree.buf.len;
+          focus.dclo.nod_pos = lhs;
           focus.dclo.tok_pos = word.pos;
           co_push(&stack, focus);
 
-          focus.kind = EXPRESSION;
+          focus.kind = UNARY;
           // TODO: hacky
           goto delay_closing;
+        }
         case INTRO_PREFIX_MINUS:
           focus.kind         = CLOSE_PFX_SUB;
-          focus.dclo.nod_pos = tree.buf.len;
+          focus.dclo.nod_pos = tree.nodes.len;
           focus.dclo.tok_pos = word.pos;
           co_push(&stack, focus);
 
-          focus.kind = EXPRESSION;
+          focus.kind = UNARY;
           // TODO: hacky
           goto delay_closing;
-        case INTRO_RETURN: focus.kind = EXPRESSION; break;
+        case INTRO_RETURN:
+          focus.kind = INTRO_CLOSE_SEMI;
+          focus.tpos = tree.nodes.len;
+          co_push(&stack, focus);
+
+          focus.kind = EXPRESSION;
+          break;
+        case INTRO_ASSERT:
+        case INTRO_ASSUME:
+          // a comparison, `lhs < rhs` or `lhs > rhs`
+          focus.kind = INTRO_CLOSE_SEMI;
+          focus.tpos = tree.nodes.len;
+          co_push(&stack, focus);
+
+          focus.kind = EXPRESSION;
+          co_push(&stack, focus);
+
+          focus.kind = TERM_CMP_GT | CHOICE_END;
+          co_push(&stack, focus);
+
+          focus.kind = TERM_CMP_LT | CHOICE;
+          focus.chsz = 1;
+          co_push(&stack, focus);
+
+          focus.kind = EXPRESSION;
+          break;
         case INTRO_CLOSE_SEMI:
 
-          n.subtree_sz = tree.buf.len - focus.tpos;
+          data = tree.nodes.len - focus.tpos;
 
           focus.kind = STATEMENT;
           break;
@@ -266,32 +353,32 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
       }
       else if (focus.kind & CLOSE)
       {
-        n.subtree_sz = tree.buf.len - focus.tpos;
+        data = tree.nodes.len - focus.tpos;
         // TODO: empty stack
         if (stack.len) co_pop(&stack, &focus);
       }
       else if (stack.len) { co_pop(&stack, &focus); }
 
-      co_push(&tree.buf, n);
+      push_node(&tree.nodes, kind, data, pos);
+      if (kind == FUN_END) complete = tree.nodes.len;
 
     delay_closing:
-      word = *++lr.tokens;
+      if (++lr.tokens < lr.tkeptr) word = *lr.tokens;
     }
     else if (focus.kind & CLOSE &&
              !(focus.kind & TERM)) // "fixup" close bracketing nodes
     {
       switch (focus.kind & STATIC_MASK) // TODO: factor out
       {
-      case CLOSE_TY_JUDGE: n.kind = BIND_TY_JUDGE; break;
-      case CLOSE_TY_SUBTY: n.kind = BIND_TY_SUBTY; break;
-      case CLOSE_FN_ARROW: n.kind = FUN_ARROW; break;
-      case CLOSE_PFX_SUB:  n.kind = PREFIX_MINUS; break;
-      case CLOSE_IFX_ADD:  n.kind = INFIX_PLUS; break;
+      case CLOSE_TY_JUDGE: kind = BIND_TY_JUDGE; break;
+      case CLOSE_TY_SUBTY: kind = BIND_TY_SUBTY; break;
+      case CLOSE_FN_ARROW: kind = FUN_ARROW; break;
+      case CLOSE_PFX_SUB:  kind = PREFIX_MINUS; break;
+      case CLOSE_IFX_ADD:  kind = INFIX_PLUS; break;
       default:             assert(false && "unhandled close fixup");
       }
-      n.pos        = focus.dclo.tok_pos;
-      n.subtree_sz = tree.buf.len - focus.dclo.nod_pos;
-      co_push(&tree.buf, n);
+      push_node(&tree.nodes, kind, tree.nodes.len - focus.dclo.nod_pos,
+                focus.dclo.tok_pos);
       co_pop(&stack, &focus);
     }
     else if (!(focus.kind & TERM))
@@ -308,17 +395,23 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
       // TODO: maybe propagate some flags
       switch (focus.kind & STATIC_MASK)
       {
-      case ROOT: focus.kind = INTRO_FN_INT; break;
+      case ROOT:
+        co_push(&stack, focus); // a file is any number of functions
+
+        focus.kind = INTRO_FN_INT;
+        break;
       case FUNC:
+        // the subtree of a function starts at its `fn` node, so that
+        // every function is the node slice [end - subtree_sz, end]
         focus.kind = TERM_CLOSE_FN;
-        focus.tpos = tree.buf.len;
+        focus.tpos = tree.nodes.len - 1;
         co_push(&stack, focus);
 
         focus.kind = STATEMENT;
         co_push(&stack, focus);
 
         focus.kind = TERM_FN_BL_OPEN;
-        focus.tpos = tree.buf.len;
+        focus.tpos = tree.nodes.len;
         co_push(&stack, focus);
 
         focus.kind = INTRO_FN_ARROW | CHOICE;
@@ -349,13 +442,25 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
         focus.chsz = 0;
         co_push(&stack, focus);
 
-        focus.kind = INTRO_RETURN | CHOICE;
+        focus.kind = INTRO_ASSUME | CHOICE;
         focus.chsz = 1;
+        co_push(&stack, focus);
+
+        focus.kind = INTRO_ASSERT | CHOICE;
+        focus.chsz = 2;
+        co_push(&stack, focus);
+
+        focus.kind = INTRO_RETURN | CHOICE;
+        focus.chsz = 3;
         break;
       case EXPRESSION:
         focus.kind = EXPR_CONT;
+        focus.tpos = tree.nodes.len;
         co_push(&stack, focus);
 
+        focus.kind = UNARY;
+        break;
+      case UNARY:
         focus.kind = INTRO_PREFIX_MINUS | CHOICE_END;
         focus.chsz = 2;
         co_push(&stack, focus);
@@ -368,12 +473,8 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
         focus.chsz = 2;
         break;
       case EXPR_CONT:
-        focus.kind = INTRO_CLOSE_SEMI | CHOICE;
-        focus.chsz = 0;
-        co_push(&stack, focus);
-
         focus.kind = INTRO_ADD_CONT | CHOICE;
-        focus.chsz = 1;
+        focus.chsz = 0;
         break;
 
       default: assert(false && "unhandled nonterminal");
@@ -385,33 +486,100 @@ static void term_into_node(Token word, PStateKind state, PNode *n, LexRes *lr,
     }
     else
     {
-      // TODO: error
-      printf("focus.kind & STATIC_MASK = 0x%x, word = 0x%x\n",
-             focus.kind & STATIC_MASK, word.tag & 0xff);
-      assert(false && "encountered parse error?");
+      // TODO: recover at the next `fn`
+      err = (ParseErr){.pos = word.pos, .msg = "unexpected token"};
+      break;
     }
   }
 
-  free(stack.buffer);
+  if (!err.msg && tree.nodes.len != complete)
+    err = (ParseErr){.pos = word.pos, .msg = "unexpected end of file"};
+
+  mem_free(MEM_PSTACK, stack.buffer);
+
+  // the literals too large to be inlined, which the payloads index into
+  if (lr.nlits) co_append(&tree.lits, lr.lits, lr.nlits);
 
-  ParseRes res = {
-      .size = tree.buf.len, .tree = tree.buf.buffer, .names = tree.names};
+  // both only move while parsing
+  tree.nodes.lits  = tree.lits.buffer;
+  tree.nodes.names = tree.names.intrn.buffer;
+
+  ParseRes res = {.size  = complete,
+                  .tree  = tree.nodes,
+                  .lits  = tree.lits,
+                  .names = tree.names,
+                  .err   = err};
+
+  PERF_END(PERF_PARSE, perf);
 
   return res;
 }
 
-#define PNodeKindMacroFormat1(V, ...)                                          \
-  case V: printf("{ .kind = " #V " }"); break;
-#define PNodeKindMacroFormat2(V, _, S, F)                                      \
-  case V: printf("{ .kind = " #V ", ." #F " = " S " }", n.F); break;
-#define PNodeKindMacroFormat3(V, _, S, F1, F2)                                 \
-  case V: printf("{ .kind = " #V ", .str = " S " }", n.F1, n.F2); break;
+void free_parseres(ParseRes pr)
+{
+  free_ptree(pr.tree);
+  mem_free(MEM_TREE, pr.lits.buffer);
+  free_hset(pr.names);
+}
+
+// grows one column of a tree, charging it to MEM_TREE
+static void *grow_column(void *col, size_t size)
+{
+  uintptr_t old   = (uintptr_t)col;
+  size_t old_size = mem_size(col);
+
+  col = realloc(col, size);
+  assert(col && "failed to grow tree");
 
-void print_pnode(PNode n)
+  mem_grow(MEM_TREE, old_size, mem_size(col),
+           (uintptr_t)col != old ? old_size : 0);
+  return col;
+}
+
+static void reserve_nodes(PTree *restrict t, uint32_t n)
 {
-  switch (n.kind)
-  {
-    PNodeKindMacro(PNodeKindMacroFormat1, PNodeKindMacroFormat2,
-                   PNodeKindMacroFormat3)
-  }
+  if (t->len + n <= t->cap) return;
+
+  uint32_t new_cap = t->cap ? t->cap : 0x100;
+  while (new_cap < t->len + n)
+    new_cap <<= 1;
+
+  t->kind = grow_column(t->kind, new_cap * sizeof(*t->kind));
+  t->data = grow_column(t->data, new_cap * sizeof(*t->data));
+  t->pos  = grow_column(t->pos, new_cap * sizeof(*t->pos));
+
+  t->cap = new_cap;
 }
+
+uint32_t push_node(PTree *restrict t, PNodeKind kind, uint32_t data,
+                   uint32_t pos)
+{
+  if (t->len == t->cap) reserve_nodes(t, 1);
+
+  t->kind[t->len] = (uint8_t)kind;
+  t->data[t->len] = data;
+  t->pos[t->len]  = pos;
+
+  return t->len++;
+}
+
+void append_nodes(PTree *restrict t, const PTree *src, uint32_t beg,
+                  uint32_t n)
+{
+  if (!n) return;
+  reserve_nodes(t, n);
+
+  memcpy(t->kind + t->len, src->kind + beg, n * sizeof(*t->kind));
+  memcpy(t->data + t->len, src->data + beg, n * sizeof(*t->data));
+  memcpy(t->pos + t->len, src->pos + beg, n * sizeof(*t->pos));
+
+  t->len += n;
+}
+
+void free_ptree(PTree t)
+{
+  mem_free(MEM_TREE, t.kind);
+  mem_free(MEM_TREE, t.data);
+  mem_free(MEM_TREE, t.pos);
+}
+
@@ -2,6 +2,7 @@
 #define _PARSER_H_
 #include "hashtable.h"
 #include "lexer.h"
+#include "types.h"
 
 #define PNodeKindMacro(X1, X2, X3)                                             \
   X1(INVALID, INVALID)                                                         \
@@ -26,7 +27,7 @@
   X3(BIND_USE, "name", "%.*s", str.len, str.txt)                               \
   X3(BIND_TY_USE, "Name", "%.*s", str.len, str.txt)                            \
                                                                                \
-  X2(LITERAL_INT, "1234", "%d", literal_int)                                   \
+  X2(LITERAL_INT, "1234", "%lu", literal_int)                                   \
                                                                                \
   X2(PREFIX_MINUS, "-", "%d", subtree_sz)                                      \
                                                                                \
@@ -36,8 +37,12 @@
   X1(STMT_RETURN, "return")                                                    \
   X1(STMT_LET_BIND, "let")                                                     \
   X1(STMT_ASSGN_EQ, "=")                                                       \
+  X1(STMT_ASSERT, "ass")                                                       \
+  X1(STMT_ASSUME, "asu")                                                       \
+  X1(STMT_CMP_LT, "<")                                                         \
+  X1(STMT_CMP_GT, ">")                                                         \
   X2(STMT_SEMI, ";", "%d", subtree_sz)                                         \
-  X1(BUILTIN_TY, "u32, ...")
+  X2(BUILTIN_TY, "u32, ...", "0x%x", inbuilt)
 
 #define PNodeKindMacroDeclare(V, ...) V,
 
@@ -46,28 +51,127 @@ typedef enum
   PNodeKindMacro(PNodeKindMacroDeclare, PNodeKindMacroDeclare, PNodeKindMacroDeclare)
 } PNodeKind;
 
+#define PNodeKindMacroSym(V, ...) case V:
+#define PNodeKindMacroIgnore(...)
+
+/*
+ * The parse tree in structure of arrays layout.
+ *
+ *  a node is an index into the columns, a byte of kind, 32 bits of payload
+ *  and the offset of its token. the payload holds
+ *
+ *    the size of the subtree  for closers, see subtree_size
+ *    a symbol                 for names, the offset of the interned name in
+ *                             the intern region of the names, so equal
+ *                             names have equal symbols
+ *    a literal                for LITERAL_INT, see LIT_INLINE
+ *    the InbuiltType          for BUILTIN_TY
+ *
+ *  so a node takes 9 bytes, and a pass that only looks at kinds touches one
+ *  of them.
+ */
+
+// the payload of a LITERAL_INT is that of its token shifted down to the
+// bottom: the value over this bit when it is set, else the index of the
+// value in `lits` over it. see TOK_LIT_INLINE
+#define LIT_INLINE 1u
+
 typedef struct
 {
-  PNodeKind kind;
-  union
+  uint8_t *kind;  // PNodeKind
+  uint32_t *data; // the payload
+  uint32_t *pos;  // offset of the token in the source
+  uint32_t len, cap;
+
+  const uint64_t *lits; // the values of literals, not owned
+  const char *names;    // where symbols point into, not owned
+} PTree;
+
+// number of descendants of a node, i.e. its subtree is [i - size, i]
+static inline uint32_t subtree_size(const PTree *t, uint32_t i)
+{
+  switch (t->kind[i])
   {
-    uint32_t subtree_sz;
-    uint64_t literal_int;
-    StrView str;
-  };
+  case FUN_ARROW:
+  case FUN_END:
+  case EXP_ARGLIST_END:
+  case IMP_ARGLIST_END:
+  case BIND_TY_JUDGE:
+  case BIND_TY_SUBTY:
+  case PREFIX_MINUS:
+  case INFIX_MINUS:
+  case INFIX_PLUS:
+  case STMT_SEMI:       return t->data[i];
+  default:              return 0;
+  }
+}
+
+// does the payload of a node of this kind hold a symbol
+static inline bool has_sym(PNodeKind kind)
+{
+  switch (kind)
+  {
+    PNodeKindMacro(PNodeKindMacroIgnore, PNodeKindMacroIgnore,
+                   PNodeKindMacroSym) return true;
+  default:
+    return false;
+  }
+}
+
+// the name a node with a symbol binds or uses
+static inline StrView sym_str(const PTree *t, uint32_t i)
+{
+  return interned_at(t->names, t->data[i]);
+}
+
+static inline uint64_t lit_val(const PTree *t, uint32_t i)
+{
+  uint32_t d = t->data[i];
+  return d & LIT_INLINE ? d >> 1 : t->lits[d >> 1];
+}
+
+// the nodes from `beg` on as a tree of their own, sharing the columns
+static inline PTree ptree_from(const PTree *t, uint32_t beg)
+{
+  return (PTree){.kind  = t->kind + beg,
+                 .data  = t->data + beg,
+                 .pos   = t->pos + beg,
+                 .len   = t->len - beg,
+                 .lits  = t->lits,
+                 .names = t->names};
+}
+
+// appends a node, returns its index
+uint32_t push_node(PTree *restrict t, PNodeKind kind, uint32_t data,
+                   uint32_t pos);
+
+// appends the `n` nodes of `src` starting at `beg`
+void append_nodes(PTree *restrict t, const PTree *src, uint32_t beg,
+                  uint32_t n);
+
+void free_ptree(PTree t);
+
+typedef struct
+{
   uint32_t pos;
-} PNode;
+  const char *msg; // NULL if there was no error
+} ParseErr;
 
 typedef struct
 {
-  PNode *tree;
+  PTree tree;
   uintptr_t size;
 
+  DynamicArray lits; // uint64_t, the values of the literals of the tree
   HSet names;
+  ParseErr err; // the first syntax error, only the functions before it remain
 } ParseRes;
 
+// room kept in the names of a parse for the names of instances, see mono.h
+#define PARSE_NAMES_SLACK (1u << 20)
+
 [[nodiscard]] ParseRes parse(LexRes lr);
 
-void print_pnode(PNode n);
+void free_parseres(ParseRes pr);
 
 #endif // _PARSER_H_
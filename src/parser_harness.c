@@ -0,0 +1,278 @@
+/*
+ * Fuzzes the front end, from bytes to a parse tree and back to nothing.
+ *
+ *  one file, built three ways:
+ *
+ *    afl-clang-lto     AFL++ persistent mode, run through run_fuzz.sh
+ *    -DFUZZ_LIBFUZZER  libFuzzer entry points, using the grammar mutator
+ *    anything else     a fuzzing loop of its own, without coverage, that
+ *                      mutates the given inputs, keeps the ones that parse
+ *                      further than what they came from and reports
+ *                      execs/s. with -r it only runs the inputs, to replay
+ *                      a crash
+ */
+
+#include "mutator.h"
+#include "parser.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#define __FUNLANG_COMMON_H_IMPL
+#include "common.h"
+
+static DynamicArray input; // char, the input being run, NUL terminated
+
+// lexes and parses `size` bytes and frees it all again, returning the
+// number of nodes of the tree
+static uint32_t run(const uint8_t *data, size_t size)
+{
+  // a copy, so the lexer may look one byte past the end as it does on files
+  input.len = 0;
+  if (size) co_append(&input, (const char *)data, size);
+  co_append(&input, "", 1);
+
+  char *src   = input.buffer;
+  Lexer l     = {.src = src, .cur = src, .end = src + size};
+  LexRes lr   = lex(l);
+  ParseRes pr = parse(lr);
+
+  uint32_t nodes = (uint32_t)pr.size;
+  free_parseres(pr);
+  destroy_lexres(lr);
+
+  return nodes;
+}
+
+static void load_dict(void)
+{
+  const char *path = getenv("FUNLANG_DICT");
+  if (!mutator_load_dict(path ? path : "funlang.dict"))
+    fprintf(stderr, "no dictionary, set FUNLANG_DICT\n");
+}
+
+#if defined(FUZZ_LIBFUZZER)
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  (void)argc;
+  (void)argv;
+  load_dict();
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  (void)run(data, size);
+  return 0;
+}
+
+size_t LLVMFuzzerCustomMutator(uint8_t *data, size_t size, size_t max_size,
+                               unsigned int seed)
+{
+  return mutate(data, size, max_size, seed);
+}
+
+#elif defined(__AFL_FUZZ_TESTCASE_LEN)
+
+__AFL_FUZZ_INIT();
+
+int main(void)
+{
+#ifdef __AFL_HAVE_MANUAL_CONTROL
+  __AFL_INIT();
+#endif
+
+  // must be taken after __AFL_INIT and before __AFL_LOOP
+  unsigned char *buf = __AFL_FUZZ_TESTCASE_BUF;
+
+  while (__AFL_LOOP(100000))
+  {
+    size_t len = (size_t)__AFL_FUZZ_TESTCASE_LEN;
+    (void)run(buf, len);
+  }
+
+  return 0;
+}
+
+#else
+
+#define MAX_INPUT (64u << 10)
+#define MAX_POOL 1024
+#define CRASH_PATH "crash.funlang"
+
+typedef struct
+{
+  DynamicArray src; // uint8_t
+  uint32_t nodes;   // of its tree
+} Entry;
+
+// leaves the input that brought the process down behind
+static void save_input(void)
+{
+  int fd = open(CRASH_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return;
+
+  (void)!write(fd, input.buffer, input.len ? input.len - 1 : 0);
+  (void)close(fd);
+}
+
+static void on_signal(int sig)
+{
+  save_input();
+  (void)signal(sig, SIG_DFL);
+  (void)raise(sig);
+}
+
+// the sanitizers exit without a signal, but call this first
+void __sanitizer_set_death_callback(void (*callback)(void))
+    __attribute__((weak));
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s [-r] [-n execs] [-t seconds] [-s seed] [input...]\n"
+          "  mutates the inputs, the empty input if none are given, and\n"
+          "  runs the lexer and parser on the results. a crashing input is\n"
+          "  written to " CRASH_PATH "\n"
+          "  -r  only run the inputs once each\n"
+          "  -n  stop after this many runs\n"
+          "  -t  stop after this many seconds, defaults to 10\n"
+          "set FUNLANG_DICT to the dictionary, defaults to funlang.dict\n",
+          argv0);
+  exit(1);
+}
+
+// mutates inputs of the pool until `secs` or `max_execs` run out
+static void fuzz(DynamicArray *restrict pool, uint64_t seed, double secs,
+                 uint64_t max_execs)
+{
+  load_dict();
+  if (!pool->len)
+  {
+    Entry e = {};
+    co_push(pool, e);
+  }
+
+  // mutations happen in place, in a buffer with room for the largest input
+  uint8_t *work = malloc(MAX_INPUT);
+  assert(work && "failed to allocate input buffer");
+
+  uint64_t rng = seed, execs = 0, last_execs = 0;
+  uint32_t deepest = 0;
+  double start = now(), last = start;
+
+  printf("seed %lu, %u inputs\n", seed, pool->len);
+
+  while (execs < max_execs)
+  {
+    rng         = rng * 6364136223846793005ull + 1442695040888963407ull;
+    Entry *pick = (Entry *)pool->buffer + (rng >> 33) % pool->len;
+    size_t size = pick->src.len;
+    if (size) memcpy(work, pick->src.buffer, size);
+
+    // a few mutations stacked on top of each other go further
+    for (uint32_t i = 0, n = 1 + (uint32_t)(rng >> 62); i <= n; ++i)
+      size = mutate(work, size, MAX_INPUT, rng + i);
+
+    uint32_t nodes = run(work, size);
+    deepest        = MAX(deepest, nodes);
+    execs++;
+
+    if (nodes > pick->nodes)
+    {
+      Entry e = {.nodes = nodes};
+      co_append(&e.src, work, size);
+
+      if (pool->len < MAX_POOL) co_push(pool, e);
+      else
+      {
+        Entry *old = (Entry *)pool->buffer + (rng >> 40) % pool->len;
+        free(old->src.buffer);
+        *old = e;
+      }
+    }
+
+    if (execs & 0xff) continue;
+
+    double t = now();
+    if (t - last >= 1.0)
+    {
+      printf("%lu execs, %.0f execs/s, %u inputs, deepest %u nodes\n", execs,
+             (double)(execs - last_execs) / (t - last), pool->len, deepest);
+      (void)fflush(stdout);
+      last       = t;
+      last_execs = execs;
+    }
+    if (t - start >= secs) break;
+  }
+
+  double total = now() - start;
+  printf("%lu execs in %.1fs, %.0f execs/s\n", execs, total,
+         (double)execs / total);
+
+  free(work);
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t max_execs = UINT64_MAX, seed = (uint64_t)time(NULL);
+  double secs        = 10.0;
+  bool replay        = false;
+  int argi           = 1;
+
+  for (; argi < argc && argv[argi][0] == '-'; ++argi)
+  {
+    if (!strcmp(argv[argi], "-r")) replay = true;
+    else if (argi + 1 >= argc) usage(argv[0]);
+    else if (!strcmp(argv[argi], "-n"))
+      max_execs = strtoull(argv[++argi], NULL, 0);
+    else if (!strcmp(argv[argi], "-t")) secs = strtod(argv[++argi], NULL);
+    else if (!strcmp(argv[argi], "-s")) seed = strtoull(argv[++argi], NULL, 0);
+    else usage(argv[0]);
+  }
+
+  (void)signal(SIGABRT, on_signal);
+  (void)signal(SIGSEGV, on_signal);
+  (void)signal(SIGFPE, on_signal);
+  if (__sanitizer_set_death_callback)
+    __sanitizer_set_death_callback(save_input);
+
+  DynamicArray pool = {}; // Entry
+  for (; argi < argc; ++argi)
+  {
+    FILE *f = fopen(argv[argi], "rb");
+    if (!f)
+    {
+      perror(argv[argi]);
+      continue;
+    }
+
+    Entry e = {};
+    uint8_t chunk[4096];
+    for (size_t n; (n = fread(chunk, 1, sizeof(chunk), f));)
+      co_append(&e.src, chunk, MIN(n, MAX_INPUT - e.src.len));
+    (void)fclose(f);
+
+    e.nodes = run(e.src.buffer, e.src.len);
+    co_push(&pool, e);
+  }
+
+  if (!replay) fuzz(&pool, seed, secs, max_execs);
+
+  for (Entry *e = pool.buffer; e < (Entry *)pool.buffer + pool.len; ++e)
+    free(e->src.buffer);
+  free(pool.buffer);
+  free(input.buffer);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Hardware counters around the phases of the compiler, see perf.h.
+ *
+ *  every thread opens its own group of counters on first use and reads all
+ *  of them with a single read. phase totals are summed atomically, the
+ *  counts of single functions are kept in a list behind a lock, since they
+ *  are only taken when asked for.
+ */
+
+#include "perf.h"
+
+#ifdef FUNLANG_PERF
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define PerfPhaseMacroName(V, S) [V] = S,
+
+static const char *phase_names[] = {PerfPhaseMacro(PerfPhaseMacroName)};
+
+static const struct
+{
+  const char *name;
+  uint64_t config;
+} counters[PERF_COUNTERS] = {
+    {"cycles", PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch_misses", PERF_COUNT_HW_BRANCH_MISSES},
+    {"llc_misses", PERF_COUNT_HW_CACHE_MISSES},
+};
+
+typedef struct
+{
+  char *name;
+  PerfPhase phase;
+  PerfCount count;
+} PerfFn;
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static bool json, fns;
+
+// the last column counts how often the phase ran
+static _Atomic uint64_t totals[PERF_PHASES][PERF_COUNTERS + 1];
+static atomic_bool opened, failed;
+
+static pthread_mutex_t fn_lock = PTHREAD_MUTEX_INITIALIZER;
+static DynamicArray fn_counts; // PerfFn
+
+// the group leader of the thread plus one, -1 once opening it failed
+static _Thread_local int group;
+// which counter each value read belongs to, as some may be missing
+static _Thread_local uint8_t slots[PERF_COUNTERS];
+
+static void report(void);
+
+static void setup(void)
+{
+  const char *env = getenv("FUNLANG_PERF");
+  json            = env && strstr(env, "json");
+  fns             = env && strstr(env, "fns");
+
+  (void)atexit(report);
+}
+
+static int open_counter(uint32_t counter, int leader)
+{
+  struct perf_event_attr attr = {
+      .type           = PERF_TYPE_HARDWARE,
+      .size           = sizeof(attr),
+      .config         = counters[counter].config,
+      .read_format    = PERF_FORMAT_GROUP,
+      .exclude_kernel = 1,
+      .exclude_hv     = 1,
+  };
+
+  // only the calling thread is counted, on whatever cpu it runs
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+static void open_group(void)
+{
+  int leader = open_counter(0, -1);
+  if (leader < 0)
+  {
+    group = -1;
+    atomic_store(&failed, true);
+    return;
+  }
+
+  uint8_t n = 1;
+  for (uint32_t i = 1; i < PERF_COUNTERS; ++i)
+    if (open_counter(i, leader) >= 0) slots[n++] = (uint8_t)i;
+
+  group = leader + 1;
+  atomic_store(&opened, true);
+}
+
+bool perf_fns(void)
+{
+  (void)pthread_once(&once, setup);
+  return fns;
+}
+
+PerfCount perf_read(void)
+{
+  (void)pthread_once(&once, setup);
+  if (!group) open_group();
+
+  PerfCount c = {};
+  if (group < 0) return c;
+
+  uint64_t buf[1 + PERF_COUNTERS]; // the number of values, then the values
+  if (read(group - 1, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) return c;
+
+  for (uint64_t i = 0; i < MIN(buf[0], PERF_COUNTERS); ++i)
+    c.v[slots[i]] = buf[1 + i];
+
+  return c;
+}
+
+void perf_add(PerfPhase phase, PerfCount start, StrView fn)
+{
+  PerfCount c = perf_read();
+  for (uint32_t i = 0; i < PERF_COUNTERS; ++i)
+    c.v[i] -= start.v[i];
+
+  if (fn.len)
+  {
+    PerfFn f = {.name = strndup(fn.txt, fn.len), .phase = phase, .count = c};
+    pthread_mutex_lock(&fn_lock);
+    co_push(&fn_counts, f);
+    pthread_mutex_unlock(&fn_lock);
+    return;
+  }
+
+  for (uint32_t i = 0; i < PERF_COUNTERS; ++i)
+    atomic_fetch_add_explicit(&totals[phase][i], c.v[i], memory_order_relaxed);
+  atomic_fetch_add_explicit(&totals[phase][PERF_COUNTERS], 1,
+                            memory_order_relaxed);
+}
+
+static double ipc(const uint64_t *v)
+{
+  return v[0] ? (double)v[1] / (double)v[0] : 0.0;
+}
+
+static int by_cycles(const void *a, const void *b)
+{
+  uint64_t x = ((const PerfFn *)a)->count.v[0];
+  uint64_t y = ((const PerfFn *)b)->count.v[0];
+  return (x < y) - (x > y);
+}
+
+// the functions that took the most cycles in the table
+#define TOP_FNS 20
+
+static void print_json(const PerfFn *f, uint32_t nfns)
+{
+  fprintf(stderr, "{\"phases\": [");
+  for (PerfPhase p = 0; p < PERF_PHASES; ++p)
+  {
+    uint64_t v[PERF_COUNTERS + 1];
+    for (uint32_t i = 0; i <= PERF_COUNTERS; ++i)
+      v[i] = atomic_load(&totals[p][i]);
+
+    fprintf(stderr, "%s{\"phase\": \"%s\", \"runs\": %lu", p ? ", " : "",
+            phase_names[p], v[PERF_COUNTERS]);
+    for (uint32_t i = 0; i < PERF_COUNTERS; ++i)
+      fprintf(stderr, ", \"%s\": %lu", counters[i].name, v[i]);
+    fprintf(stderr, ", \"ipc\": %.3f}", ipc(v));
+  }
+
+  fprintf(stderr, "], \"fns\": [");
+  for (uint32_t j = 0; j < nfns; ++j)
+  {
+    // names are identifiers, nothing in them needs escaping
+    fprintf(stderr, "%s{\"fn\": \"%s\", \"phase\": \"%s\"", j ? ", " : "",
+            f[j].name, phase_names[f[j].phase]);
+    for (uint32_t i = 0; i < PERF_COUNTERS; ++i)
+      fprintf(stderr, ", \"%s\": %lu", counters[i].name, f[j].count.v[i]);
+    fprintf(stderr, ", \"ipc\": %.3f}", ipc(f[j].count.v));
+  }
+  fprintf(stderr, "]}\n");
+}
+
+static void print_row(const char *name, const char *phase, const uint64_t *v)
+{
+  fprintf(stderr, "%-24.24s %-8s %14lu %14lu %5.2f %12lu %12lu\n", name, phase,
+          v[0], v[1], ipc(v), v[2], v[3]);
+}
+
+static void print_table(const PerfFn *f, uint32_t nfns)
+{
+  fprintf(stderr, "%-24s %-8s %14s %14s %5s %12s %12s\n", "phase", "runs",
+          "cycles", "instructions", "ipc", "branch-miss", "llc-miss");
+
+  for (PerfPhase p = 0; p < PERF_PHASES; ++p)
+  {
+    uint64_t v[PERF_COUNTERS + 1];
+    for (uint32_t i = 0; i <= PERF_COUNTERS; ++i)
+      v[i] = atomic_load(&totals[p][i]);
+    if (!v[PERF_COUNTERS]) continue;
+
+    char runs[24];
+    (void)snprintf(runs, sizeof(runs), "%lu", v[PERF_COUNTERS]);
+    print_row(phase_names[p], runs, v);
+  }
+
+  if (!nfns) return;
+
+  fprintf(stderr, "\n%-24s %-8s\n", "function", "phase");
+  for (uint32_t j = 0; j < MIN(nfns, TOP_FNS); ++j)
+    print_row(f[j].name, phase_names[f[j].phase], f[j].count.v);
+  if (nfns > TOP_FNS) fprintf(stderr, "... %u more\n", nfns - TOP_FNS);
+}
+
+static void report(void)
+{
+  if (!atomic_load(&opened))
+  {
+    if (atomic_load(&failed))
+      fprintf(stderr, "perf: can't open the hardware counters, see "
+                      "/proc/sys/kernel/perf_event_paranoid\n");
+    return;
+  }
+
+  PerfFn *f     = fn_counts.buffer;
+  uint32_t nfns = fn_counts.len;
+  if (nfns) qsort(f, nfns, sizeof(PerfFn), by_cycles);
+
+  if (json) print_json(f, nfns);
+  else print_table(f, nfns);
+
+  for (uint32_t j = 0; j < nfns; ++j)
+    free(f[j].name);
+  free(f);
+}
+
+#endif // FUNLANG_PERF
@@ -0,0 +1,71 @@
+#ifndef _PERF_H
+#define _PERF_H
+
+#include "common.h"
+
+/*
+ * Hardware counters around the phases of the compiler.
+ *
+ *  only built in with -DFUNLANG_PERF (make PERF=1 after a clean), otherwise
+ *  the macros below expand to nothing. cycles, instructions, branch misses
+ *  and last level cache misses are counted for the calling thread, summed
+ *  per phase and printed to stderr at exit. the FUNLANG_PERF environment
+ *  variable takes a comma separated list of
+ *
+ *    json  print JSON instead of a table
+ *    fns   also count every function on its own in check and lower
+ */
+
+#define PerfPhaseMacro(X)                                                      \
+  X(PERF_LEX, "lex")                                                           \
+  X(PERF_PARSE, "parse")                                                       \
+  X(PERF_RESOLVE, "resolve")                                                   \
+  X(PERF_CHECK, "check")                                                       \
+  X(PERF_LOWER, "lower")                                                       \
+  X(PERF_FOLD, "fold")                                                         \
+  X(PERF_RANGE, "range")                                                       \
+  X(PERF_DCE, "dce")                                                           \
+  X(PERF_FMT, "fmt")
+
+#define PerfPhaseMacroDeclare(V, ...) V,
+
+typedef enum
+{
+  PerfPhaseMacro(PerfPhaseMacroDeclare) PERF_PHASES
+} PerfPhase;
+
+#ifdef FUNLANG_PERF
+
+#define PERF_COUNTERS 4
+
+typedef struct
+{
+  uint64_t v[PERF_COUNTERS]; // cycles, instructions, branch and LLC misses
+} PerfCount;
+
+// the counters of the calling thread so far, all 0 if they can't be opened
+[[nodiscard]] PerfCount perf_read(void);
+
+// charges what was counted since `start` to `phase`, or with a non empty `fn`
+// to that function within `phase` only
+void perf_add(PerfPhase phase, PerfCount start, StrView fn);
+
+// whether functions are counted on their own
+[[nodiscard]] bool perf_fns(void);
+
+#define PERF_BEGIN(c) PerfCount c = perf_read()
+#define PERF_END(phase, c) perf_add(phase, c, (StrView){})
+#define PERF_BEGIN_FN(c) PerfCount c = perf_fns() ? perf_read() : (PerfCount){}
+#define PERF_END_FN(phase, c, fn)                                              \
+  if (perf_fns()) perf_add(phase, c, fn)
+
+#else
+
+#define PERF_BEGIN(c)
+#define PERF_END(phase, c)
+#define PERF_BEGIN_FN(c)
+#define PERF_END_FN(phase, c, fn)
+
+#endif // FUNLANG_PERF
+
+#endif // _PERF_H
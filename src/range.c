@@ -0,0 +1,142 @@
+/*
+ * Range analysis, see range.h.
+ *
+ *  functions are straight line code, so a single forward sweep computes the
+ *  range of every value from those of its operands. a comparison narrows
+ *  the ranges of its operands in place, since every instruction after it
+ *  only runs if it held.
+ *
+ *  a checked operation that may overflow either traps or produces a value
+ *  of its type, so its range is the exact one clamped to the type. a
+ *  wrapping one that may overflow can produce anything.
+ */
+
+#include "range.h"
+#include "perf.h"
+
+typedef struct
+{
+  uint64_t lo, hi; // inclusive, in the canonical form of the type
+} Range;
+
+static bool lt(TypeId ty, uint64_t a, uint64_t b)
+{
+  return inbuilt_signed(ty) ? (int64_t)a < (int64_t)b : a < b;
+}
+
+static Range full(TypeId ty)
+{
+  uint32_t bits = inbuilt_bits(ty);
+  if (!inbuilt_signed(ty))
+    return (Range){.lo = 0, .hi = UINT64_MAX >> (64 - bits)};
+
+  uint64_t max = UINT64_MAX >> (65 - bits);
+  return (Range){.lo = ~max, .hi = max};
+}
+
+// the range of `a + b`, `over` is set if the sum may overflow
+static Range add_range(TypeId ty, Range a, Range b, bool *restrict over)
+{
+  Range r, f = full(ty);
+  bool lo = add_overflows(a.lo, b.lo, ty, &r.lo);
+  bool hi = add_overflows(a.hi, b.hi, ty, &r.hi);
+
+  // the lower bound only overflows upwards if the upper one does too
+  if (lo) r.lo = f.lo;
+  if (hi) r.hi = f.hi;
+
+  *over = lo || hi;
+  return r;
+}
+
+// the range of `-a`, `over` is set if the negation may overflow
+static Range neg_range(TypeId ty, Range a, bool *restrict over)
+{
+  Range r, f = full(ty);
+  bool lo = neg_overflows(a.hi, ty, &r.lo);
+  bool hi = neg_overflows(a.lo, ty, &r.hi);
+  *over   = lo || hi;
+
+  // unsigned negation only keeps the order among nonzero values
+  if (!inbuilt_signed(ty)) return a.lo || !a.hi ? r : f;
+
+  if (lo) r.lo = f.lo;
+  if (hi) r.hi = f.hi;
+  return r;
+}
+
+// narrows the ranges of `a` and `b` to where `a < b`, unless it never holds
+static void narrow(TypeId ty, Range *restrict a, Range *restrict b)
+{
+  if (!lt(ty, a->lo, b->hi)) return;
+
+  if (!lt(ty, a->hi, b->hi)) a->hi = b->hi - 1;
+  if (!lt(ty, a->lo, b->lo)) b->lo = a->lo + 1;
+}
+
+static void relax(IR *restrict ir, uint32_t v, IROp op,
+                  uint32_t *restrict relaxed)
+{
+  if (ir->op[v] == op) return;
+
+  ir->op[v] = (uint8_t)op;
+  ++*relaxed;
+}
+
+uint32_t relax_checks(IR *restrict ir)
+{
+  PERF_BEGIN(perf);
+
+  Range *rng = malloc(ir->len * sizeof(Range) + 1);
+  assert(rng && "failed to allocate ranges");
+
+  const IRFunc *funcs   = ir->funcs.buffer;
+  const IRBlock *blocks = ir->blocks.buffer;
+
+  uint32_t relaxed = 0;
+  for (uint32_t fn = 0; fn < ir->funcs.len; ++fn)
+    for (uint32_t bl = funcs[fn].blk_beg; bl < funcs[fn].blk_end; ++bl)
+      for (uint32_t v = blocks[bl].beg; v < blocks[bl].end; ++v)
+      {
+        TypeId ty  = ir->ty[v];
+        uint32_t a = ir->a[v], b = ir->b[v];
+        bool over;
+
+        switch (ir->op[v])
+        {
+        case IR_PARAM: rng[v] = full(ty); break;
+        case IR_CONST:
+          rng[v] = (Range){.lo = ir_const(ir, v), .hi = ir_const(ir, v)};
+          break;
+        case IR_NEG:
+        case IR_NEGC:
+        case IR_NEGX:
+          rng[v] = neg_range(ty, rng[a], &over);
+          if (!over) relax(ir, v, IR_NEGX, &relaxed);
+          else if (ir->op[v] != IR_NEGC) rng[v] = full(ty);
+          break;
+        case IR_ADD:
+        case IR_ADDC:
+        case IR_ADDX:
+          rng[v] = add_range(ty, rng[a], rng[b], &over);
+          if (!over) relax(ir, v, IR_ADDX, &relaxed);
+          else if (ir->op[v] != IR_ADDC) rng[v] = full(ty);
+          break;
+        case IR_ASSERT:
+          if (lt(ty, rng[a].hi, rng[b].lo)) relax(ir, v, IR_NOP, &relaxed);
+          if (a != b) narrow(ty, rng + a, rng + b);
+          break;
+        case IR_ASSUME:
+          if (a != b) narrow(ty, rng + a, rng + b);
+          relax(ir, v, IR_NOP, &relaxed);
+          break;
+        default: break;
+        }
+      }
+
+  free(rng);
+
+  PERF_END(PERF_RANGE, perf);
+
+  return relaxed;
+}
@@ -0,0 +1,22 @@
+#ifndef _RANGE_H
+#define _RANGE_H
+
+#include "ir.h"
+
+/*
+ * Value ranges, and relaxing the checks they make redundant.
+ *
+ *  the range of a value is an interval of its type, starting out as the
+ *  whole type for parameters and as the value itself for constants. `ass`
+ *  and `asu` statements narrow the ranges of the values they compare, for
+ *  everything after them. an operation whose operands are in ranges that
+ *  can't make it overflow becomes the exact one, which neither checks nor
+ *  wraps, and an assertion that always holds goes away.
+ */
+
+// turns every operation that can't overflow into the exact one, and every
+// assertion that can't fail and every assumption into a NOP. returns the
+// number of relaxed instructions
+uint32_t relax_checks(IR *restrict ir);
+
+#endif // _RANGE_H
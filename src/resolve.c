@@ -0,0 +1,101 @@
+/*
+ * Name resolution.
+ *
+ *  a single forward walk over the postorder tree, keeping every binding that
+ *  is in scope on one flat stack. scopes are delimited by marker entries
+ *  instead of having a table per scope, and since equal names have equal
+ *  symbols, a lookup is a backwards scan comparing integers.
+ */
+
+#include "resolve.h"
+#include "perf.h"
+
+typedef struct
+{
+  uint32_t sym; // 0 for a scope marker, no name starts the intern region
+  uint32_t node;
+} ScopeEntry;
+
+static void bind(DynamicArray *restrict scopes, const PTree *tree,
+                 uint32_t node)
+{
+  ScopeEntry e = {.sym = tree->data[node], .node = node};
+  co_push(scopes, e);
+}
+
+static void open_scope(DynamicArray *restrict scopes)
+{
+  ScopeEntry marker = {};
+  co_push(scopes, marker);
+}
+
+static void close_scope(DynamicArray *restrict scopes)
+{
+  ScopeEntry *ents = scopes->buffer;
+
+  while (scopes->len && ents[--scopes->len].sym)
+    ;
+}
+
+static uint32_t lookup(const DynamicArray *restrict scopes, uint32_t sym)
+{
+  const ScopeEntry *ents = scopes->buffer;
+
+  for (uint32_t i = scopes->len; i-- > 0;)
+    if (ents[i].sym == sym) return ents[i].node;
+
+  return RES_UNBOUND;
+}
+
+Resolution resolve(const PTree *tree, uint32_t size)
+{
+  PERF_BEGIN(perf);
+
+  Resolution res = {.binding = malloc(size * sizeof(uint32_t))};
+  assert((res.binding || !size) && "failed to allocate binding array");
+  memset(res.binding, 0xff, size * sizeof(uint32_t));
+
+  DynamicArray scopes = {};
+
+  // a let binding only comes into scope after its initializer
+  uint32_t pending = RES_UNBOUND;
+  PNodeKind prev   = INVALID;
+
+  for (uint32_t i = 0; i < size; prev = tree->kind[i++])
+  {
+    switch (tree->kind[i])
+    {
+    case BIND_NAME:
+      if (prev == FUN_INT)
+      { // function names live in the file scope
+        bind(&scopes, tree, i);
+        open_scope(&scopes);
+      }
+      else if (prev == STMT_LET_BIND) { pending = i; }
+      else { bind(&scopes, tree, i); }
+      break;
+    case BIND_TY_NAME: bind(&scopes, tree, i); break;
+    case STMT_SEMI:
+      if (pending == RES_UNBOUND) break;
+
+      bind(&scopes, tree, pending);
+      pending = RES_UNBOUND;
+      break;
+    case BIND_USE:
+    case BIND_TY_USE:
+      res.binding[i] = lookup(&scopes, tree->data[i]);
+      res.unbound += res.binding[i] == RES_UNBOUND;
+      break;
+    case FUN_END: close_scope(&scopes); break;
+    default:      break;
+    }
+  }
+
+  free(scopes.buffer);
+
+  PERF_END(PERF_RESOLVE, perf);
+
+  return res;
+}
+
+void free_resolution(Resolution r) { free(r.binding); }
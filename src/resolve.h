@@ -0,0 +1,19 @@
+#ifndef _RESOLVE_H
+#define _RESOLVE_H
+
+#include "parser.h"
+
+#define RES_UNBOUND UINT32_MAX
+
+typedef struct
+{
+  // for every BIND_USE and BIND_TY_USE the index of the node that binds it,
+  // RES_UNBOUND for every other node and for uses that don't resolve
+  uint32_t *binding;
+  uint32_t unbound; // number of uses that didn't resolve
+} Resolution;
+
+[[nodiscard]] Resolution resolve(const PTree *tree, uint32_t size);
+void free_resolution(Resolution r);
+
+#endif // _RESOLVE_H
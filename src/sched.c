@@ -0,0 +1,129 @@
+#include "sched.h"
+
+// jobs only ever take the lock briefly, the work itself runs outside of it
+static void *worker(void *arg)
+{
+  Sched *s = arg;
+
+  pthread_mutex_lock(&s->lock);
+  for (;;)
+  {
+    while (!s->ready.len && !s->quit)
+      pthread_cond_wait(&s->ready_cv, &s->lock);
+    if (!s->ready.len) break;
+
+    uint32_t id;
+    co_pop(&s->ready, &id);
+    Job job = ((Job *)s->jobs.buffer)[id];
+
+    pthread_mutex_unlock(&s->lock);
+    job.fn(job.arg);
+    pthread_mutex_lock(&s->lock);
+
+    // the job array may have moved while the job ran
+    Job *j  = (Job *)s->jobs.buffer + id;
+    j->done = true;
+
+    uint32_t *next = j->next.buffer;
+    for (uint32_t *n = next; n < next + j->next.len; ++n)
+    {
+      Job *dep = (Job *)s->jobs.buffer + *n;
+      if (--dep->waiting) continue;
+
+      co_push(&s->ready, *n);
+      pthread_cond_signal(&s->ready_cv);
+    }
+
+    if (!--s->pending) pthread_cond_broadcast(&s->idle_cv);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  return NULL;
+}
+
+void init_sched(Sched *restrict s, uint32_t nthreads)
+{
+  *s = (Sched){.nthreads = nthreads};
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->ready_cv, NULL);
+  pthread_cond_init(&s->idle_cv, NULL);
+
+  s->threads = malloc(nthreads * sizeof(pthread_t));
+  assert(s->threads && "failed to allocate threads");
+
+  for (uint32_t t = 0; t < nthreads; ++t)
+  {
+    int err = pthread_create(s->threads + t, NULL, worker, s);
+    assert(!err && "failed to start worker");
+  }
+}
+
+uint32_t sched_job(Sched *restrict s, JobFn fn, void *arg)
+{
+  Job j = {.fn = fn, .arg = arg, .waiting = 1};
+
+  pthread_mutex_lock(&s->lock);
+  uint32_t id = co_push(&s->jobs, j);
+  pthread_mutex_unlock(&s->lock);
+
+  return id;
+}
+
+void sched_edge(Sched *restrict s, uint32_t before, uint32_t after)
+{
+  pthread_mutex_lock(&s->lock);
+
+  Job *jobs = s->jobs.buffer;
+  if (!jobs[before].done)
+  {
+    jobs[after].waiting++;
+    co_push(&jobs[before].next, after);
+  }
+
+  pthread_mutex_unlock(&s->lock);
+}
+
+void sched_submit(Sched *restrict s, uint32_t job)
+{
+  pthread_mutex_lock(&s->lock);
+
+  s->pending++;
+  if (!--((Job *)s->jobs.buffer)[job].waiting)
+  {
+    co_push(&s->ready, job);
+    pthread_cond_signal(&s->ready_cv);
+  }
+
+  pthread_mutex_unlock(&s->lock);
+}
+
+void sched_wait(Sched *restrict s)
+{
+  pthread_mutex_lock(&s->lock);
+  while (s->pending)
+    pthread_cond_wait(&s->idle_cv, &s->lock);
+  pthread_mutex_unlock(&s->lock);
+}
+
+void free_sched(Sched *restrict s)
+{
+  pthread_mutex_lock(&s->lock);
+  s->quit = true;
+  pthread_cond_broadcast(&s->ready_cv);
+  pthread_mutex_unlock(&s->lock);
+
+  for (uint32_t t = 0; t < s->nthreads; ++t)
+    pthread_join(s->threads[t], NULL);
+
+  for (Job *j = s->jobs.buffer; j < (Job *)s->jobs.buffer + s->jobs.len; ++j)
+    free(j->next.buffer);
+
+  free(s->jobs.buffer);
+  free(s->ready.buffer);
+  free(s->threads);
+
+  pthread_cond_destroy(&s->ready_cv);
+  pthread_cond_destroy(&s->idle_cv);
+  pthread_mutex_destroy(&s->lock);
+}
@@ -0,0 +1,55 @@
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include "common.h"
+#include <pthread.h>
+
+typedef void (*JobFn)(void *arg);
+
+typedef struct
+{
+  JobFn fn;
+  void *arg;
+  uint32_t waiting; // unfinished dependencies, plus one until submitted
+  bool done;
+  DynamicArray next; // uint32_t, jobs waiting on this one
+} Job;
+
+/*
+ * A thread pool running a graph of jobs.
+ *
+ *  jobs are created, wired up with edges and then submitted. a job runs once
+ *  it's submitted and everything it depends on has finished. ready jobs are
+ *  taken newest first, so the jobs a finished job just unblocked run next,
+ *  while their inputs are still warm.
+ */
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t ready_cv, idle_cv;
+
+  DynamicArray jobs;  // Job
+  DynamicArray ready; // uint32_t
+  uint32_t pending;   // submitted but not finished
+  bool quit;
+
+  pthread_t *threads;
+  uint32_t nthreads;
+} Sched;
+
+// starts `nthreads` workers, the scheduler must not move afterwards
+void init_sched(Sched *restrict s, uint32_t nthreads);
+
+[[nodiscard]] uint32_t sched_job(Sched *restrict s, JobFn fn, void *arg);
+
+// `after` won't start before `before` finished
+void sched_edge(Sched *restrict s, uint32_t before, uint32_t after);
+
+void sched_submit(Sched *restrict s, uint32_t job);
+
+// waits until every submitted job finished
+void sched_wait(Sched *restrict s);
+
+void free_sched(Sched *restrict s);
+
+#endif // _SCHED_H
@@ -0,0 +1,144 @@
+/*
+ * Chrome trace events, see trace.h.
+ *
+ *  a thread's buffer is pushed onto a lock free list the first time it
+ *  records something. events are stamped with the timestamp counter, which
+ *  is turned into microseconds when writing, against the clock readings
+ *  taken at the start and the end.
+ */
+
+#include "trace.h"
+#include <stdatomic.h>
+#include <time.h>
+#include <x86intrin.h>
+
+typedef struct
+{
+  uint64_t tsc;
+  const char *name, *file; // name is NULL for the end of a span
+} TraceEvent;
+
+typedef struct TraceBuf
+{
+  DynamicArray events; // TraceEvent
+  uint32_t tid;
+  struct TraceBuf *next;
+} TraceBuf;
+
+static atomic_bool on;
+static _Atomic(TraceBuf *) bufs;
+static atomic_uint ntids;
+
+static uint64_t start_tsc;
+static struct timespec start_time;
+
+static _Thread_local TraceBuf *local;
+
+void trace_start(void)
+{
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  start_tsc = __rdtsc();
+  atomic_store(&on, true);
+}
+
+static void record(const char *name, const char *file)
+{
+  if (!atomic_load_explicit(&on, memory_order_relaxed)) return;
+
+  TraceBuf *b = local;
+  if (!b)
+  {
+    b = local = calloc(1, sizeof(TraceBuf));
+    assert(b && "failed to allocate trace buffer");
+
+    b->tid  = atomic_fetch_add(&ntids, 1) + 1;
+    b->next = atomic_load(&bufs);
+    while (!atomic_compare_exchange_weak(&bufs, &b->next, b))
+      ;
+  }
+
+  TraceEvent e = {.tsc = __rdtsc(), .name = name, .file = file};
+  co_push(&b->events, e);
+}
+
+void trace_begin(const char *name, const char *file) { record(name, file); }
+
+void trace_end(void) { record(NULL, NULL); }
+
+static void put_json_str(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (; *s; ++s)
+  {
+    if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+    else fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+bool trace_write(const char *path)
+{
+  struct timespec end_time;
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  uint64_t end_tsc = __rdtsc();
+  atomic_store(&on, false);
+
+  double secs = (double)(end_time.tv_sec - start_time.tv_sec) +
+                (double)(end_time.tv_nsec - start_time.tv_nsec) * 1e-9;
+  double us_per_tick =
+      end_tsc > start_tsc ? secs * 1e6 / (double)(end_tsc - start_tsc) : 0.0;
+
+  FILE *f = fopen(path, "w");
+
+  if (f) fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+  bool first = true;
+  for (TraceBuf *b = atomic_exchange(&bufs, NULL), *next; b; b = next)
+  {
+    next = b->next;
+
+    if (f)
+    {
+      fprintf(f,
+              "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+              "\"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+              first ? "" : ",\n", b->tid, b->tid);
+      first = false;
+    }
+
+    const TraceEvent *e = b->events.buffer;
+    for (uint32_t i = 0; f && i < b->events.len; ++i)
+    {
+      double ts = (double)(e[i].tsc - start_tsc) * us_per_tick;
+
+      // an end closes the innermost span, it needs no name
+      if (!e[i].name)
+      {
+        fprintf(f, ",\n{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u}",
+                ts, b->tid);
+        continue;
+      }
+
+      fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"B\", \"ts\": %.3f, "
+                 "\"pid\": 1, \"tid\": %u",
+              e[i].name, ts, b->tid);
+      if (e[i].file)
+      {
+        fprintf(f, ", \"args\": {\"file\": ");
+        put_json_str(f, e[i].file);
+        fputc('}', f);
+      }
+      fputc('}', f);
+    }
+
+    free(b->events.buffer);
+    free(b);
+  }
+
+  local = NULL;
+
+  if (!f) return false;
+  fprintf(f, "\n]}\n");
+  return !fclose(f);
+}
@@ -0,0 +1,29 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "common.h"
+
+/*
+ * A timeline of what every thread did, as Chrome trace events.
+ *
+ *  each thread appends to its own buffer, so recording an event takes a
+ *  timestamp counter read and a push, without any locking. the buffers are
+ *  only read by `trace_write`, once all threads are done. the result loads
+ *  in chrome://tracing or ui.perfetto.dev.
+ */
+
+// starts recording, events before this are dropped
+void trace_start(void);
+
+// opens a span named `name` on the calling thread. `file` may be NULL, both
+// must live until `trace_write`
+void trace_begin(const char *name, const char *file);
+
+// closes the innermost open span of the calling thread
+void trace_end(void);
+
+// stops recording and writes every event to `path`, returning false if that
+// fails. no thread may record anything concurrently
+[[nodiscard]] bool trace_write(const char *path);
+
+#endif // _TRACE_H
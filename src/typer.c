@@ -1,5 +1,10 @@
 #include "typer.h"
-#include "parser.h"
+#include "dump.h"
+#include "front.h"
+#include "live.h"
+#include "opt.h"
+#include "range.h"
+#include "resolve.h"
 #include <stdio.h>
 #define __FUNLANG_COMMON_H_IMPL
 #include "common.h"
@@ -8,39 +13,66 @@ int main(int argc, char **argv)
 {
   assert(argc > 1);
 
-  FILE *f = fopen(argv[1], "rb");
-  (void)fseek(f, 0, SEEK_END);
-  size_t fsize = (size_t)ftell(f);
-  (void)fseek(f, 0, SEEK_SET); /* same as rewind(f); */
+  size_t fsize;
+  char *string = read_file(argv[1], &fsize);
+  assert(string);
 
-  char *string = malloc(fsize + 1);
-  (void)fread(string, fsize, 1, f);
-  (void)fclose(f);
+  // FUNLANG_CACHE names a directory to keep parses of unchanged files in
+  const char *cache = getenv("FUNLANG_CACHE");
+  // the tokens and the tree are too many for a printf each
+  DumpBuf *dump = dump_open(stdout);
 
-  string[fsize] = 0;
-
-  Lexer l = {.src = string, .cur = string, .end = string + fsize};
-  LexRes lr = lex(l);
+  ParseRes parseres;
+  if (cache && cache_load(cache, string, fsize, &parseres))
+    printf("loaded %lu nodes from the cache\n", parseres.size);
+  else
+  {
+    Lexer l   = {.src = string, .cur = string, .end = string + fsize};
+    LexRes lr = lex(l);
 
-  free(string);
+    printf("found %lu tokens\n", lr.tkeptr - lr.tokens);
+    dump_tokens(dump, lr.tokens, (uint32_t)(lr.tkeptr - lr.tokens));
+    dump_str(dump, "\n", 1);
+    dump_flush(dump);
+    parseres = parse(lr);
+    destroy_lexres(lr);
 
-  printf("found %lu tokens\n", lr.tkeptr - lr.tokens);
-  for (Token *tok = lr.tokens; tok < lr.tkeptr; ++tok)
-  {
-    printf("0x%x ", tok->tag & 0xff);
+    if (cache) cache_store(cache, string, fsize, &parseres);
   }
-  printf("\n");
-  ParseRes parseres = parse(lr);
-  destroy_lexres(lr);
 
-  for (uintptr_t i = 0; i< parseres.size; ++i)
+  Lines lines = lines_of(argv[1], string, (uint32_t)fsize);
+  if (parseres.err.msg)
   {
-    print_pnode(parseres.tree[i]);
-    (void)putchar(0xa);
+    print_pos(stdout, &lines, parseres.err.pos);
+    printf(": %s\n", parseres.err.msg);
   }
 
-  free(parseres.tree);
-  free_hset(parseres.names);
+  Resolution res = resolve(&parseres.tree, (uint32_t)parseres.size);
+
+  dump_tree(dump, &parseres.tree, (uint32_t)parseres.size, res.binding);
+  dump_close(dump);
+  printf("%u unresolved names\n", res.unbound);
+
+  Typing typing = check(&parseres.tree, (uint32_t)parseres.size, &res);
+  for (CheckErr *e = typing.errs.buffer;
+       e < (CheckErr *)typing.errs.buffer + typing.errs.len; ++e)
+    report_node(stdout, &lines, &parseres.tree, e->node,
+                (StrView){.txt = e->msg, .len = (uint32_t)strlen(e->msg)});
+
+  IR ir = {};
+  lower(&ir, &parseres.tree, (uint32_t)parseres.size, &res, &typing);
+  uint32_t folded = fold_and_number(&ir);
+  printf("folded or merged %u instructions\n", folded);
+  printf("relaxed %u checks\n", relax_checks(&ir));
+  printf("removed %u dead instructions\n", eliminate_dead(&ir));
+  print_ir(&ir);
+
+  free_ir(ir);
+  free_typing(typing);
+  free_resolution(res);
+  free_parseres(parseres);
+  free_lines(lines);
+  free(string);
 
   return 0;
 }
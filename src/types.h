@@ -10,7 +10,87 @@ typedef enum
   S32 = TOK_KW_S32, S64 = TOK_KW_S64,
 } InbuiltType;
 
+// the type of a node, either an InbuiltType or one of the below
+typedef uint8_t TypeId;
 
+#define TY_NONE 0x00    /* not a value, or not (successfully) typed */
+#define TY_UNTYPED 0x01 /* an integer literal that isn't settled yet */
 
+static inline const char *inbuilt_name(InbuiltType ty)
+{
+  switch (ty)
+  {
+  case U8:  return "u8";
+  case U16: return "u16";
+  case U32: return "u32";
+  case U64: return "u64";
+  case S8:  return "s8";
+  case S16: return "s16";
+  case S32: return "s32";
+  case S64: return "s64";
+  }
+  return "?";
+}
+
+static inline uint32_t inbuilt_bits(InbuiltType ty)
+{
+  switch (ty)
+  {
+  case U8:
+  case S8:  return 8;
+  case U16:
+  case S16: return 16;
+  case U32:
+  case S32: return 32;
+  case U64:
+  case S64: return 64;
+  }
+  return 64;
+}
+
+static inline bool inbuilt_signed(InbuiltType ty)
+{
+  return ty == S8 || ty >= S16;
+}
+
+// values of every type are kept in 64 bits, sign or zero extended from the
+// width of their type. this brings any 64 bit result into that form
+static inline uint64_t wrap_to(uint64_t v, InbuiltType ty)
+{
+  uint32_t sh = 64 - inbuilt_bits(ty);
+
+  if (inbuilt_signed(ty)) return (uint64_t)((int64_t)(v << sh) >> sh);
+  return v << sh >> sh;
+}
+
+// the sum of two values of type `ty` into `sum`, returns true if it doesn't
+// fit the type, in which case `sum` is the wrapped one
+static inline bool add_overflows(uint64_t a, uint64_t b, InbuiltType ty,
+                                 uint64_t *restrict sum)
+{
+  bool carry = inbuilt_signed(ty)
+                   ? __builtin_add_overflow((int64_t)a, (int64_t)b,
+                                            (int64_t *)sum)
+                   : __builtin_add_overflow(a, b, sum);
+  uint64_t exact = *sum;
+  *sum           = wrap_to(exact, ty);
+  return carry || *sum != exact;
+}
+
+// the same for negation, only zero negates without overflow if unsigned
+static inline bool neg_overflows(uint64_t a, InbuiltType ty,
+                                 uint64_t *restrict neg)
+{
+  if (!inbuilt_signed(ty))
+  {
+    *neg = wrap_to(-a, ty);
+    return a != 0;
+  }
+
+  bool carry     = __builtin_sub_overflow(0, (int64_t)a, (int64_t *)neg);
+  uint64_t exact = *neg;
+  *neg           = wrap_to(exact, ty);
+  return carry || *neg != exact;
+}
 
 #endif // _TYPES_H
@@ -0,0 +1,316 @@
+/*
+ * x86-64 code generation from the IR.
+ *
+ *  registers are assigned by linear scan over the live intervals of the
+ *  values of a function. since functions are straight line code, an
+ *  interval is just [definition, last use]. when no register is free the
+ *  interval that ends last is spilled into a stack slot, and spilled
+ *  operands are either used as memory operands or go through a scratch
+ *  register.
+ *
+ *  checked operations happen at the width of their type, so the flags tell
+ *  whether they overflowed, and are followed by a jump over a ud2. those
+ *  known not to overflow need no normalizing afterwards.
+ */
+
+#include "x64.h"
+
+enum
+{
+  RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+  R8,  R9,  R10, R11, R12, R13, R14, R15,
+};
+
+#define SCRATCH R11
+#define LOC_SLOT 0x80000000u /* a location is a register or a stack slot */
+#define LOC_NONE UINT32_MAX  /* the location of an instruction without value */
+
+static const uint8_t abi_params[X64_MAX_PARAMS] = {RDI, RSI, RDX,
+                                                   RCX, R8,  R9};
+static const uint8_t allocatable[] = {RAX, RCX, RDX, RSI, RDI, R8, R9, R10};
+
+#define NALLOC (sizeof(allocatable) / sizeof(*allocatable))
+
+static void byte(DynamicArray *restrict c, uint8_t b) { co_push(c, b); }
+
+static void imm32(DynamicArray *restrict c, uint32_t imm)
+{
+  uint8_t le[] = {(uint8_t)imm, (uint8_t)(imm >> 8), (uint8_t)(imm >> 16),
+                  (uint8_t)(imm >> 24)};
+  co_append(c, le, sizeof(le));
+}
+
+// REX prefix, opcode and ModRM (plus SIB and displacement for stack slots)
+// for an instruction with register operand `reg` and r/m operand `rm`
+static void op_rm(DynamicArray *restrict c, bool w, const uint8_t *opc,
+                  uint32_t nopc, uint8_t reg, uint32_t rm)
+{
+  bool slot = rm & LOC_SLOT;
+  uint32_t r = reg, b = slot ? 0 : (rm >> 3) & 1;
+
+  // always emitted, so sil/dil are reachable as byte registers
+  byte(c, (uint8_t)(0x40u | (uint32_t)w << 3 | (r >> 3) << 2 | b));
+  co_append(c, opc, nopc);
+
+  if (!slot)
+  {
+    byte(c, (uint8_t)(0xc0u | (r & 7) << 3 | (rm & 7)));
+    return;
+  }
+
+  byte(c, (uint8_t)(0x84u | (r & 7) << 3)); // [rsp + disp32]
+  byte(c, 0x24);
+  imm32(c, (rm & ~LOC_SLOT) * 8);
+}
+
+#define OP(c, w, reg, rm, ...)                                                 \
+  op_rm(c, w, (const uint8_t[]){__VA_ARGS__},                                  \
+        sizeof((const uint8_t[]){__VA_ARGS__}), reg, rm)
+
+static void mov_load(DynamicArray *restrict c, uint8_t reg, uint32_t rm)
+{
+  if (rm != reg) OP(c, 1, reg, rm, 0x8b);
+}
+
+static void mov_store(DynamicArray *restrict c, uint32_t rm, uint8_t reg)
+{
+  if (rm != reg) OP(c, 1, reg, rm, 0x89);
+}
+
+static void mov_imm(DynamicArray *restrict c, uint32_t rm, uint64_t imm)
+{
+  if ((uint64_t)(int64_t)(int32_t)imm == imm)
+  {
+    OP(c, 1, 0, rm, 0xc7);
+    imm32(c, (uint32_t)imm);
+    return;
+  }
+
+  uint8_t reg = rm & LOC_SLOT ? SCRATCH : (uint8_t)rm;
+  byte(c, (uint8_t)(0x48 | (reg >> 3)));
+  byte(c, (uint8_t)(0xb8 + (reg & 7)));
+  imm32(c, (uint32_t)imm);
+  imm32(c, (uint32_t)(imm >> 32));
+
+  if (rm & LOC_SLOT) mov_store(c, rm, reg);
+}
+
+// brings a 64 bit result into the canonical form of its type
+static void normalize(DynamicArray *restrict c, uint8_t reg, TypeId ty)
+{
+  switch (ty)
+  {
+  case U8:  OP(c, 0, reg, reg, 0x0f, 0xb6); break; // movzx r32, r8
+  case U16: OP(c, 0, reg, reg, 0x0f, 0xb7); break; // movzx r32, r16
+  case U32: OP(c, 0, reg, reg, 0x8b); break;       // mov r32, r32
+  case S8:  OP(c, 1, reg, reg, 0x0f, 0xbe); break; // movsx r64, r8
+  case S16: OP(c, 1, reg, reg, 0x0f, 0xbf); break; // movsx r64, r16
+  case S32: OP(c, 1, reg, reg, 0x63); break;       // movsxd r64, r32
+  default:  break;
+  }
+}
+
+// an instruction with an 8 bit form `opc8` and another form `opc`, at the
+// width of `ty`
+static void op_sized(DynamicArray *restrict c, TypeId ty, uint8_t opc8,
+                     uint8_t opc, uint8_t reg, uint32_t rm)
+{
+  switch (inbuilt_bits(ty))
+  {
+  case 8:  OP(c, 0, reg, rm, opc8); break;
+  case 16: byte(c, 0x66); OP(c, 0, reg, rm, opc); break;
+  case 32: OP(c, 0, reg, rm, opc); break;
+  default: OP(c, 1, reg, rm, opc); break;
+  }
+}
+
+// traps unless condition `cc` holds, jcc rel8 over ud2
+static void trap_unless(DynamicArray *restrict c, uint8_t cc)
+{
+  uint8_t insn[] = {(uint8_t)(0x70 | cc), 0x02, 0x0f, 0x0b};
+  co_append(c, insn, sizeof(insn));
+}
+
+#define CC_NO 0x1 /* no signed overflow */
+#define CC_AE 0x3 /* no carry */
+#define CC_B 0x2  /* below, unsigned */
+#define CC_L 0xc  /* less, signed */
+
+static void frame(DynamicArray *restrict c, uint8_t ext, uint32_t nslots)
+{
+  if (!nslots) return;
+
+  OP(c, 1, ext, RSP, 0x81); // add/sub rsp, imm32
+  imm32(c, nslots * 8);
+}
+
+typedef struct
+{
+  uint32_t v, last;
+} Interval;
+
+// returns the number of stack slots needed
+static uint32_t linear_scan(const IR *ir, uint32_t base, uint32_t n,
+                            const uint32_t *last, uint32_t *restrict loc)
+{
+  Interval active[NALLOC];
+  uint32_t nactive = 0, nslots = 0;
+  uint32_t free    = 0;
+
+  for (uint32_t i = 0; i < NALLOC; ++i)
+    free |= 1u << allocatable[i];
+
+  for (uint32_t v = 0; v < n; ++v)
+  {
+    // operands dying here give up their registers, the result may reuse them
+    for (uint32_t i = 0; i < nactive;)
+    {
+      if (active[i].last > v)
+      {
+        i++;
+        continue;
+      }
+      free |= 1u << loc[active[i].v];
+      active[i] = active[--nactive];
+    }
+
+    uint8_t op = ir->op[base + v];
+    if (op == IR_RET || op == IR_NOP || op == IR_ASSERT || op == IR_ASSUME)
+    {
+      loc[v] = LOC_NONE;
+      continue;
+    }
+
+    Interval iv = {.v = v, .last = last[v]};
+
+    if (op == IR_PARAM) loc[v] = abi_params[ir->a[base + v]];
+    else if (free) loc[v] = stdc_trailing_zeros_ui(free);
+    else
+    { // spill whatever lives the longest
+      uint32_t far = 0;
+      for (uint32_t i = 1; i < nactive; ++i)
+        if (active[i].last > active[far].last) far = i;
+
+      if (active[far].last <= iv.last)
+      {
+        loc[v] = LOC_SLOT | nslots++;
+        continue;
+      }
+
+      loc[v]             = loc[active[far].v];
+      loc[active[far].v] = LOC_SLOT | nslots++;
+      active[far]        = iv;
+      continue;
+    }
+
+    free &= ~(1u << loc[v]);
+    active[nactive++] = iv;
+  }
+
+  return nslots;
+}
+
+bool emit_x64(DynamicArray *restrict c, const IR *ir, const IRFunc *f)
+{
+  const IRBlock *blocks = ir->blocks.buffer;
+
+  uint32_t base = blocks[f->blk_beg].beg;
+  uint32_t n    = blocks[f->blk_end - 1].end - base;
+
+  if (f->nparams > X64_MAX_PARAMS) return false;
+  for (uint32_t v = f->nparams; v < n; ++v)
+    if (ir->op[base + v] == IR_PARAM) return false; // params come first
+
+  uint32_t *last = malloc(2 * n * sizeof(uint32_t));
+  uint32_t *loc  = last + n;
+  assert((last || !n) && "failed to allocate register maps");
+
+  for (uint32_t v = 0; v < n; ++v)
+  {
+    last[v] = v;
+
+    uint8_t op  = ir->op[base + v];
+    uint32_t nv = op == IR_ASSUME ? 0 : ir_nvals(op); // emits nothing
+    if (nv > 0) last[ir->a[base + v] - base] = v;
+    if (nv > 1) last[ir->b[base + v] - base] = v;
+  }
+
+  uint32_t nslots = linear_scan(ir, base, n, last, loc);
+
+  frame(c, 5, nslots); // sub rsp
+
+  for (uint32_t v = 0; v < n; ++v)
+  {
+    uint32_t i  = base + v;
+    TypeId ty   = ir->ty[i];
+    uint8_t dst = loc[v] & LOC_SLOT ? SCRATCH : (uint8_t)loc[v];
+    uint32_t a = 0, b = 0; // locations of the operands
+    uint32_t nv = ir_nvals(ir->op[i]);
+    if (nv > 0) a = loc[ir->a[i] - base];
+    if (nv > 1) b = loc[ir->b[i] - base];
+
+    bool sgn = inbuilt_signed(ty);
+
+    switch (ir->op[i])
+    {
+    case IR_PARAM:
+      dst = abi_params[ir->a[i]];
+      normalize(c, dst, ty);
+      mov_store(c, loc[v], dst);
+      break;
+    case IR_CONST: mov_imm(c, loc[v], ir_const(ir, i)); break;
+    case IR_NEG:
+    case IR_NEGC:
+    case IR_NEGX:
+      mov_load(c, dst, a);
+      if (ir->op[i] == IR_NEGC)
+      {
+        op_sized(c, ty, 0xf6, 0xf7, 3, dst); // neg
+        trap_unless(c, sgn ? CC_NO : CC_AE);
+      }
+      else OP(c, 1, 3, dst, 0xf7); // neg
+
+      if (ir->op[i] != IR_NEGX) normalize(c, dst, ty);
+      mov_store(c, loc[v], dst);
+      break;
+    case IR_ADD:
+    case IR_ADDC:
+    case IR_ADDX:
+      if (b == dst && a != b)
+      { // commutative
+        b = a;
+        a = dst;
+      }
+      mov_load(c, dst, a);
+      if (ir->op[i] == IR_ADDC)
+      {
+        op_sized(c, ty, 0x02, 0x03, dst, b); // add
+        trap_unless(c, sgn ? CC_NO : CC_AE);
+      }
+      else OP(c, 1, dst, b, 0x03); // add
+
+      if (ir->op[i] != IR_ADDX) normalize(c, dst, ty);
+      mov_store(c, loc[v], dst);
+      break;
+    case IR_ASSERT:
+    {
+      uint8_t ra = a & LOC_SLOT ? SCRATCH : (uint8_t)a;
+      mov_load(c, ra, a);
+      OP(c, 1, ra, b, 0x3b); // cmp
+      trap_unless(c, sgn ? CC_L : CC_B);
+      break;
+    }
+    case IR_RET:
+      mov_load(c, RAX, a);
+      frame(c, 0, nslots); // add rsp
+      byte(c, 0xc3);
+      v = n; // anything after it is unreachable
+      break;
+    default: break;
+    }
+  }
+
+  free(last);
+
+  return true;
+}
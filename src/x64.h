@@ -0,0 +1,14 @@
+#ifndef _X64_H
+#define _X64_H
+
+#include "ir.h"
+
+// up to this many arguments are passed in registers
+#define X64_MAX_PARAMS 6
+
+// appends the machine code for `f` to `code` (uint8_t), following the SysV
+// calling convention. returns false, without appending anything, if `f` uses
+// something the backend can't handle
+bool emit_x64(DynamicArray *restrict code, const IR *ir, const IRFunc *f);
+
+#endif // _X64_H
@@ -0,0 +1,98 @@
+#!/bin/sh
+
+# runs the regression inputs in tests/ against the binaries in a build dir.
+# every input says what it expects in comments:
+#
+#   // run: fn[Ty, ...] args... => result   the result of a call, `trap` if
+#                                           it traps, `fail` if funrun fails
+#   // typer: line                          a line typer prints for the file,
+#                                           diagnostics without the path
+#
+# calls are run interpreted, jitted and through a cold and a warm cache, and
+# the tree of every input has to survive a round trip through a dump
+
+if [ $# -ne 1 ]
+then
+  echo "usage: $0 <build dir>"
+  exit 1
+fi
+
+build=$1
+run="$build/funrun"
+tests=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+passed=0
+failed=0
+
+fail()
+{
+  echo "FAIL $*"
+  failed=$((failed + 1))
+}
+
+# the outcome of a funrun invocation, as written after `=>`
+outcome()
+{
+  # the shell reports the signal on its own stderr
+  { out=$("$@"); } 2>/dev/null
+  case $? in
+  0) echo "$out" ;;
+  132) echo trap ;; # SIGILL, from ud2 and __builtin_trap alike
+  *) echo fail ;;
+  esac
+}
+
+check()
+{
+  if [ "$3" = "$4" ]; then passed=$((passed + 1))
+  else fail "$1: $2: expected $3, got $4"
+  fi
+}
+
+for f in "$tests"/*.funlang
+do
+  cache="$tmp/cache"
+  rm -rf "$cache" && mkdir "$cache"
+
+  sed -n 's|^// run: ||p' "$f" > "$tmp/runs"
+  while read -r call
+  do
+    want=${call##*=> }
+    call=${call% =>*}
+    fn=${call%% *}
+    [ "$fn" = "$call" ] && args= || args=${call#* }
+
+    # word splitting on `args` is what passes the arguments
+    # shellcheck disable=SC2086
+    {
+      check "$f" "$call" "$want" "$(outcome "$run" "$f" "$fn" $args)"
+      check "$f" "-j $call" "$want" "$(outcome "$run" -j "$f" "$fn" $args)"
+      for pass in cold warm
+      do
+        check "$f" "$pass cache $call" "$want" \
+          "$(outcome env FUNLANG_CACHE="$cache" "$run" "$f" "$fn" $args)"
+      done
+    }
+  done < "$tmp/runs"
+
+  # diagnostics are matched without the path in front
+  "$build/typer" "$f" 2>&1 | sed "s|^$f:||" > "$tmp/typer"
+  sed -n 's|^// typer: ||p' "$f" > "$tmp/lines"
+  while read -r line
+  do
+    if grep -qxF "$line" "$tmp/typer"; then passed=$((passed + 1))
+    else fail "$f: typer doesn't print \`$line\`"
+    fi
+  done < "$tmp/lines"
+
+  if "$build/fundump" -o "$tmp/tree.ftd" "$f" 2>/dev/null &&
+     [ -z "$("$build/fundump" -d "$f" "$tmp/tree.ftd" 2>&1)" ]
+  then passed=$((passed + 1))
+  else fail "$f: the tree changes through a dump"
+  fi
+done
+
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]